@@ -0,0 +1,18 @@
+#! /usr/bin/env bash
+
+set -e
+
+# Create the extension from the 1.2.5 release script, then update it with
+# the scripts of the current tree
+EXTDIR=$(pg_config --sharedir)/extension
+git fetch --depth 1 origin tag v1.2.5
+git show v1.2.5:pgsql/pointcloud.sql.in \
+  | cpp -traditional-cpp -w -P -Ipgsql \
+  | sed -e 's/#POINTCLOUD_VERSION#/1.2.5/' > pointcloud--1.2.5-release.sql
+cp $EXTDIR/pointcloud--1.2.5.sql pointcloud--1.2.5-current.sql
+sudo cp pointcloud--1.2.5-release.sql $EXTDIR/pointcloud--1.2.5.sql
+createdb test_upgrade
+psql -v ON_ERROR_STOP=1 test_upgrade -c "CREATE EXTENSION pointcloud VERSION '1.2.5'"
+sudo cp pointcloud--1.2.5-current.sql $EXTDIR/pointcloud--1.2.5.sql
+psql -v ON_ERROR_STOP=1 test_upgrade -c "ALTER EXTENSION pointcloud UPDATE TO '1.2.5next'"
+psql -v ON_ERROR_STOP=1 test_upgrade < .github/scripts/test_upgrade.sql
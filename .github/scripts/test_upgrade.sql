@@ -0,0 +1,5 @@
+-- aggregates added since 1.2.5 must exist after the update
+SELECT 'PC_GridAgg(pcpatch, float8[], float8, int4, int4, text, text)'::regprocedure;
+SELECT 'PC_VoxelFilterAgg(pcpatch, float8)'::regprocedure;
+SELECT 'PC_AsArrowAgg(pcpatch)'::regprocedure;
+SELECT 'PC_AsArrowAgg(pcpatch, boolean)'::regprocedure;
@@ -152,6 +152,35 @@ static void test_run_length_encoding()
   pc_bytes_free(pcb2);
 }
 
+/*
+ * Build a run-length encoded column of one repeated
+ * value, longer than a single run can hold.
+ */
+static void test_constant_encoding()
+{
+  const PCDIMENSION *dim = pc_schema_get_dimension_by_name(schema, "X");
+  int32_t value = 1234;
+  PCBYTES epcb, pcb;
+  int i;
+
+  epcb = pc_bytes_make_constant(dim, (uint8_t *)&value, 600);
+  CU_ASSERT_EQUAL(epcb.compression, PC_DIM_RLE);
+  CU_ASSERT_EQUAL(epcb.npoints, 600);
+  CU_ASSERT_EQUAL(epcb.size, 3 * (1 + sizeof(int32_t)));
+
+  pcb = pc_bytes_run_length_decode(epcb);
+  CU_ASSERT_EQUAL(pcb.npoints, 600);
+  for (i = 0; i < 600; i++)
+    CU_ASSERT_EQUAL(((int32_t *)pcb.bytes)[i], value);
+  pc_bytes_free(pcb);
+  pc_bytes_free(epcb);
+
+  epcb = pc_bytes_make_constant(dim, (uint8_t *)&value, 0);
+  CU_ASSERT_EQUAL(epcb.npoints, 0);
+  CU_ASSERT(pc_bytes_empty(&epcb));
+  pc_bytes_free(epcb);
+}
+
 /*
  * Strip the common bits off a stream and pack the
  * remaining bits in behind. Test bit counting and
@@ -519,9 +548,10 @@ static void test_uncompressed_filter()
 /* REGISTER ***********************************************************/
 
 CU_TestInfo bytes_tests[] = {
-    PC_TEST(test_run_length_encoding), PC_TEST(test_sigbits_encoding),
-    PC_TEST(test_zlib_encoding),       PC_TEST(test_rle_filter),
-    PC_TEST(test_uncompressed_filter), CU_TEST_INFO_NULL};
+    PC_TEST(test_run_length_encoding), PC_TEST(test_constant_encoding),
+    PC_TEST(test_sigbits_encoding),    PC_TEST(test_zlib_encoding),
+    PC_TEST(test_rle_filter),          PC_TEST(test_uncompressed_filter),
+    CU_TEST_INFO_NULL};
 
 CU_SuiteInfo bytes_suite = {.pName = "bytes",
                             .pInitFunc = init_suite,
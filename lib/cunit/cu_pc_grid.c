@@ -0,0 +1,283 @@
+/***********************************************************************
+ * cu_pc_grid.c
+ *
+ *        Testing for the gridding and retiling API functions
+ *
+ ***********************************************************************/
+
+#include "CUnit/Basic.h"
+#include "cu_tester.h"
+
+/* GLOBALS ************************************************************/
+
+static PCSCHEMA *schema = NULL;
+static const char *xmlfile = "data/simple-schema.xml";
+static const double precision = 0.000001;
+
+// SIMPLE SCHEMA
+// int32_t x
+// int32_t y
+// int32_t z
+// int16_t intensity
+
+/* Setup/teardown for this suite */
+static int init_suite(void)
+{
+  char *xmlstr = file_to_str(xmlfile);
+  schema = pc_schema_from_xml(xmlstr);
+  pcfree(xmlstr);
+  if (!schema)
+    return 1;
+  return 0;
+}
+
+static int clean_suite(void)
+{
+  pc_schema_free(schema);
+  return 0;
+}
+
+/* A 4x4 set of points with x, y in [0.5, 3.5] and z = x + y */
+static PCPATCH *grid_test_patch(enum COMPRESSIONS compression)
+{
+  PCPOINTLIST *pl = pc_pointlist_make(16);
+  PCPATCH *pa, *pacomp;
+  int i, j;
+
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < 4; j++)
+    {
+      PCPOINT *pt = pc_point_make(schema);
+      pc_point_set_double_by_name(pt, "x", i + 0.5);
+      pc_point_set_double_by_name(pt, "y", j + 0.5);
+      pc_point_set_double_by_name(pt, "z", i + j + 1);
+      pc_point_set_double_by_name(pt, "intensity", 10 * i + j);
+      pc_pointlist_add_point(pl, pt);
+    }
+  }
+
+  pa = pc_patch_from_pointlist(pl);
+  pc_pointlist_free(pl);
+
+  if (compression == PC_DIMENSIONAL)
+  {
+    PCPATCH_DIMENSIONAL *pdl =
+        pc_patch_dimensional_from_uncompressed((PCPATCH_UNCOMPRESSED *)pa);
+    PCDIMSTATS *pds = pc_dimstats_make(schema);
+    pc_dimstats_update(pds, pdl);
+    pacomp = (PCPATCH *)pc_patch_dimensional_compress(pdl, pds);
+    pc_dimstats_free(pds);
+    pc_patch_free((PCPATCH *)pdl);
+    pc_patch_free(pa);
+    pa = pacomp;
+  }
+  return pa;
+}
+
+/* TESTS **************************************************************/
+
+static void test_grid_agg_from_string()
+{
+  PC_GRIDAGG agg;
+  CU_ASSERT_SUCCESS(pc_grid_agg_from_string("min", &agg));
+  CU_ASSERT_EQUAL(agg, PC_GRID_MIN);
+  CU_ASSERT_SUCCESS(pc_grid_agg_from_string("MEAN", &agg));
+  CU_ASSERT_EQUAL(agg, PC_GRID_MEAN);
+  CU_ASSERT_SUCCESS(pc_grid_agg_from_string("last", &agg));
+  CU_ASSERT_EQUAL(agg, PC_GRID_LAST);
+  CU_ASSERT_FAILURE(pc_grid_agg_from_string("median", &agg));
+}
+
+static void test_grid_make_invalid()
+{
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_grid_make(0, 0, 0, 2, 2, PC_GRID_MIN));
+  CU_ASSERT_PTR_NULL(pc_grid_make(0, 0, 1, 0, 2, PC_GRID_MIN));
+}
+
+static void test_grid_patch(enum COMPRESSIONS compression)
+{
+  PCPATCH *pa = grid_test_patch(compression);
+  PCGRID *grid;
+  double v;
+
+  // 2x2 cells of size 2 covering all the points
+  grid = pc_grid_make(0, 0, 2, 2, 2, PC_GRID_MAX);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, "Z"));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 0, 0, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 3, precision);
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 1, 0, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 5, precision);
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 0, 1, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 5, precision);
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 1, 1, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 7, precision);
+  pc_grid_free(grid);
+
+  grid = pc_grid_make(0, 0, 2, 2, 2, PC_GRID_MIN);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, "Z"));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 1, 1, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 5, precision);
+  pc_grid_free(grid);
+
+  grid = pc_grid_make(0, 0, 2, 2, 2, PC_GRID_MEAN);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, "Intensity"));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 1, 0, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 25.5, precision);
+  pc_grid_free(grid);
+
+  grid = pc_grid_make(0, 0, 2, 2, 2, PC_GRID_LAST);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, "Intensity"));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 0, 1, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 13, precision);
+  pc_grid_free(grid);
+
+  // 3x3 cells of size 1 shifted by two cells: partial coverage
+  grid = pc_grid_make(2, 2, 1, 3, 3, PC_GRID_COUNT);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, NULL));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 0, 0, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 1, precision);
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 2, 2, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 0, precision);
+  pc_grid_free(grid);
+
+  // grid away from the patch
+  grid = pc_grid_make(100, 100, 1, 3, 3, PC_GRID_MIN);
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa, "Z"));
+  CU_ASSERT_FAILURE(pc_grid_get_value(grid, 0, 0, &v));
+  pc_grid_free(grid);
+
+  // unknown dimension
+  grid = pc_grid_make(0, 0, 2, 2, 2, PC_GRID_MIN);
+  cu_error_msg_reset();
+  CU_ASSERT_FAILURE(pc_grid_add_patch(grid, pa, "nodim"));
+  pc_grid_free(grid);
+
+  pc_patch_free(pa);
+}
+
+static void test_grid_uncompressed() { test_grid_patch(PC_NONE); }
+
+static void test_grid_dimensional() { test_grid_patch(PC_DIMENSIONAL); }
+
+static void test_grid_several_patches()
+{
+  PCPATCH *pa1 = grid_test_patch(PC_NONE);
+  PCPATCH *pa2 = grid_test_patch(PC_DIMENSIONAL);
+  PCGRID *grid = pc_grid_make(0, 0, 4, 1, 1, PC_GRID_COUNT);
+  double v;
+
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa1, NULL));
+  CU_ASSERT_SUCCESS(pc_grid_add_patch(grid, pa2, NULL));
+  CU_ASSERT_SUCCESS(pc_grid_get_value(grid, 0, 0, &v));
+  CU_ASSERT_DOUBLE_EQUAL(v, 32, precision);
+
+  pc_grid_free(grid);
+  pc_patch_free(pa1);
+  pc_patch_free(pa2);
+}
+
+static void test_retile_make_invalid()
+{
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_retile_make(schema, 0, 10));
+  CU_ASSERT_PTR_NULL(pc_retile_make(schema, 1, 0));
+}
+
+static void test_retile()
+{
+  PCPATCH *pa1 = grid_test_patch(PC_NONE);
+  PCPATCH *pa2 = grid_test_patch(PC_DIMENSIONAL);
+  PCRETILE *rt = pc_retile_make(schema, 2, 3);
+  PCPATCH *pa;
+  int64_t key;
+  double x;
+  uint32_t nparts = 0, npoints = 0;
+
+  // 2x2 tiles of 4 points per patch, full tiles flushed every 3 points
+  CU_ASSERT_SUCCESS(pc_retile_add_patch(rt, pa1));
+  pa = pc_retile_pop(rt, &key);
+  CU_ASSERT_PTR_NOT_NULL(pa);
+  CU_ASSERT_EQUAL(key, pc_retile_key(0, 0));
+  CU_ASSERT_EQUAL(pa->npoints, 3);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmin, 0.5, precision);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmax, 1.5, precision);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymax, 1.5, precision);
+  CU_ASSERT_SUCCESS(pc_point_get_x(&(pa->stats->max), &x));
+  CU_ASSERT_DOUBLE_EQUAL(x, 1.5, precision);
+  pc_patch_free(pa);
+  while ((pa = pc_retile_pop(rt, NULL)))
+  {
+    CU_ASSERT_EQUAL(pa->npoints, 3);
+    pc_patch_free(pa);
+  }
+
+  CU_ASSERT_SUCCESS(pc_retile_add_patch(rt, pa2));
+  pc_retile_flush(rt);
+  while ((pa = pc_retile_pop(rt, &key)))
+  {
+    int32_t col = (int32_t)(pa->bounds.xmin / 2);
+    int32_t row = (int32_t)(pa->bounds.ymin / 2);
+    CU_ASSERT_EQUAL(key, pc_retile_key(col, row));
+    CU_ASSERT(pa->bounds.xmax < 2 * (col + 1));
+    CU_ASSERT(pa->bounds.ymax < 2 * (row + 1));
+    CU_ASSERT(pa->npoints <= 3);
+    npoints += pa->npoints;
+    nparts++;
+    pc_patch_free(pa);
+  }
+  // 1 patch of 3 points per tile popped above, 8 - 3 points left per tile
+  CU_ASSERT_EQUAL(npoints, 20);
+  CU_ASSERT_EQUAL(nparts, 8);
+
+  pc_retile_free(rt);
+  pc_patch_free(pa1);
+  pc_patch_free(pa2);
+}
+
+static void test_retile_negative()
+{
+  PCPOINTLIST *pl = pc_pointlist_make(2);
+  PCRETILE *rt = pc_retile_make(schema, 10, 100);
+  PCPOINT *pt;
+  PCPATCH *pa;
+  int64_t key;
+
+  pt = pc_point_make(schema);
+  pc_point_set_double_by_name(pt, "x", -0.5);
+  pc_point_set_double_by_name(pt, "y", -15);
+  pc_pointlist_add_point(pl, pt);
+  pa = pc_patch_from_pointlist(pl);
+
+  CU_ASSERT_SUCCESS(pc_retile_add_patch(rt, pa));
+  CU_ASSERT_PTR_NULL(pc_retile_pop(rt, &key));
+  pc_retile_flush(rt);
+  pc_patch_free(pa);
+  pa = pc_retile_pop(rt, &key);
+  CU_ASSERT_PTR_NOT_NULL(pa);
+  CU_ASSERT_EQUAL(key, pc_retile_key(-1, -2));
+  CU_ASSERT_EQUAL(pa->npoints, 1);
+  pc_patch_free(pa);
+  CU_ASSERT_PTR_NULL(pc_retile_pop(rt, &key));
+
+  pc_retile_free(rt);
+  pc_pointlist_free(pl);
+}
+
+/* REGISTER ***********************************************************/
+
+CU_TestInfo grid_tests[] = {PC_TEST(test_grid_agg_from_string),
+                            PC_TEST(test_grid_make_invalid),
+                            PC_TEST(test_grid_uncompressed),
+                            PC_TEST(test_grid_dimensional),
+                            PC_TEST(test_grid_several_patches),
+                            PC_TEST(test_retile_make_invalid),
+                            PC_TEST(test_retile),
+                            PC_TEST(test_retile_negative),
+                            CU_TEST_INFO_NULL};
+
+CU_SuiteInfo grid_suite = {.pName = "grid",
+                           .pInitFunc = init_suite,
+                           .pCleanupFunc = clean_suite,
+                           .pTests = grid_tests};
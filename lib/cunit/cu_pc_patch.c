@@ -630,6 +630,146 @@ static void test_patch_filter()
   return;
 }
 
+/*
+ * The JSON of patches, written from their columns, is the one of the
+ * points formatted with printf
+ */
+static void test_patch_to_string_columns()
+{
+  int i, j;
+  int npts = 600;
+  PCPOINTLIST *pl;
+  PCPATCH *pu, *pd, *pdc;
+  char *str, *expected, *ptr;
+  const char *pcids = "{\"pcid\":0,\"pts\":[";
+
+  pl = pc_pointlist_make(npts);
+  for (i = 0; i < npts; i++)
+  {
+    PCPOINT *pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "x", -100000 - i * 0.37);
+    pc_point_set_double_by_name(pt, "y", i * 0.01);
+    pc_point_set_double_by_name(pt, "Z", i * 1000);
+    pc_point_set_double_by_name(pt, "intensity", i % 7);
+    pc_pointlist_add_point(pl, pt);
+  }
+
+  expected = pcalloc(npts * 64 + 32);
+  ptr = expected + sprintf(expected, "%s", pcids);
+  for (i = 0; i < npts; i++)
+  {
+    PCPOINT *pt = pc_pointlist_get_point(pl, i);
+    ptr += sprintf(ptr, i ? ",[" : "[");
+    for (j = 0; j < simpleschema->ndims; j++)
+    {
+      double d;
+      pc_point_get_double_by_index(pt, j, &d);
+      ptr += sprintf(ptr, j ? ",%g" : "%g", d);
+    }
+    ptr += sprintf(ptr, "]");
+  }
+  sprintf(ptr, "]}");
+
+  pu = (PCPATCH *)pc_patch_uncompressed_from_pointlist(pl);
+  str = pc_patch_to_string(pu);
+  CU_ASSERT_STRING_EQUAL(str, expected);
+  pcfree(str);
+
+  pd = (PCPATCH *)pc_patch_dimensional_from_pointlist(pl);
+  pdc = (PCPATCH *)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL *)pd,
+                                                 NULL);
+  str = pc_patch_to_string(pdc);
+  CU_ASSERT_STRING_EQUAL(str, expected);
+  pcfree(str);
+
+  pc_patch_free(pdc);
+  pc_patch_free(pd);
+  pc_patch_free(pu);
+  pc_pointlist_free(pl);
+  pcfree(expected);
+}
+
+static void test_patch_voxel_filter()
+{
+  int i;
+  int npts = 20;
+  PCPOINTLIST *pl;
+  PCPATCH *pa[2], *pf;
+  PC_VOXELMODE mode;
+  char *str;
+
+  pl = pc_pointlist_make(npts);
+  for (i = 0; i < npts; i++)
+  {
+    PCPOINT *pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "x", i * 0.5);
+    pc_point_set_double_by_name(pt, "y", 1);
+    pc_point_set_double_by_name(pt, "Z", i % 2);
+    pc_point_set_double_by_name(pt, "intensity", i);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pa[0] = (PCPATCH *)pc_patch_uncompressed_from_pointlist(pl);
+  pa[1] = (PCPATCH *)pc_patch_dimensional_from_pointlist(pl);
+
+  for (i = 0; i < 2; i++)
+  {
+    // 2x2x2 voxels hold four points on X, two on Z
+    pf = pc_patch_voxel_filter(pa[i], 2, PC_VOXEL_FIRST);
+    CU_ASSERT_EQUAL(pf->type, pa[i]->type);
+    CU_ASSERT_EQUAL(pf->npoints, 5);
+    CU_ASSERT_DOUBLE_EQUAL(pf->bounds.xmax, 8, 0.000001);
+    str = pc_patch_to_string(pf);
+    CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pts\":[[0,1,0,0],[2,1,0,4],"
+                                "[4,1,0,8],[6,1,0,12],[8,1,0,16]]}");
+    pcfree(str);
+    pc_patch_free(pf);
+
+    pf = pc_patch_voxel_filter(pa[i], 2, PC_VOXEL_CENTROID);
+    CU_ASSERT_EQUAL(pf->type, simpleschema->compression);
+    CU_ASSERT_EQUAL(pf->npoints, 5);
+    CU_ASSERT_DOUBLE_EQUAL(pf->bounds.xmin, 0.75, 0.000001);
+    str = pc_patch_to_string(pf);
+    CU_ASSERT_STRING_EQUAL(str,
+                           "{\"pcid\":0,\"pts\":[[0.75,1,0.5,0],[2.75,1,0.5,4],"
+                           "[4.75,1,0.5,8],[6.75,1,0.5,12],[8.75,1,0.5,16]]}");
+    pcfree(str);
+    pc_patch_free(pf);
+
+    // equidistant points, the first one wins
+    pf = pc_patch_voxel_filter(pa[i], 2, PC_VOXEL_CLOSEST);
+    CU_ASSERT_EQUAL(pf->type, pa[i]->type);
+    str = pc_patch_to_string(pf);
+    CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pts\":[[0.5,1,1,1],[2.5,1,1,5],"
+                                "[4.5,1,1,9],[6.5,1,1,13],[8.5,1,1,17]]}");
+    pcfree(str);
+    pc_patch_free(pf);
+
+    // voxels smaller than the points spacing keep everything
+    pf = pc_patch_voxel_filter(pa[i], 0.25, PC_VOXEL_FIRST);
+    CU_ASSERT_EQUAL(pf->npoints, npts);
+    pc_patch_free(pf);
+
+    // a single voxel
+    pf = pc_patch_voxel_filter(pa[i], 100, PC_VOXEL_FIRST);
+    CU_ASSERT_EQUAL(pf->npoints, 1);
+    pc_patch_free(pf);
+  }
+
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_patch_voxel_filter(pa[0], 0, PC_VOXEL_FIRST));
+  CU_ASSERT_PTR_NULL(pc_patch_voxel_filter(pa[0], -1, PC_VOXEL_FIRST));
+
+  CU_ASSERT_SUCCESS(pc_voxel_mode_from_string("Centroid", &mode));
+  CU_ASSERT_EQUAL(mode, PC_VOXEL_CENTROID);
+  CU_ASSERT_SUCCESS(pc_voxel_mode_from_string("closest", &mode));
+  CU_ASSERT_EQUAL(mode, PC_VOXEL_CLOSEST);
+  CU_ASSERT_FAILURE(pc_voxel_mode_from_string("random", &mode));
+
+  pc_pointlist_free(pl);
+  pc_patch_free(pa[0]);
+  pc_patch_free(pa[1]);
+}
+
 static void test_patch_pointn_last_first()
 {
   // 00 endian (big)
@@ -1154,10 +1294,11 @@ test_patch_set_schema_dimensional_compression(enum DIMCOMPRESSIONS dimcomp)
 {
   // init data
   PCPATCH_DIMENSIONAL *padim1, *padim2;
-  PCPATCH *pat;
+  PCPATCH *pat, *pat1;
   PCPOINT *pt;
   PCPOINTLIST *pl;
   char *str;
+  double d;
   int i;
   int npts = PCDIMSTATS_MIN_SAMPLE + 1; // force to keep custom compression
 
@@ -1188,11 +1329,32 @@ test_patch_set_schema_dimensional_compression(enum DIMCOMPRESSIONS dimcomp)
   // assign a valid schema to the patch
   pat = pc_patch_set_schema((PCPATCH *)padim2, simpleschema_nointensity, 0.0);
   CU_ASSERT(pat != NULL);
+  CU_ASSERT_EQUAL(pat->type, PC_DIMENSIONAL);
+  CU_ASSERT_EQUAL(((PCPATCH_DIMENSIONAL *)pat)->bytes[0].compression,
+                  padim2->bytes[0].compression);
   pt = pc_patch_pointn(pat, 1);
   str = pc_point_to_string(pt);
   CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pt\":[1000.1,2000.2,3000.3]}");
   pcfree(str);
   pc_point_free(pt);
+
+  // the missing dimension is filled with a constant encoded column
+  pat1 = pc_patch_set_schema(pat, simpleschema, 7.0);
+  CU_ASSERT(pat1 != NULL);
+  CU_ASSERT_EQUAL(pat1->type, PC_DIMENSIONAL);
+  CU_ASSERT_EQUAL(((PCPATCH_DIMENSIONAL *)pat1)->bytes[3].compression,
+                  PC_DIM_RLE);
+  pt = pc_patch_pointn(pat1, npts + 1);
+  str = pc_point_to_string(pt);
+  CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pt\":[0,0,0,7]}");
+  pcfree(str);
+  pc_point_free(pt);
+  CU_ASSERT_DOUBLE_EQUAL(pat1->bounds.xmax, pat->bounds.xmax, 0.000001);
+  pc_point_get_double_by_name(&pat1->stats->min, "Intensity", &d);
+  CU_ASSERT_DOUBLE_EQUAL(d, 7, 0.000001);
+  pc_point_get_double_by_name(&pat1->stats->max, "Z", &d);
+  CU_ASSERT_DOUBLE_EQUAL(d, npts * 0.3, 0.000001);
+  pc_patch_free(pat1);
   pc_patch_free(pat);
 
   pc_pointlist_free(pl);
@@ -1314,6 +1476,570 @@ static void test_patch_transform_compression_none()
   pc_pointlist_free(pl);
 }
 
+static void test_transform_plan()
+{
+  PCTRANSFORM *plan;
+  PCSCHEMA *nschema;
+
+  // same schema: a single copy of the whole point
+  plan = pc_transform_make(simpleschema, simpleschema, 0.0, PC_TRUE);
+  CU_ASSERT_EQUAL(plan->nops, 1);
+  CU_ASSERT_EQUAL(plan->ops[0].type, PC_TRANSFORM_COPY);
+  CU_ASSERT_EQUAL(plan->ops[0].size, simpleschema->size);
+  pc_transform_free(plan);
+
+  // dropped dimension: a single copy of the leading dimensions
+  plan = pc_transform_make(simpleschema, simpleschema_nointensity, 0.0,
+                           PC_TRUE);
+  CU_ASSERT_EQUAL(plan->nops, 1);
+  CU_ASSERT_EQUAL(plan->ops[0].type, PC_TRANSFORM_COPY);
+  CU_ASSERT_EQUAL(plan->ops[0].size, simpleschema_nointensity->size);
+  pc_transform_free(plan);
+
+  // added dimension: a copy and a fill
+  plan = pc_transform_make(simpleschema_nointensity, simpleschema, 0.0,
+                           PC_TRUE);
+  CU_ASSERT_EQUAL(plan->nops, 2);
+  CU_ASSERT_EQUAL(plan->ops[0].type, PC_TRANSFORM_COPY);
+  CU_ASSERT_EQUAL(plan->ops[1].type, PC_TRANSFORM_FILL);
+  CU_ASSERT_EQUAL(plan->ops[1].to, simpleschema->dims[3]->byteoffset);
+  pc_transform_free(plan);
+
+  // rescaled dimension: converted when transforming, copied when relabeling
+  nschema = pc_schema_clone(simpleschema);
+  nschema->ydim->scale = 0.02;
+  plan = pc_transform_make(simpleschema, nschema, 0.0, PC_TRUE);
+  CU_ASSERT_EQUAL(plan->nops, 3);
+  CU_ASSERT_EQUAL(plan->ops[0].type, PC_TRANSFORM_COPY);
+  CU_ASSERT_EQUAL(plan->ops[1].type, PC_TRANSFORM_CONVERT);
+  CU_ASSERT_EQUAL(plan->ops[2].type, PC_TRANSFORM_COPY);
+  pc_transform_free(plan);
+  plan = pc_transform_make(simpleschema, nschema, 0.0, PC_FALSE);
+  CU_ASSERT_EQUAL(plan->nops, 1);
+  pc_transform_free(plan);
+
+  // different interpretation: only allowed when transforming
+  nschema->dims[3]->interpretation = PC_INT16;
+  plan = pc_transform_make(simpleschema, nschema, 0.0, PC_TRUE);
+  CU_ASSERT_EQUAL(plan->nops, 4);
+  CU_ASSERT_EQUAL(plan->ops[3].type, PC_TRANSFORM_CONVERT);
+  pc_transform_free(plan);
+  plan = pc_transform_make(simpleschema, nschema, 0.0, PC_FALSE);
+  CU_ASSERT(plan == NULL);
+
+  pc_schema_free(nschema);
+}
+
+static void test_patch_transform_plan_dimensional()
+{
+  PCPATCH_UNCOMPRESSED *pau;
+  PCPATCH_DIMENSIONAL *padim;
+  PCTRANSFORM *plan;
+  PCSCHEMA *nschema;
+  PCPOINTLIST *pl;
+  PCPATCH *pa1, *pa2;
+  PCPOINT *pt;
+  double v;
+  int i;
+  int npts = 400;
+
+  pl = pc_pointlist_make(npts);
+  for (i = 0; i < npts; i++)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.01);
+    pc_point_set_double_by_name(pt, "Y", i * 0.02);
+    pc_point_set_double_by_name(pt, "Z", i * 0.03);
+    pc_point_set_double_by_name(pt, "Intensity", i % 7);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pau = pc_patch_uncompressed_from_pointlist(pl);
+  padim = pc_patch_dimensional_from_uncompressed(pau);
+
+  nschema = pc_schema_clone(simpleschema);
+  nschema->xdim->scale = 0.1;
+  nschema->zdim->offset = 5;
+
+  // one plan for many patches, same result as the one-shot transform
+  plan = pc_transform_make(simpleschema, nschema, 0.0, PC_TRUE);
+  CU_ASSERT(plan != NULL);
+  pa1 = pc_patch_transform_plan((PCPATCH *)padim, plan);
+  pa2 = pc_patch_transform((PCPATCH *)pau, nschema, 0.0);
+  CU_ASSERT(pa1 != NULL);
+  CU_ASSERT(pa2 != NULL);
+  CU_ASSERT_EQUAL(pa1->npoints, npts);
+  CU_ASSERT_EQUAL(memcmp(((PCPATCH_UNCOMPRESSED *)pa1)->data,
+                         ((PCPATCH_UNCOMPRESSED *)pa2)->data,
+                         npts * nschema->size),
+                  0);
+  CU_ASSERT_DOUBLE_EQUAL(pa1->bounds.xmax, 4.0, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa1->bounds.ymax, 7.98, 0.000001);
+
+  pt = pc_patch_pointn(pa1, 124);
+  pc_point_get_x(pt, &v);
+  CU_ASSERT_DOUBLE_EQUAL(v, 1.2, 0.000001);
+  pc_point_get_double_by_name(pt, "Z", &v);
+  CU_ASSERT_DOUBLE_EQUAL(v, 3.69, 0.000001);
+  pc_point_get_double_by_name(pt, "Intensity", &v);
+  CU_ASSERT_DOUBLE_EQUAL(v, 4, 0.000001);
+  pc_point_free(pt);
+
+  pc_patch_free(pa1);
+  pc_patch_free(pa2);
+  pc_transform_free(plan);
+  pc_schema_free(nschema);
+  pc_patch_free((PCPATCH *)padim);
+  pc_patch_free((PCPATCH *)pau);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_set_schema_no_stats()
+{
+  PCPATCH_UNCOMPRESSED *pau;
+  PCPOINTLIST *pl;
+  PCPATCH *pa;
+  PCPOINT *pt;
+  int i;
+
+  pl = pc_pointlist_make(4);
+  for (i = 0; i < 4; i++)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.1);
+    pc_point_set_double_by_name(pt, "Y", i * 0.2);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pau = pc_patch_uncompressed_from_pointlist(pl);
+  pc_stats_free(pau->stats);
+  pau->stats = NULL;
+
+  // the bounds are carried over
+  pa = pc_patch_set_schema((PCPATCH *)pau, simpleschema_nointensity, 0.0);
+  CU_ASSERT(pa != NULL);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmin, 0, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmax, 0.3, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymin, 0, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymax, 0.6, 0.000001);
+
+  pc_patch_free(pa);
+  pc_patch_free((PCPATCH *)pau);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_project_compression_none()
+{
+  PCPATCH_UNCOMPRESSED *pau;
+  PCPOINTLIST *pl;
+  PCSCHEMA *nschema;
+  PCPATCH *pa;
+  PCPOINT *pt;
+  char *str;
+  int i;
+  int npts = 4;
+
+  pl = pc_pointlist_make(npts);
+  for (i = npts; i >= 0; i--)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.1);
+    pc_point_set_double_by_name(pt, "Y", i * 0.2);
+    pc_point_set_double_by_name(pt, "Z", i * 0.3);
+    pc_point_set_double_by_name(pt, "Intensity", 10);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pau = pc_patch_uncompressed_from_pointlist(pl);
+
+  pa = pc_patch_project((PCPATCH *)pau, simpleschema_nointensity);
+  CU_ASSERT(pa != NULL);
+  CU_ASSERT_EQUAL(pa->type, PC_NONE);
+  str = pc_patch_to_string(pa);
+  CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pts\":[[0.4,0.8,1.2],[0.3,0.6,0.9]"
+                              ",[0.2,0.4,0.6],[0.1,0.2,0.3],[0,0,0]]}");
+  pcfree(str);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmax, 0.4, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymax, 0.8, 0.000001);
+  pc_patch_free(pa);
+
+  // dimensions missing from the patch cannot be kept
+  pa = pc_patch_project((PCPATCH *)pau, schema);
+  CU_ASSERT(pa == NULL);
+
+  // dimensions with different scales cannot be kept as they are
+  nschema = pc_schema_clone(simpleschema_nointensity);
+  nschema->xdim->scale = 0.1;
+  pa = pc_patch_project((PCPATCH *)pau, nschema);
+  CU_ASSERT(pa == NULL);
+  pc_schema_free(nschema);
+
+  pc_patch_free((PCPATCH *)pau);
+  pc_pointlist_free(pl);
+}
+
+static void
+test_patch_project_dimensional_compression(enum DIMCOMPRESSIONS dimcomp)
+{
+  PCPATCH_DIMENSIONAL *padim1, *padim2;
+  PCPATCH_DIMENSIONAL *pdl;
+  PCDIMSTATS *stats;
+  PCPOINTLIST *pl;
+  PCPATCH *pa;
+  PCPOINT *pt;
+  char *str;
+  double v;
+  int i;
+  int npts = PCDIMSTATS_MIN_SAMPLE + 1; // force to keep custom compression
+
+  pl = pc_pointlist_make(npts);
+  for (i = npts; i >= 0; i--)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.1);
+    pc_point_set_double_by_name(pt, "Y", i * 0.2);
+    pc_point_set_double_by_name(pt, "Z", i * 0.3);
+    pc_point_set_double_by_name(pt, "Intensity", 10);
+    pc_pointlist_add_point(pl, pt);
+  }
+  padim1 = pc_patch_dimensional_from_pointlist(pl);
+
+  stats = pc_dimstats_make(simpleschema);
+  pc_dimstats_update(stats, padim1);
+  for (i = 0; i < padim1->schema->ndims; i++)
+    stats->stats[i].recommended_compression = dimcomp;
+  padim2 = pc_patch_dimensional_compress(padim1, stats);
+
+  // the columns are kept encoded
+  pa = pc_patch_project((PCPATCH *)padim2, simpleschema_nointensity);
+  CU_ASSERT(pa != NULL);
+  CU_ASSERT_EQUAL(pa->type, PC_DIMENSIONAL);
+  pdl = (PCPATCH_DIMENSIONAL *)pa;
+  for (i = 0; i < simpleschema_nointensity->ndims; i++)
+  {
+    CU_ASSERT_EQUAL(pdl->bytes[i].compression, padim2->bytes[i].compression);
+    CU_ASSERT_EQUAL(pdl->bytes[i].size, padim2->bytes[i].size);
+  }
+
+  pt = pc_patch_pointn(pa, 1);
+  str = pc_point_to_string(pt);
+  CU_ASSERT_STRING_EQUAL(str, "{\"pcid\":0,\"pt\":[1000.1,2000.2,3000.3]}");
+  pcfree(str);
+  pc_point_free(pt);
+
+  // and so are the stats and bounds
+  pc_point_get_double_by_name(&pa->stats->max, "Z", &v);
+  CU_ASSERT_DOUBLE_EQUAL(v, 3000.3, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmax, padim2->bounds.xmax, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymin, padim2->bounds.ymin, 0.000001);
+
+  pc_patch_free(pa);
+  pc_pointlist_free(pl);
+  pc_dimstats_free(stats);
+  pc_patch_free((PCPATCH *)padim1);
+  pc_patch_free((PCPATCH *)padim2);
+}
+
+static void test_patch_project_dimensional_compression_none()
+{
+  test_patch_project_dimensional_compression(PC_DIM_NONE);
+}
+
+static void test_patch_project_dimensional_compression_zlib()
+{
+  test_patch_project_dimensional_compression(PC_DIM_ZLIB);
+}
+
+static void test_patch_project_dimensional_compression_sigbits()
+{
+  test_patch_project_dimensional_compression(PC_DIM_SIGBITS);
+}
+
+static void test_patch_project_dimensional_compression_rle()
+{
+  test_patch_project_dimensional_compression(PC_DIM_RLE);
+}
+
+static const double affine_matrix[12] = {0, 1, 0, 10, 1, 0, 0, 20,
+                                         0, 0, 2, 0.5};
+
+static void test_patch_affine_compression_none()
+{
+  PCPATCH_UNCOMPRESSED *pau;
+  PCPATCH *pa;
+  PCPOINTLIST *pl;
+  PCPOINT *pt;
+  char *str;
+  double d, m[12];
+  int i;
+  int npts = 4;
+
+  pl = pc_pointlist_make(npts);
+  for (i = npts; i >= 0; i--)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.1);
+    pc_point_set_double_by_name(pt, "Y", i * 0.2);
+    pc_point_set_double_by_name(pt, "Z", i * 0.3);
+    pc_point_set_double_by_name(pt, "Intensity", 10);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pau = pc_patch_uncompressed_from_pointlist(pl);
+
+  // swap X and Y, scale Z, and translate all of them
+  pa = pc_patch_affine((PCPATCH *)pau, affine_matrix);
+  CU_ASSERT(pa != NULL);
+  CU_ASSERT_EQUAL(pa->type, PC_NONE);
+  str = pc_patch_to_string(pa);
+  CU_ASSERT_STRING_EQUAL(
+      str, "{\"pcid\":0,\"pts\":[[10.8,20.4,2.9,10],[10.6,20.3,2.3,10],"
+           "[10.4,20.2,1.7,10],[10.2,20.1,1.1,10],[10,20,0.5,10]]}");
+  pcfree(str);
+
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmin, 10, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.xmax, 10.8, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymin, 20, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa->bounds.ymax, 20.4, 0.000001);
+  pc_point_get_double_by_name(&pa->stats->max, "Z", &d);
+  CU_ASSERT_DOUBLE_EQUAL(d, 2.9, 0.000001);
+  pc_point_get_double_by_name(&pa->stats->avg, "X", &d);
+  CU_ASSERT_DOUBLE_EQUAL(d, 10.4, 0.000001);
+  pc_point_get_double_by_name(&pa->stats->min, "Intensity", &d);
+  CU_ASSERT_DOUBLE_EQUAL(d, 10, 0.000001);
+  pc_patch_free(pa);
+
+  // matrices must be finite
+  memcpy(m, affine_matrix, sizeof(m));
+  m[10] = NAN;
+  CU_ASSERT(pc_patch_affine((PCPATCH *)pau, m) == NULL);
+
+  pc_patch_free((PCPATCH *)pau);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_affine_dimensional(enum DIMCOMPRESSIONS dimcomp)
+{
+  PCPATCH_DIMENSIONAL *padim1, *padim2;
+  PCPATCH_UNCOMPRESSED *pau;
+  PCPATCH *pa1, *pa2;
+  PCDIMSTATS *stats;
+  PCPOINTLIST *pl;
+  PCPOINT *pt;
+  char *str1, *str2;
+  double d1, d2;
+  int i;
+  int npts = PCDIMSTATS_MIN_SAMPLE + 1; // force to keep custom compression
+
+  pl = pc_pointlist_make(npts);
+  for (i = npts; i >= 0; i--)
+  {
+    pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "X", i * 0.1);
+    pc_point_set_double_by_name(pt, "Y", i * 0.2);
+    pc_point_set_double_by_name(pt, "Z", i * 0.3);
+    pc_point_set_double_by_name(pt, "Intensity", i % 7);
+    pc_pointlist_add_point(pl, pt);
+  }
+
+  padim1 = pc_patch_dimensional_from_pointlist(pl);
+  stats = pc_dimstats_make(simpleschema);
+  pc_dimstats_update(stats, padim1);
+  for (i = 0; i < padim1->schema->ndims; i++)
+    stats->stats[i].recommended_compression = dimcomp;
+  padim2 = pc_patch_dimensional_compress(padim1, stats);
+  pau = pc_patch_uncompressed_from_pointlist(pl);
+
+  pa1 = pc_patch_affine((PCPATCH *)padim2, affine_matrix);
+  pa2 = pc_patch_affine((PCPATCH *)pau, affine_matrix);
+  CU_ASSERT(pa1 != NULL && pa2 != NULL);
+
+  // the columns keep their encodings, untouched ones are copied
+  CU_ASSERT_EQUAL(pa1->type, PC_DIMENSIONAL);
+  for (i = 0; i < simpleschema->ndims; i++)
+    CU_ASSERT_EQUAL(((PCPATCH_DIMENSIONAL *)pa1)->bytes[i].compression,
+                    padim2->bytes[i].compression);
+  CU_ASSERT_EQUAL(((PCPATCH_DIMENSIONAL *)pa1)->bytes[3].size,
+                  padim2->bytes[3].size);
+  CU_ASSERT_EQUAL(memcmp(((PCPATCH_DIMENSIONAL *)pa1)->bytes[3].bytes,
+                         padim2->bytes[3].bytes, padim2->bytes[3].size),
+                  0);
+
+  str1 = pc_patch_to_string(pa1);
+  str2 = pc_patch_to_string(pa2);
+  CU_ASSERT_STRING_EQUAL(str1, str2);
+  pcfree(str1);
+  pcfree(str2);
+
+  CU_ASSERT_DOUBLE_EQUAL(pa1->bounds.xmin, pa2->bounds.xmin, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(pa1->bounds.ymax, pa2->bounds.ymax, 0.000001);
+  for (i = 0; i < simpleschema->ndims; i++)
+  {
+    pc_point_get_double(&pa1->stats->avg, simpleschema->dims[i], &d1);
+    pc_point_get_double(&pa2->stats->avg, simpleschema->dims[i], &d2);
+    CU_ASSERT_DOUBLE_EQUAL(d1, d2, 0.000001);
+  }
+
+  pc_patch_free(pa1);
+  pc_patch_free(pa2);
+  pc_patch_free((PCPATCH *)pau);
+  pc_patch_free((PCPATCH *)padim1);
+  pc_patch_free((PCPATCH *)padim2);
+  pc_dimstats_free(stats);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_affine_dimensional_compression_none()
+{
+  test_patch_affine_dimensional(PC_DIM_NONE);
+}
+
+static void test_patch_affine_dimensional_compression_zlib()
+{
+  test_patch_affine_dimensional(PC_DIM_ZLIB);
+}
+
+static void test_patch_affine_dimensional_compression_sigbits()
+{
+  test_patch_affine_dimensional(PC_DIM_SIGBITS);
+}
+
+static void test_patch_affine_dimensional_compression_rle()
+{
+  test_patch_affine_dimensional(PC_DIM_RLE);
+}
+
+static uint8_t *test_patch_arrow_stream(const PCPATCH *pa, int scaled,
+                                        size_t *size)
+{
+  PCARROW *arrow = pc_arrow_make(pa->schema, scaled);
+  uint8_t *stream;
+
+  CU_ASSERT_EQUAL(pc_arrow_add_patch(arrow, pa), PC_SUCCESS);
+  *size = pc_arrow_stream_size(arrow);
+  stream = pcalloc(*size);
+  pc_arrow_stream_copy(arrow, stream);
+  pc_arrow_free(arrow);
+  return stream;
+}
+
+static void test_patch_arrow()
+{
+  static const uint8_t eos[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+  int i;
+  int npts = 300;
+  PCPOINTLIST *pl;
+  PCPATCH *pu, *pd, *pdc;
+  uint8_t *su, *sd;
+  size_t usize, dsize;
+  double d;
+
+  pl = pc_pointlist_make(npts);
+  for (i = 0; i < npts; i++)
+  {
+    PCPOINT *pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "x", i * 0.01);
+    pc_point_set_double_by_name(pt, "y", -i * 0.01);
+    pc_point_set_double_by_name(pt, "Z", i);
+    pc_point_set_double_by_name(pt, "intensity", i % 5);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pu = (PCPATCH *)pc_patch_uncompressed_from_pointlist(pl);
+  pd = (PCPATCH *)pc_patch_dimensional_from_pointlist(pl);
+  pdc = (PCPATCH *)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL *)pd,
+                                                 NULL);
+
+  /* dimensional patches give the same columns */
+  su = test_patch_arrow_stream(pu, PC_FALSE, &usize);
+  sd = test_patch_arrow_stream(pdc, PC_FALSE, &dsize);
+  CU_ASSERT_EQUAL(usize % 8, 0);
+  CU_ASSERT_EQUAL(usize, dsize);
+  CU_ASSERT_EQUAL(memcmp(su, sd, usize), 0);
+  CU_ASSERT_EQUAL(memcmp(su, eos, 4), 0);
+  CU_ASSERT_EQUAL(memcmp(su + usize - 8, eos, 8), 0);
+  pcfree(su);
+  pcfree(sd);
+
+  /* the scaled intensity column ends the last batch */
+  su = test_patch_arrow_stream(pu, PC_TRUE, &usize);
+  sd = test_patch_arrow_stream(pdc, PC_TRUE, &dsize);
+  CU_ASSERT_EQUAL(usize, dsize);
+  CU_ASSERT_EQUAL(memcmp(su, sd, usize), 0);
+  memcpy(&d, su + usize - 16, 8);
+  CU_ASSERT_DOUBLE_EQUAL(d, 4, 0.000001);
+  memcpy(&d, su + usize - 16 - 8 * npts, 8);
+  CU_ASSERT_DOUBLE_EQUAL(d, 299, 0.000001);
+  pcfree(su);
+  pcfree(sd);
+
+  pc_patch_free(pdc);
+  pc_patch_free(pd);
+  pc_patch_free(pu);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_get_columns()
+{
+  int i;
+  int npts = 300;
+  PCPOINTLIST *pl;
+  PCPATCH *pu, *pd, *pdc;
+  const PCDIMENSION *dims[2];
+  double *uvals, *dvals;
+  int64_t *raw;
+
+  pl = pc_pointlist_make(npts);
+  for (i = 0; i < npts; i++)
+  {
+    PCPOINT *pt = pc_point_make(simpleschema);
+    pc_point_set_double_by_name(pt, "x", i * 0.01);
+    pc_point_set_double_by_name(pt, "y", -i * 0.01);
+    pc_point_set_double_by_name(pt, "Z", i);
+    pc_point_set_double_by_name(pt, "intensity", i % 5);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pu = (PCPATCH *)pc_patch_uncompressed_from_pointlist(pl);
+  pd = (PCPATCH *)pc_patch_dimensional_from_pointlist(pl);
+  pdc = (PCPATCH *)pc_patch_dimensional_compress((PCPATCH_DIMENSIONAL *)pd,
+                                                 NULL);
+
+  dims[0] = pc_schema_get_dimension_by_name(simpleschema, "Y");
+  dims[1] = pc_schema_get_dimension_by_name(simpleschema, "Intensity");
+  uvals = pcalloc(2 * npts * sizeof(double));
+  dvals = pcalloc(2 * npts * sizeof(double));
+  raw = pcalloc(2 * npts * sizeof(int64_t));
+
+  /* one column after the other, whatever the compression */
+  CU_ASSERT_EQUAL(pc_patch_get_columns(pu, dims, 2, uvals), PC_SUCCESS);
+  CU_ASSERT_EQUAL(pc_patch_get_columns(pdc, dims, 2, dvals), PC_SUCCESS);
+  CU_ASSERT_EQUAL(memcmp(uvals, dvals, 2 * npts * sizeof(double)), 0);
+  CU_ASSERT_DOUBLE_EQUAL(uvals[7], -0.07, 0.000001);
+  CU_ASSERT_DOUBLE_EQUAL(uvals[npts + 7], 2, 0.000001);
+
+  /* raw values are the stored integers */
+  CU_ASSERT_EQUAL(pc_patch_get_raw_columns(pdc, dims, 2, raw), PC_SUCCESS);
+  CU_ASSERT_EQUAL(raw[7], -7);
+  CU_ASSERT_EQUAL(raw[npts + 7], 2);
+
+  pcfree(raw);
+  pcfree(dvals);
+  pcfree(uvals);
+  pc_patch_free(pdc);
+  pc_patch_free(pd);
+  pc_patch_free(pu);
+  pc_pointlist_free(pl);
+}
+
+static void test_patch_get_raw_columns_float()
+{
+  PCPATCH *pa;
+  const PCDIMENSION *dim;
+  int64_t raw[1];
+
+  /* GPS time is a double */
+  dim = pc_schema_get_dimension_by_name(schema, "Time");
+  CU_ASSERT_EQUAL(dim->interpretation, PC_DOUBLE);
+  pa = (PCPATCH *)pc_patch_uncompressed_make(schema, 1);
+  CU_ASSERT_EQUAL(pc_patch_get_raw_columns(pa, &dim, 1, raw), PC_FAILURE);
+  pc_patch_free(pa);
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo patch_tests[] = {
@@ -1328,6 +2054,10 @@ CU_TestInfo patch_tests[] = {
     PC_TEST(test_patch_union),
     PC_TEST(test_patch_wkb),
     PC_TEST(test_patch_filter),
+    PC_TEST(test_patch_to_string_columns),
+    PC_TEST(test_patch_voxel_filter),
+    PC_TEST(test_patch_get_columns),
+    PC_TEST(test_patch_get_raw_columns_float),
     PC_TEST(test_patch_pointn_last_first),
     PC_TEST(test_patch_pointn_no_compression),
     PC_TEST(test_patch_pointn_dimensional_compression_none),
@@ -1359,6 +2089,20 @@ CU_TestInfo patch_tests[] = {
     PC_TEST(test_patch_set_schema_compression_lazperf),
 #endif
     PC_TEST(test_patch_transform_compression_none),
+    PC_TEST(test_transform_plan),
+    PC_TEST(test_patch_transform_plan_dimensional),
+    PC_TEST(test_patch_set_schema_no_stats),
+    PC_TEST(test_patch_project_compression_none),
+    PC_TEST(test_patch_project_dimensional_compression_none),
+    PC_TEST(test_patch_project_dimensional_compression_zlib),
+    PC_TEST(test_patch_project_dimensional_compression_sigbits),
+    PC_TEST(test_patch_project_dimensional_compression_rle),
+    PC_TEST(test_patch_affine_compression_none),
+    PC_TEST(test_patch_affine_dimensional_compression_none),
+    PC_TEST(test_patch_affine_dimensional_compression_zlib),
+    PC_TEST(test_patch_affine_dimensional_compression_sigbits),
+    PC_TEST(test_patch_affine_dimensional_compression_rle),
+    PC_TEST(test_patch_arrow),
     CU_TEST_INFO_NULL};
 
 CU_SuiteInfo patch_suite = {.pName = "patch",
@@ -228,6 +228,63 @@ static void test_schema_clone(void)
   pc_schema_free(clone);
 }
 
+static void test_schema_bytes(void)
+{
+  int i;
+  size_t size;
+  uint8_t *bytes = pc_schema_to_bytes(schema, &size);
+  PCSCHEMA *myschema;
+  char *myxmlfile = "data/simple-schema-no-name.xml";
+  char *xmlstr;
+  PCSCHEMA *s = pc_schema_from_bytes(bytes, size);
+
+  CU_ASSERT_PTR_NOT_NULL(s);
+  CU_ASSERT_EQUAL(s->pcid, schema->pcid);
+  CU_ASSERT_EQUAL(s->srid, schema->srid);
+  CU_ASSERT_EQUAL(s->ndims, schema->ndims);
+  CU_ASSERT_EQUAL(s->size, schema->size);
+  CU_ASSERT_EQUAL(s->compression, schema->compression);
+  CU_ASSERT_EQUAL(s->xdim->position, schema->xdim->position);
+  CU_ASSERT_EQUAL(s->ydim->position, schema->ydim->position);
+  CU_ASSERT_EQUAL(s->zdim->position, schema->zdim->position);
+  CU_ASSERT_EQUAL(s->mdim->position, schema->mdim->position);
+  for (i = 0; i < schema->ndims; ++i)
+  {
+    PCDIMENSION *dim = schema->dims[i];
+    PCDIMENSION *sdim = s->dims[i];
+    CU_ASSERT_STRING_EQUAL(sdim->name, dim->name);
+    CU_ASSERT_STRING_EQUAL(sdim->description, dim->description);
+    CU_ASSERT_EQUAL(sdim->position, dim->position);
+    CU_ASSERT_EQUAL(sdim->size, dim->size);
+    CU_ASSERT_EQUAL(sdim->byteoffset, dim->byteoffset);
+    CU_ASSERT_EQUAL(sdim->interpretation, dim->interpretation);
+    CU_ASSERT_EQUAL(sdim->scale, dim->scale);
+    CU_ASSERT_EQUAL(sdim->offset, dim->offset);
+    CU_ASSERT_EQUAL(sdim->active, dim->active);
+    CU_ASSERT_EQUAL(sdim, pc_schema_get_dimension_by_name(s, dim->name));
+  }
+  pc_schema_free(s);
+
+  /* truncated bytes are rejected */
+  CU_ASSERT_PTR_NULL(pc_schema_from_bytes(bytes, size - 1));
+  CU_ASSERT_PTR_NULL(pc_schema_from_bytes(bytes, 20));
+  pcfree(bytes);
+
+  /* names may be missing */
+  xmlstr = file_to_str(myxmlfile);
+  myschema = pc_schema_from_xml(xmlstr);
+  bytes = pc_schema_to_bytes(myschema, &size);
+  s = pc_schema_from_bytes(bytes, size);
+  CU_ASSERT_PTR_NOT_NULL(s);
+  CU_ASSERT_EQUAL(s->ndims, myschema->ndims);
+  CU_ASSERT_PTR_NULL(s->dims[0]->name);
+  CU_ASSERT_PTR_NULL(s->dims[0]->description);
+  pc_schema_free(s);
+  pc_schema_free(myschema);
+  pcfree(bytes);
+  pcfree(xmlstr);
+}
+
 static void test_schema_clone_empty_description(void)
 {
   PCSCHEMA *myschema, *clone;
@@ -415,6 +472,70 @@ static void test_schema_same_interpretations(void)
   pc_schema_free(s2);
 }
 
+static void test_schema_is_projection(void)
+{
+  PCSCHEMA *s1, *s2;
+  char *xmlstr;
+
+  xmlstr = file_to_str("data/simple-schema.xml");
+  s1 = pc_schema_from_xml(xmlstr);
+  pcfree(xmlstr);
+
+  xmlstr = file_to_str("data/simple-schema-no-intensity.xml");
+  s2 = pc_schema_from_xml(xmlstr);
+  pcfree(xmlstr);
+
+  // a subset of the dimensions
+  CU_ASSERT_EQUAL(pc_schema_is_projection(s1, s2), PC_TRUE);
+  CU_ASSERT_EQUAL(pc_schema_is_projection(s1, s1), PC_TRUE);
+
+  // a dimension missing from s1
+  CU_ASSERT_EQUAL(pc_schema_is_projection(s2, s1), PC_FALSE);
+
+  // different scales for a dimension
+  s2->dims[1]->scale = 0.08;
+  CU_ASSERT_EQUAL(pc_schema_is_projection(s1, s2), PC_FALSE);
+
+  pc_schema_free(s1);
+  pc_schema_free(s2);
+}
+
+static void test_dimension_accessors(void)
+{
+  PCSCHEMA *s2 = pc_schema_clone(schema);
+  uint8_t buf[3 * 8];
+  double vals[3] = {42, 0, 127};
+  double out[3];
+  int i;
+
+  for (i = 0; i < schema->ndims; i++)
+  {
+    PCDIMENSION *dim = schema->dims[i];
+
+    // a single value
+    memset(buf, 0, sizeof(buf));
+    dim->write(buf, 42);
+    CU_ASSERT_DOUBLE_EQUAL(dim->read(buf), 42, 0);
+    CU_ASSERT_DOUBLE_EQUAL(pc_double_from_ptr(buf, dim->interpretation), 42,
+                           0);
+
+    // strided values
+    dim->write_array(buf, 8, vals, 3);
+    dim->read_array(out, buf, 8, 3);
+    CU_ASSERT_DOUBLE_EQUAL(out[0], 42, 0);
+    CU_ASSERT_DOUBLE_EQUAL(out[1], 0, 0);
+    CU_ASSERT_DOUBLE_EQUAL(out[2], 127, 0);
+    CU_ASSERT_DOUBLE_EQUAL(pc_double_from_ptr(buf + 16, dim->interpretation),
+                           127, 0);
+
+    // resolved again for the clones
+    CU_ASSERT(s2->dims[i]->read == dim->read);
+    CU_ASSERT(s2->dims[i]->write_array == dim->write_array);
+  }
+
+  pc_schema_free(s2);
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo schema_tests[] = {
@@ -430,11 +551,14 @@ CU_TestInfo schema_tests[] = {
     PC_TEST(test_schema_missing_dimension),
     PC_TEST(test_schema_empty),
     PC_TEST(test_schema_clone),
+    PC_TEST(test_schema_bytes),
     PC_TEST(test_schema_clone_empty_description),
     PC_TEST(test_schema_clone_no_name),
     PC_TEST(test_schema_clone_empty_name),
     PC_TEST(test_schema_same_dimensions),
     PC_TEST(test_schema_same_interpretations),
+    PC_TEST(test_schema_is_projection),
+    PC_TEST(test_dimension_accessors),
     CU_TEST_INFO_NULL};
 
 CU_SuiteInfo schema_suite = {.pName = "schema",
@@ -11,7 +11,11 @@
 /* GLOBALS ************************************************************/
 
 static PCSCHEMA *schema = NULL;
+static PCSCHEMA *schema_xy = NULL;
+static PCSCHEMA *schema_types = NULL;
 static const char *xmlfile = "data/simple-schema.xml";
+static const char *xmlfile_xy = "data/simple-schema-xy.xml";
+static const char *xmlfile_types = "data/simple-schema-laz-multiple-dim.xml";
 static const double precision = 0.000001;
 
 // SIMPLE SCHEMA
@@ -28,12 +32,26 @@ static int init_suite(void)
   pcfree(xmlstr);
   if (!schema)
     return 1;
+
+  xmlstr = file_to_str(xmlfile_xy);
+  schema_xy = pc_schema_from_xml(xmlstr);
+  pcfree(xmlstr);
+  if (!schema_xy)
+    return 1;
+
+  xmlstr = file_to_str(xmlfile_types);
+  schema_types = pc_schema_from_xml(xmlstr);
+  pcfree(xmlstr);
+  if (!schema_types)
+    return 1;
   return 0;
 }
 
 static int clean_suite(void)
 {
   pc_schema_free(schema);
+  pc_schema_free(schema_xy);
+  pc_schema_free(schema_types);
   return 0;
 }
 
@@ -371,6 +389,402 @@ static void test_sort_patch_ndims()
   pc_patch_free(pa);
 }
 
+static void test_sort_types(enum COMPRESSIONS compression)
+{
+  // int64_t X, double Y, float Z, uint64_t Intensity
+  double vals[] = {1,  -2.5, 3,  5, -1, 0, -1.5, 2, 1, -2.5,
+                   -3, 7,    -3, 4, 0,  1, 1,    1, 2, 0};
+  const char *X[] = {"X"};
+  const char *Y_Z[] = {"Y", "Z"};
+  const char *Z[] = {"Z"};
+  const char *I[] = {"Intensity"};
+  const char **dims[] = {X, Y_Z, Z, I};
+  int ndims[] = {1, 2, 1, 1};
+  double expected[][5] = {
+      {1, 2, 5, 7, 0}, {7, 5, 2, 0, 1}, {7, 2, 1, 0, 5}, {0, 1, 2, 5, 7}};
+  PCPOINTLIST *pl = pc_pointlist_make(5);
+  PCPATCH *pa, *pasort;
+  int i, j;
+
+  for (i = 0; i < 5; i++)
+    pc_pointlist_add_point(
+        pl, pc_point_from_double_array(schema_types, vals + 4 * i, 0, 4));
+  pa = pc_patch_from_pointlist(pl);
+
+  if (compression == PC_DIMENSIONAL)
+  {
+    PCPATCH_DIMENSIONAL *pdl =
+        pc_patch_dimensional_from_uncompressed((PCPATCH_UNCOMPRESSED *)pa);
+    PCDIMSTATS *pds = pc_dimstats_make(schema_types);
+    pc_dimstats_update(pds, pdl);
+    pc_patch_free(pa);
+    pa = (PCPATCH *)pc_patch_dimensional_compress(pdl, pds);
+    pc_dimstats_free(pds);
+    pc_patch_free((PCPATCH *)pdl);
+  }
+
+  for (i = 0; i < 4; i++)
+  {
+    pasort = pc_patch_sort(pa, dims[i], ndims[i]);
+    CU_ASSERT_EQUAL(pasort->type, pa->type);
+    CU_ASSERT_EQUAL(pc_patch_is_sorted(pasort, dims[i], ndims[i], PC_TRUE),
+                    PC_TRUE);
+    for (j = 0; j < 5; j++)
+    {
+      double d;
+      PCPOINT *pt = pc_patch_pointn(pasort, j + 1);
+      pc_point_get_double_by_name(pt, "Intensity", &d);
+      CU_ASSERT_DOUBLE_EQUAL(d, expected[i][j], precision);
+      pc_point_free(pt);
+    }
+    pc_patch_free(pasort);
+  }
+
+  pc_patch_free(pa);
+  pc_pointlist_free(pl);
+}
+
+static void test_sort_types_no_compression()
+{
+  test_sort_types(PC_NONE);
+}
+
+static void test_sort_types_compression_dimensional()
+{
+  test_sort_types(PC_DIMENSIONAL);
+}
+
+static void test_sort_radix()
+{
+  uint32_t i, n = 1000;
+  uint64_t seed = 42;
+  PCSORTKEY *keys = pcalloc(n * sizeof(PCSORTKEY));
+
+  // pseudo-random keys over the full 64 bits, with many duplicates
+  for (i = 0; i < n; i++)
+  {
+    seed = seed * UINT64_C(6364136223846793005) + 1;
+    keys[i].key = (seed >> 58) << 40 | (seed >> 62);
+    keys[i].index = i;
+  }
+
+  pc_sortkeys_sort(keys, n);
+  for (i = 1; i < n; i++)
+  {
+    CU_ASSERT(keys[i - 1].key <= keys[i].key);
+    // stable
+    if (keys[i - 1].key == keys[i].key)
+      CU_ASSERT(keys[i - 1].index < keys[i].index);
+  }
+
+  pcfree(keys);
+}
+
+/* A 4x4 grid of points with raw X and Y in [0, 3], in reverse order */
+static PCPATCH *sort_spatial_patch(enum COMPRESSIONS compression)
+{
+  PCPOINTLIST *pl = pc_pointlist_make(16);
+  PCPATCH *pa, *pacomp;
+  int i;
+
+  for (i = 15; i >= 0; i--)
+  {
+    PCPOINT *pt = pc_point_make(schema_xy);
+    pc_point_set_double_by_name(pt, "X", i / 4);
+    pc_point_set_double_by_name(pt, "Y", 2 * (i % 4));
+    pc_point_set_double_by_name(pt, "Intensity", 3 * i);
+    pc_pointlist_add_point(pl, pt);
+  }
+
+  pa = pc_patch_from_pointlist(pl);
+  pc_pointlist_free(pl);
+
+  if (compression == PC_DIMENSIONAL)
+  {
+    pacomp = (PCPATCH *)pc_patch_dimensional_from_uncompressed(
+        (PCPATCH_UNCOMPRESSED *)pa);
+    pc_patch_free(pa);
+    pa = pacomp;
+  }
+  return pa;
+}
+
+static void test_sort_spatial(enum COMPRESSIONS compression)
+{
+  PCPATCH *pa = sort_spatial_patch(compression);
+  PCPATCH *pasort;
+  PCPOINT *pt;
+  double x, y, lastx = 0, lasty = 0;
+  int i;
+
+  // morton order of the first quadrant: (0,0) (0,1) (1,0) (1,1)
+  pasort = pc_patch_sort_spatial(pa, PC_SORT_MORTON);
+  CU_ASSERT_EQUAL(pasort->type, pa->type);
+  CU_ASSERT_EQUAL(pasort->npoints, 16);
+  for (i = 0; i < 4; i++)
+  {
+    pt = pc_patch_pointn(pasort, i + 1);
+    pc_point_get_double_by_name(pt, "X", &x);
+    pc_point_get_double_by_name(pt, "Y", &y);
+    CU_ASSERT_DOUBLE_EQUAL(x, i / 2, precision);
+    CU_ASSERT_DOUBLE_EQUAL(y, 2 * (i % 2), precision);
+    pc_point_free(pt);
+  }
+  CU_ASSERT_DOUBLE_EQUAL(pasort->bounds.xmax, 3, precision);
+  pc_patch_free(pasort);
+
+  // hilbert order moves by a single step between consecutive points
+  pasort = pc_patch_sort_spatial(pa, PC_SORT_HILBERT);
+  CU_ASSERT_EQUAL(pasort->type, pa->type);
+  for (i = 0; i < 16; i++)
+  {
+    pt = pc_patch_pointn(pasort, i + 1);
+    pc_point_get_double_by_name(pt, "X", &x);
+    pc_point_get_double_by_name(pt, "Y", &y);
+    if (i == 0)
+    {
+      CU_ASSERT_DOUBLE_EQUAL(x, 0, precision);
+      CU_ASSERT_DOUBLE_EQUAL(y, 0, precision);
+    }
+    else
+      CU_ASSERT_DOUBLE_EQUAL(fabs(x - lastx) + fabs(y - lasty) / 2, 1,
+                             precision);
+    lastx = x;
+    lasty = y;
+    pc_point_free(pt);
+  }
+  pc_patch_free(pasort);
+
+  pc_patch_free(pa);
+}
+
+static void test_sort_spatial_no_compression()
+{
+  test_sort_spatial(PC_NONE);
+}
+
+static void test_sort_spatial_compression_dimensional()
+{
+  test_sort_spatial(PC_DIMENSIONAL);
+}
+
+static void test_sort_spatial_from_string()
+{
+  PC_SPATIALSORT curve;
+  CU_ASSERT_SUCCESS(pc_spatialsort_from_string("Morton", &curve));
+  CU_ASSERT_EQUAL(curve, PC_SORT_MORTON);
+  CU_ASSERT_SUCCESS(pc_spatialsort_from_string("hilbert", &curve));
+  CU_ASSERT_EQUAL(curve, PC_SORT_HILBERT);
+  CU_ASSERT_SUCCESS(pc_spatialsort_from_string("LOD", &curve));
+  CU_ASSERT_EQUAL(curve, PC_SORT_LOD);
+  CU_ASSERT_FAILURE(pc_spatialsort_from_string("geohash", &curve));
+}
+
+/* A 10x10 grid of points with X and Y in [0, 9] */
+static PCPATCH *split_patch(enum COMPRESSIONS compression)
+{
+  PCPOINTLIST *pl = pc_pointlist_make(100);
+  PCPATCH *pa, *pacomp;
+  int i;
+
+  for (i = 0; i < 100; i++)
+  {
+    PCPOINT *pt = pc_point_make(schema);
+    pc_point_set_double_by_name(pt, "X", i % 10);
+    pc_point_set_double_by_name(pt, "Y", i / 10);
+    pc_point_set_double_by_name(pt, "Z", 0);
+    pc_point_set_double_by_name(pt, "Intensity", i);
+    pc_pointlist_add_point(pl, pt);
+  }
+
+  pa = pc_patch_from_pointlist(pl);
+  pc_pointlist_free(pl);
+
+  if (compression == PC_DIMENSIONAL)
+  {
+    PCPATCH_DIMENSIONAL *pdl =
+        pc_patch_dimensional_from_uncompressed((PCPATCH_UNCOMPRESSED *)pa);
+    PCDIMSTATS *pds = pc_dimstats_make(schema);
+    pc_dimstats_update(pds, pdl);
+    pacomp = (PCPATCH *)pc_patch_dimensional_compress(pdl, pds);
+    pc_dimstats_free(pds);
+    pc_patch_free((PCPATCH *)pdl);
+    pc_patch_free(pa);
+    pa = pacomp;
+  }
+  return pa;
+}
+
+static void test_split(enum COMPRESSIONS compression, PC_SPLITMODE mode)
+{
+  PCPATCH *pa = split_patch(compression);
+  PCPATCH **parts;
+  uint32_t i, nparts, npoints = 0;
+  double sum = 0;
+
+  parts = pc_patch_split(pa, 30, mode, &nparts);
+  CU_ASSERT(nparts >= 4);
+  for (i = 0; i < nparts; i++)
+  {
+    PCPATCH *pu;
+    double avg, min, max;
+    CU_ASSERT_EQUAL(parts[i]->type, pa->type);
+    CU_ASSERT(parts[i]->npoints > 0 && parts[i]->npoints <= 30);
+    npoints += parts[i]->npoints;
+
+    // bounds and stats match the points of the part
+    pc_point_get_double_by_name(&(parts[i]->stats->avg), "Intensity", &avg);
+    sum += avg * parts[i]->npoints;
+    pu = pc_patch_uncompress(parts[i]);
+    pc_patch_uncompressed_compute_extent((PCPATCH_UNCOMPRESSED *)pu);
+    CU_ASSERT_DOUBLE_EQUAL(pu->bounds.xmin, parts[i]->bounds.xmin, precision);
+    CU_ASSERT_DOUBLE_EQUAL(pu->bounds.ymax, parts[i]->bounds.ymax, precision);
+    pc_point_get_double_by_name(&(parts[i]->stats->min), "X", &min);
+    pc_point_get_double_by_name(&(parts[i]->stats->max), "Y", &max);
+    CU_ASSERT_DOUBLE_EQUAL(min, parts[i]->bounds.xmin, precision);
+    CU_ASSERT_DOUBLE_EQUAL(max, parts[i]->bounds.ymax, precision);
+    if (pu != parts[i])
+      pc_patch_free(pu);
+    pc_patch_free(parts[i]);
+  }
+  CU_ASSERT_EQUAL(npoints, 100);
+  CU_ASSERT_DOUBLE_EQUAL(sum, 99 * 100 / 2, 0.001);
+  pcfree(parts);
+
+  // small patches are not split
+  parts = pc_patch_split(pa, 100, mode, &nparts);
+  CU_ASSERT_EQUAL(nparts, 1);
+  CU_ASSERT_EQUAL(parts[0]->npoints, 100);
+  pc_patch_free(parts[0]);
+  pcfree(parts);
+
+  pc_patch_free(pa);
+}
+
+static void test_split_quadtree()
+{
+  test_split(PC_NONE, PC_SPLIT_QUADTREE);
+  test_split(PC_DIMENSIONAL, PC_SPLIT_QUADTREE);
+
+  // the four quadrants of the grid
+  PCPATCH *pa = split_patch(PC_NONE);
+  uint32_t i, nparts;
+  PCPATCH **parts = pc_patch_split(pa, 25, PC_SPLIT_QUADTREE, &nparts);
+  CU_ASSERT_EQUAL(nparts, 4);
+  CU_ASSERT_DOUBLE_EQUAL(parts[0]->bounds.xmax, 4, precision);
+  CU_ASSERT_DOUBLE_EQUAL(parts[3]->bounds.ymin, 5, precision);
+  for (i = 0; i < nparts; i++)
+  {
+    CU_ASSERT_EQUAL(parts[i]->npoints, 25);
+    pc_patch_free(parts[i]);
+  }
+  pcfree(parts);
+  pc_patch_free(pa);
+}
+
+static void test_split_octree()
+{
+  test_split(PC_NONE, PC_SPLIT_OCTREE);
+  test_split(PC_DIMENSIONAL, PC_SPLIT_OCTREE);
+}
+
+static void test_split_kdtree()
+{
+  test_split(PC_NONE, PC_SPLIT_KDTREE);
+  test_split(PC_DIMENSIONAL, PC_SPLIT_KDTREE);
+}
+
+static void test_split_duplicates()
+{
+  PCPOINTLIST *pl = pc_pointlist_make(10);
+  PCPATCH *pa, **parts;
+  uint32_t i, nparts;
+  int mode;
+
+  for (i = 0; i < 10; i++)
+  {
+    PCPOINT *pt = pc_point_make(schema);
+    pc_point_set_double_by_name(pt, "X", 1);
+    pc_point_set_double_by_name(pt, "Y", 1);
+    pc_pointlist_add_point(pl, pt);
+  }
+  pa = pc_patch_from_pointlist(pl);
+
+  for (mode = PC_SPLIT_QUADTREE; mode <= PC_SPLIT_KDTREE; mode++)
+  {
+    parts = pc_patch_split(pa, 3, mode, &nparts);
+    CU_ASSERT_EQUAL(nparts, 4);
+    for (i = 0; i < nparts; i++)
+      pc_patch_free(parts[i]);
+    pcfree(parts);
+  }
+
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_patch_split(pa, 0, PC_SPLIT_KDTREE, &nparts));
+
+  pc_patch_free(pa);
+  pc_pointlist_free(pl);
+}
+
+static void test_sort_lod(enum COMPRESSIONS compression)
+{
+  PCPATCH *pa = split_patch(compression);
+  PCPATCH *pasort, *palod;
+  // number of distinct cells of the 10x10 grid at each level
+  uint32_t npoints[] = {1, 4, 16, 64, 100, 100};
+  uint32_t counts[PC_LOD_NLEVELS];
+  double x, y;
+  int l;
+
+  pasort = pc_patch_sort_lod(pa, counts);
+  CU_ASSERT_EQUAL(pasort->type, pa->type);
+  CU_ASSERT_EQUAL(pasort->npoints, 100);
+  CU_ASSERT_EQUAL(pc_patch_lod_npoints(counts, PC_LOD_NLEVELS), 100);
+
+  for (l = 0; l < 6; l++)
+  {
+    CU_ASSERT_EQUAL(pc_patch_lod_npoints(counts, l), npoints[l]);
+    palod = pc_patch_lod(pasort, counts, l);
+    CU_ASSERT_EQUAL(palod->type, pa->type);
+    CU_ASSERT_EQUAL(palod->npoints, npoints[l]);
+    if (l == 0)
+    {
+      // the first point of the patch
+      pc_point_get_double_by_name(&(palod->stats->min), "X", &x);
+      pc_point_get_double_by_name(&(palod->stats->min), "Y", &y);
+      CU_ASSERT_DOUBLE_EQUAL(x, 0, precision);
+      CU_ASSERT_DOUBLE_EQUAL(y, 0, precision);
+    }
+    else
+    {
+      // the coarse points cover the whole extent
+      CU_ASSERT_DOUBLE_EQUAL(palod->bounds.xmin, 0, precision);
+      CU_ASSERT(palod->bounds.xmax >= 5);
+      CU_ASSERT_DOUBLE_EQUAL(palod->bounds.ymin, 0, precision);
+      CU_ASSERT(palod->bounds.ymax >= 5);
+    }
+    pc_patch_free(palod);
+  }
+
+  // the counts must not exceed the patch
+  counts[0] = 101;
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_patch_lod(pa, counts, 0));
+
+  cu_error_msg_reset();
+  CU_ASSERT_PTR_NULL(pc_patch_lod(pa, counts, -1));
+
+  pc_patch_free(pasort);
+  pc_patch_free(pa);
+}
+
+static void test_sort_lod_no_compression() { test_sort_lod(PC_NONE); }
+
+static void test_sort_lod_compression_dimensional()
+{
+  test_sort_lod(PC_DIMENSIONAL);
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo sort_tests[] = {
@@ -384,6 +798,18 @@ CU_TestInfo sort_tests[] = {
     PC_TEST(test_sort_patch_is_sorted_compression_dimensional_sigbits),
     PC_TEST(test_sort_patch_is_sorted_compression_dimensional_rle),
     PC_TEST(test_sort_patch_ndims),
+    PC_TEST(test_sort_types_no_compression),
+    PC_TEST(test_sort_types_compression_dimensional),
+    PC_TEST(test_sort_radix),
+    PC_TEST(test_sort_spatial_no_compression),
+    PC_TEST(test_sort_spatial_compression_dimensional),
+    PC_TEST(test_sort_spatial_from_string),
+    PC_TEST(test_split_quadtree),
+    PC_TEST(test_split_octree),
+    PC_TEST(test_split_kdtree),
+    PC_TEST(test_split_duplicates),
+    PC_TEST(test_sort_lod_no_compression),
+    PC_TEST(test_sort_lod_compression_dimensional),
     CU_TEST_INFO_NULL};
 
 CU_SuiteInfo sort_suite = {.pName = "sort",
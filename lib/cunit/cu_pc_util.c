@@ -9,6 +9,7 @@
 
 #include "CUnit/Basic.h"
 #include "cu_tester.h"
+#include <math.h>
 
 /* GLOBALS ************************************************************/
 
@@ -92,10 +93,67 @@ static void test_bounding_diagonal_wkb_from_stats()
   pcfree(wkbhex);
 }
 
+static void test_hexbytes()
+{
+  uint8_t bytes[600], *decoded;
+  char *hex;
+  int i;
+
+  for (i = 0; i < 600; i++)
+    bytes[i] = i % 256;
+
+  hex = pc_hexbytes_from_bytes(bytes, 600);
+  CU_ASSERT_EQUAL(strlen(hex), 1200);
+  CU_ASSERT_NSTRING_EQUAL(hex, "000102", 6);
+  CU_ASSERT_NSTRING_EQUAL(hex + 2 * 250, "FAFBFCFDFEFF00", 14);
+
+  decoded = pc_bytes_from_hexbytes(hex, 1200);
+  CU_ASSERT_EQUAL(memcmp(decoded, bytes, 600), 0);
+  pcfree(decoded);
+  pcfree(hex);
+
+  /* lower case digits decode too */
+  decoded = pc_bytes_from_hexbytes("0aFf7e", 6);
+  CU_ASSERT_EQUAL(decoded[0], 0x0A);
+  CU_ASSERT_EQUAL(decoded[1], 0xFF);
+  CU_ASSERT_EQUAL(decoded[2], 0x7E);
+  pcfree(decoded);
+}
+
+static void test_double_to_string()
+{
+  double values[] = {0,        -0.0,      1,         -7,        999999,
+                     1e6,      -1234567,  0.5,       0.02,      1.8,
+                     -126.99,  45.01,     3.3333333, 999999.5,  99999.95,
+                     0.0001,   0.0000999, 1e-10,     123456789, 0.1234565,
+                     1e300,    -2.5e-300, INFINITY,  -INFINITY, NAN};
+  char buf[PC_DOUBLE_STRING_SIZE], expected[PC_DOUBLE_STRING_SIZE];
+  size_t len;
+  int i;
+
+  for (i = 0; i < sizeof(values) / sizeof(double); i++)
+  {
+    snprintf(expected, sizeof(expected), "%g", values[i]);
+    len = pc_double_to_string(buf, values[i]);
+    CU_ASSERT_STRING_EQUAL(buf, expected);
+    CU_ASSERT_EQUAL(len, strlen(expected));
+  }
+
+  /* values of scaled integer dimensions */
+  for (i = -200000; i < 200000; i += 7)
+  {
+    snprintf(expected, sizeof(expected), "%g", i * 0.01);
+    pc_double_to_string(buf, i * 0.01);
+    CU_ASSERT_STRING_EQUAL(buf, expected);
+  }
+}
+
 /* REGISTER ***********************************************************/
 
 CU_TestInfo util_tests[] = {PC_TEST(test_bounding_diagonal_wkb_from_bounds),
                             PC_TEST(test_bounding_diagonal_wkb_from_stats),
+                            PC_TEST(test_hexbytes),
+                            PC_TEST(test_double_to_string),
                             CU_TEST_INFO_NULL};
 
 CU_SuiteInfo util_suite = {.pName = "util",
@@ -23,6 +23,7 @@ extern CU_SuiteInfo bytes_suite;
 extern CU_SuiteInfo lazperf_suite;
 extern CU_SuiteInfo sort_suite;
 extern CU_SuiteInfo util_suite;
+extern CU_SuiteInfo grid_suite;
 
 /**
  * CUnit error handler
@@ -47,9 +48,9 @@ void cu_error_msg_reset() { memset(cu_error_msg, '\0', MAX_CUNIT_MSG_LENGTH); }
 int main(int argc, char *argv[])
 {
   /* ADD YOUR SUITE HERE (2 of 2) */
-  CU_SuiteInfo suites[] = {schema_suite, patch_suite,       point_suite,
-                           bytes_suite,  lazperf_suite,     sort_suite,
-                           util_suite,   CU_SUITE_INFO_NULL};
+  CU_SuiteInfo suites[] = {schema_suite, patch_suite,   point_suite,
+                           bytes_suite,  lazperf_suite, sort_suite,
+                           util_suite,   grid_suite,    CU_SUITE_INFO_NULL};
 
   int index;
   char *suite_name;
@@ -37,23 +37,21 @@ size_t lazperf_compress_from_uncompressed(const PCPATCH_UNCOMPRESSED *pa,
 }
 
 size_t lazperf_uncompress_from_compressed(const PCPATCH_LAZPERF *pa,
-                                          uint8_t **decompressed)
+                                          uint8_t *decompressed)
 {
   size_t size = -1;
   size_t datasize = pa->schema->size * pa->npoints;
 
-  LazPerfBuf buf;
-  buf.putBytes(pa->lazperf, pa->lazperfsize);
-  LazPerfDecompressor engine(pa->schema, buf);
-
-  *decompressed = (uint8_t *)malloc(datasize);
+  // decode straight from the patch buffer, which may be read-only
+  LazPerfSpan span(pa->lazperf, pa->lazperfsize);
+  LazPerfDecompressor engine(pa->schema, span);
 
-  if (engine.decompress(*decompressed, datasize) == pa->npoints)
-    size = buf.buf.size();
+  if (engine.decompress(decompressed, datasize) == pa->npoints)
+    size = datasize;
 
   // log
   // lazperf_dump(pa);
-  // lazperf_dump(*decompressed, datasize);
+  // lazperf_dump(decompressed, datasize);
 
   return size;
 }
@@ -104,27 +102,28 @@ void lazperf_dump(const PCPATCH_LAZPERF *p)
 }
 
 // LazPerf class
-template <typename LazPerfEngine, typename LazPerfCoder>
-LazPerf<LazPerfEngine, LazPerfCoder>::LazPerf(const PCSCHEMA *pcschema,
-                                              LazPerfBuf &buf)
+template <typename LazPerfEngine, typename LazPerfCoder, typename LazPerfStream>
+LazPerf<LazPerfEngine, LazPerfCoder, LazPerfStream>::LazPerf(
+    const PCSCHEMA *pcschema, LazPerfStream &buf)
     : _pcschema(pcschema), _coder(buf), _pointsize(0)
 {
 }
 
-template <typename LazPerfEngine, typename LazPerfCoder>
-LazPerf<LazPerfEngine, LazPerfCoder>::~LazPerf()
+template <typename LazPerfEngine, typename LazPerfCoder, typename LazPerfStream>
+LazPerf<LazPerfEngine, LazPerfCoder, LazPerfStream>::~LazPerf()
 {
 }
 
-template <typename LazPerfEngine, typename LazPerfCoder>
-void LazPerf<LazPerfEngine, LazPerfCoder>::initSchema()
+template <typename LazPerfEngine, typename LazPerfCoder, typename LazPerfStream>
+void LazPerf<LazPerfEngine, LazPerfCoder, LazPerfStream>::initSchema()
 {
   for (int i = 0; i < _pcschema->ndims; i++)
     addField(_pcschema->dims[i]);
 }
 
-template <typename LazPerfEngine, typename LazPerfCoder>
-bool LazPerf<LazPerfEngine, LazPerfCoder>::addField(const PCDIMENSION *dim)
+template <typename LazPerfEngine, typename LazPerfCoder, typename LazPerfStream>
+bool LazPerf<LazPerfEngine, LazPerfCoder, LazPerfStream>::addField(
+    const PCDIMENSION *dim)
 {
   bool rc = true;
 
@@ -225,7 +224,7 @@ size_t LazPerfCompressor::compress(const uint8_t *input, const size_t inputsize)
 
 // LazPerf Decompressor
 LazPerfDecompressor::LazPerfDecompressor(const PCSCHEMA *pcschema,
-                                         LazPerfBuf &input)
+                                         LazPerfSpan &input)
     : LazPerf(pcschema, input)
 {
   _engine = laszip::formats::make_dynamic_decompressor(_coder);
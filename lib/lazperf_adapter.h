@@ -25,7 +25,7 @@ extern "C"
   size_t lazperf_compress_from_uncompressed(const PCPATCH_UNCOMPRESSED *pa,
                                             uint8_t **compressed);
   size_t lazperf_uncompress_from_compressed(const PCPATCH_LAZPERF *pa,
-                                            uint8_t **decompressed);
+                                            uint8_t *decompressed);
 #ifdef __cplusplus
 }
 #endif
@@ -67,19 +67,43 @@ struct LazPerfBuf
   size_t idx;
 };
 
+// read-only view of a compressed buffer, fed to the decompressor
+struct LazPerfSpan
+{
+  LazPerfSpan(const uint8_t *data, size_t size)
+      : _data(data), _size(size), idx(0)
+  {
+  }
+
+  unsigned char getByte() { return idx < _size ? _data[idx++] : 0; }
+
+  void getBytes(unsigned char *b, int len)
+  {
+    size_t n = idx + len <= _size ? len : _size - idx;
+    memcpy(b, _data + idx, n);
+    memset(b + n, 0, len - n);
+    idx += n;
+  }
+
+  const uint8_t *_data;
+  size_t _size;
+  size_t idx;
+};
+
 // some typedef
 typedef laszip::encoders::arithmetic<LazPerfBuf> Encoder;
-typedef laszip::decoders::arithmetic<LazPerfBuf> Decoder;
+typedef laszip::decoders::arithmetic<LazPerfSpan> Decoder;
 
 typedef laszip::formats::dynamic_field_compressor<Encoder>::ptr Compressor;
 typedef laszip::formats::dynamic_field_decompressor<Decoder>::ptr Decompressor;
 
 // LazPerf class
-template <typename LazPerfEngine, typename LazPerfCoder> class LazPerf
+template <typename LazPerfEngine, typename LazPerfCoder, typename LazPerfStream>
+class LazPerf
 {
 
 public:
-  LazPerf(const PCSCHEMA *pcschema, LazPerfBuf &buf);
+  LazPerf(const PCSCHEMA *pcschema, LazPerfStream &buf);
   ~LazPerf();
 
   size_t pointsize() const { return _pointsize; }
@@ -95,7 +119,7 @@ protected:
 };
 
 // compressor
-class LazPerfCompressor : public LazPerf<Compressor, Encoder>
+class LazPerfCompressor : public LazPerf<Compressor, Encoder, LazPerfBuf>
 {
 
 public:
@@ -106,11 +130,12 @@ public:
 };
 
 // decompressor
-class LazPerfDecompressor : public LazPerf<Decompressor, Decoder>
+class LazPerfDecompressor
+    : public LazPerf<Decompressor, Decoder, LazPerfSpan>
 {
 
 public:
-  LazPerfDecompressor(const PCSCHEMA *pcschema, LazPerfBuf &input);
+  LazPerfDecompressor(const PCSCHEMA *pcschema, LazPerfSpan &input);
   ~LazPerfDecompressor();
 
   size_t decompress(uint8_t *data, const size_t datasize);
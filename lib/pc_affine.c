@@ -0,0 +1,260 @@
+/***********************************************************************
+ * pc_affine.c
+ *
+ *  Pointclound affine transforms. Apply a 3x4 matrix to the X, Y and Z
+ *  coordinates of a patch, leaving the other dimensions untouched.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <float.h>
+#include <math.h>
+
+/* How many points are transformed at once */
+#define PC_AFFINE_CHUNK 256
+
+/* A strided coordinate column, the dimension is NULL when it is missing */
+typedef struct
+{
+  uint8_t *data;
+  size_t stride;
+  const PCDIMENSION *dim;
+  double min;
+  double max;
+  double sum;
+} PCAFFINECOLUMN;
+
+/* Transform a chunk of coordinates, one output column at a time */
+static void pc_affine_chunk(const double *m, const double *x, const double *y,
+                            const double *z, double *out[3], uint32_t n)
+{
+  uint32_t c, i;
+  for (c = 0; c < 3; c++)
+  {
+    const double *r = m + 4 * c;
+    double *o = out[c];
+    for (i = 0; i < n; i++)
+      o[i] = r[0] * x[i] + r[1] * y[i] + r[2] * z[i] + r[3];
+  }
+}
+
+/* Transform the coordinate columns in place, keeping their min/max/sum */
+static void pc_affine_columns(const double *m, PCAFFINECOLUMN cols[3],
+                              uint32_t npoints)
+{
+  double in[3][PC_AFFINE_CHUNK], res[3][PC_AFFINE_CHUNK];
+  double *out[3] = {res[0], res[1], res[2]};
+  uint32_t first, c, i;
+
+  for (c = 0; c < 3; c++)
+  {
+    cols[c].min = DBL_MAX;
+    cols[c].max = -1 * DBL_MAX;
+    cols[c].sum = 0.0;
+  }
+
+  for (first = 0; first < npoints; first += PC_AFFINE_CHUNK)
+  {
+    uint32_t n = npoints - first;
+    if (n > PC_AFFINE_CHUNK)
+      n = PC_AFFINE_CHUNK;
+
+    for (c = 0; c < 3; c++)
+    {
+      if (cols[c].dim)
+        pc_value_array_from_ptr(in[c], cols[c].data + first * cols[c].stride,
+                                cols[c].stride, n, cols[c].dim);
+      else
+        memset(in[c], 0, n * sizeof(double));
+    }
+
+    pc_affine_chunk(m, in[0], in[1], in[2], out, n);
+
+    for (c = 0; c < 3; c++)
+    {
+      uint8_t *ptr;
+      if (!cols[c].dim)
+        continue;
+
+      ptr = cols[c].data + first * cols[c].stride;
+      pc_value_array_to_ptr(ptr, cols[c].stride, out[c], n, cols[c].dim);
+
+      /* The stats follow the quantized values, not the exact results */
+      pc_value_array_from_ptr(out[c], ptr, cols[c].stride, n, cols[c].dim);
+      for (i = 0; i < n; i++)
+      {
+        if (out[c][i] < cols[c].min)
+          cols[c].min = out[c][i];
+        if (out[c][i] > cols[c].max)
+          cols[c].max = out[c][i];
+        cols[c].sum += out[c][i];
+      }
+    }
+  }
+}
+
+/* Set the stats and bounds of a transformed patch */
+static int pc_affine_stats(const PCPATCH *patch, PCPATCH *paout,
+                           const PCAFFINECOLUMN cols[3])
+{
+  uint32_t c;
+
+  if (!paout->npoints)
+  {
+    paout->bounds = patch->bounds;
+    paout->stats = patch->stats ? pc_stats_clone(patch->stats) : NULL;
+    return PC_SUCCESS;
+  }
+
+  paout->bounds.xmin = cols[0].min;
+  paout->bounds.xmax = cols[0].max;
+  paout->bounds.ymin = cols[1].min;
+  paout->bounds.ymax = cols[1].max;
+
+  /* Without stats to start from, compute them all */
+  if (!patch->stats)
+    return pc_patch_compute_stats(paout);
+
+  paout->stats = pc_stats_clone(patch->stats);
+  for (c = 0; c < 3; c++)
+  {
+    if (!cols[c].dim)
+      continue;
+    pc_point_set_double(&paout->stats->min, cols[c].dim, cols[c].min);
+    pc_point_set_double(&paout->stats->max, cols[c].dim, cols[c].max);
+    pc_point_set_double(&paout->stats->avg, cols[c].dim,
+                        cols[c].sum / paout->npoints);
+  }
+  return PC_SUCCESS;
+}
+
+static PCPATCH *pc_affine_uncompressed(const PCPATCH_UNCOMPRESSED *pu,
+                                       const double *matrix)
+{
+  const PCSCHEMA *schema = pu->schema;
+  const PCDIMENSION *dims[3] = {schema->xdim, schema->ydim, schema->zdim};
+  PCPATCH_UNCOMPRESSED *paout;
+  PCAFFINECOLUMN cols[3];
+  uint32_t c;
+
+  paout = pc_patch_uncompressed_make(schema, pu->npoints);
+  paout->npoints = pu->npoints;
+  if (pu->npoints)
+    memcpy(paout->data, pu->data, pu->npoints * schema->size);
+
+  for (c = 0; c < 3; c++)
+  {
+    cols[c].dim = dims[c];
+    cols[c].stride = schema->size;
+    cols[c].data = dims[c] ? paout->data + dims[c]->byteoffset : NULL;
+  }
+
+  pc_affine_columns(matrix, cols, paout->npoints);
+
+  if (PC_FAILURE ==
+      pc_affine_stats((const PCPATCH *)pu, (PCPATCH *)paout, cols))
+  {
+    pc_patch_free((PCPATCH *)paout);
+    return NULL;
+  }
+  return (PCPATCH *)paout;
+}
+
+/*
+ * Decode the coordinate columns of a dimensional patch, and encode them
+ * back as they were. The other columns are copied without decoding them.
+ */
+static PCPATCH *pc_affine_dimensional(const PCPATCH_DIMENSIONAL *pdl,
+                                      const double *matrix)
+{
+  const PCSCHEMA *schema = pdl->schema;
+  const PCDIMENSION *dims[3] = {schema->xdim, schema->ydim, schema->zdim};
+  PCPATCH_DIMENSIONAL *pdlout = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+  PCBYTES decoded[3];
+  PCAFFINECOLUMN cols[3];
+  uint32_t c, i;
+
+  pdlout->type = PC_DIMENSIONAL;
+  pdlout->readonly = PC_FALSE;
+  pdlout->schema = schema;
+  pdlout->npoints = pdl->npoints;
+  pdlout->stats = NULL;
+  pdlout->bytes = pcalloc(schema->ndims * sizeof(PCBYTES));
+
+  for (i = 0; i < schema->ndims; i++)
+  {
+    /* Clones of empty columns would share their buffer */
+    if (pc_bytes_empty(&pdl->bytes[i]))
+      pdlout->bytes[i] = pc_bytes_make(schema->dims[i], 0);
+    else if (i != dims[0]->position && i != dims[1]->position &&
+             !(dims[2] && i == dims[2]->position))
+      pdlout->bytes[i] = pc_bytes_clone(pdl->bytes[i]);
+  }
+
+  for (c = 0; c < 3; c++)
+  {
+    cols[c].dim = dims[c];
+    cols[c].stride = dims[c] ? dims[c]->size : 0;
+    cols[c].data = NULL;
+    if (dims[c] && pdl->npoints)
+    {
+      decoded[c] = pc_bytes_decode(pdl->bytes[dims[c]->position]);
+      cols[c].data = decoded[c].bytes;
+    }
+  }
+
+  pc_affine_columns(matrix, cols, pdl->npoints);
+
+  for (c = 0; c < 3; c++)
+  {
+    if (!cols[c].data)
+      continue;
+    pdlout->bytes[dims[c]->position] =
+        pc_bytes_encode(decoded[c], pdl->bytes[dims[c]->position].compression);
+    pc_bytes_free(decoded[c]);
+  }
+
+  if (PC_FAILURE ==
+      pc_affine_stats((const PCPATCH *)pdl, (PCPATCH *)pdlout, cols))
+  {
+    pc_patch_free((PCPATCH *)pdlout);
+    return NULL;
+  }
+  return (PCPATCH *)pdlout;
+}
+
+PCPATCH *pc_patch_affine(const PCPATCH *patch, const double *matrix)
+{
+  PCPATCH *pu, *paout;
+  int i;
+
+  if (!patch->schema->xdim || !patch->schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return NULL;
+  }
+
+  for (i = 0; i < 12; i++)
+  {
+    if (!isfinite(matrix[i]))
+    {
+      pcerror("%s: matrix values must be finite", __func__);
+      return NULL;
+    }
+  }
+
+  if (patch->type == PC_NONE)
+    return pc_affine_uncompressed((const PCPATCH_UNCOMPRESSED *)patch, matrix);
+
+  if (patch->type == PC_DIMENSIONAL)
+    return pc_affine_dimensional((const PCPATCH_DIMENSIONAL *)patch, matrix);
+
+  pu = pc_patch_uncompress(patch);
+  paout = pc_affine_uncompressed((PCPATCH_UNCOMPRESSED *)pu, matrix);
+  pc_patch_free(pu);
+  return paout;
+}
@@ -57,6 +57,17 @@ typedef enum
   PC_BETWEEN
 } PC_FILTERTYPE;
 
+/**
+ * Raw (unscaled) value conversions between the bytes of a dimension and
+ * doubles, specialized for each interpretation.
+ */
+typedef double (*PCDOUBLEREADER)(const uint8_t *ptr);
+typedef void (*PCDOUBLEWRITER)(uint8_t *ptr, double val);
+typedef void (*PCDOUBLEARRAYREADER)(double *vals, const uint8_t *ptr,
+                                    size_t stride, uint32_t n);
+typedef void (*PCDOUBLEARRAYWRITER)(uint8_t *ptr, size_t stride,
+                                    const double *vals, uint32_t n);
+
 /**
  * We need to hold a cached in-memory version of the format's
  * XML structure for speed, and this is it.
@@ -72,6 +83,11 @@ typedef struct
   double scale;
   double offset;
   uint8_t active;
+  /* Accessors of the interpretation, resolved when the schema is loaded */
+  PCDOUBLEREADER read;
+  PCDOUBLEWRITER write;
+  PCDOUBLEARRAYREADER read_array;
+  PCDOUBLEARRAYWRITER write_array;
 } PCDIMENSION;
 
 typedef struct
@@ -196,6 +212,154 @@ typedef struct
   uint8_t *lazperf;
 } PCPATCH_LAZPERF;
 
+/**
+ * Aggregations of the values falling into a grid cell
+ */
+typedef enum
+{
+  PC_GRID_MIN,
+  PC_GRID_MAX,
+  PC_GRID_MEAN,
+  PC_GRID_COUNT,
+  PC_GRID_LAST
+} PC_GRIDAGG;
+
+/**
+ * Point kept for each voxel by the voxel filter: the first point of the
+ * voxel, the first point moved to the voxel centroid, or the point nearest
+ * to the centroid
+ */
+typedef enum
+{
+  PC_VOXEL_FIRST,
+  PC_VOXEL_CENTROID,
+  PC_VOXEL_CLOSEST
+} PC_VOXELMODE;
+
+/**
+ * Spatial orderings of the points of a patch: along a space filling curve,
+ * or coarse-to-fine levels of detail
+ */
+typedef enum
+{
+  PC_SORT_MORTON,
+  PC_SORT_HILBERT,
+  PC_SORT_LOD
+} PC_SPATIALSORT;
+
+/**
+ * Partitions used to split a patch: quadtree cells on X/Y, octree cells on
+ * X/Y/Z, or median splits of the widest axis
+ */
+typedef enum
+{
+  PC_SPLIT_QUADTREE,
+  PC_SPLIT_OCTREE,
+  PC_SPLIT_KDTREE
+} PC_SPLITMODE;
+
+/**
+ * Regular XY grid accumulating patch values per cell. Cells are
+ * stored row by row, the first row being the one starting at ymin.
+ */
+typedef struct
+{
+  double xmin;
+  double ymin;
+  double cellsize;
+  uint32_t ncols;
+  uint32_t nrows;
+  PC_GRIDAGG agg;
+  double *values;   /* Accumulated value per cell (sum for the mean) */
+  uint32_t *counts; /* Number of points per cell */
+} PCGRID;
+
+/**
+ * Points buffered for one tile of a retiling
+ */
+typedef struct
+{
+  int64_t key;        /* Tile column and row, see pc_retile_key */
+  uint32_t npoints;   /* Number of points buffered */
+  uint32_t maxpoints; /* Number of points the buffer can hold */
+  uint8_t *data;      /* Uncompressed points, or NULL once flushed */
+} PCTILE;
+
+/**
+ * Redistribution of the points of many patches into the tiles of a
+ * regular XY grid aligned on the origin. A tile is flushed as a patch
+ * when it holds maxpoints points or when the retiling is flushed.
+ */
+typedef struct
+{
+  const PCSCHEMA *schema;
+  double tilesize;
+  uint32_t maxpoints;
+  PCTILE *tiles; /* Tiles in order of creation */
+  uint32_t ntiles;
+  uint32_t maxtiles;
+  uint32_t *slots; /* Hash table of tile indexes + 1, 0 for empty slots */
+  uint32_t nslots;
+  PCPATCH **done; /* Flushed patches not popped yet */
+  int64_t *donekeys;
+  uint32_t ndone;
+  uint32_t nextdone;
+  uint32_t maxdone;
+} PCRETILE;
+
+/**
+ * Arrow IPC stream of patches sharing a schema: a schema message, then
+ * one record batch per patch, the end of stream marker being added when
+ * the stream is copied out
+ */
+typedef struct
+{
+  const PCSCHEMA *schema;
+  int scaled; /* Scaled float64 columns rather than the stored values */
+  uint8_t *buf;
+  size_t size;
+  size_t capacity;
+} PCARROW;
+
+/**
+ * Kinds of steps of a transform plan
+ */
+typedef enum
+{
+  PC_TRANSFORM_COPY,    /* copy bytes verbatim */
+  PC_TRANSFORM_CONVERT, /* convert values between dimensions */
+  PC_TRANSFORM_FILL     /* copy bytes from the default point */
+} PC_TRANSFORMOP_TYPE;
+
+/**
+ * One step of a transform plan. Byte-level steps cover runs of
+ * contiguous dimensions, conversions cover a single dimension.
+ */
+typedef struct
+{
+  PC_TRANSFORMOP_TYPE type;
+  size_t from; /* Byte offset in the old point */
+  size_t to;   /* Byte offset in the new point */
+  size_t size; /* Number of bytes copied or filled */
+  const PCDIMENSION *odim; /* Dimensions of a conversion */
+  const PCDIMENSION *ndim;
+} PCTRANSFORMOP;
+
+/**
+ * Plan turning points of an old schema into points of a new schema,
+ * matching dimensions by name. Compiled once, applied to many patches.
+ */
+typedef struct
+{
+  const PCSCHEMA *oschema;
+  const PCSCHEMA *nschema;
+  double def;  /* Value of the dimensions missing from the old schema */
+  int rescale; /* Values are converted, otherwise bytes are relabeled */
+  PCTRANSFORMOP *ops;
+  uint32_t nops;
+  uint8_t *defaults; /* New point holding the default values */
+} PCTRANSFORM;
+
 /* Global function signatures for memory/logging handlers. */
 typedef void *(*pc_allocator)(size_t size);
 typedef void *(*pc_reallocator)(void *mem, size_t size);
@@ -234,12 +398,17 @@ void pc_install_default_handlers(void);
  * UTILITY
  */
 
+/* Room needed by pc_double_to_string, terminator included */
+#define PC_DOUBLE_STRING_SIZE 32
+
 /** Convert binary to hex */
 uint8_t *pc_bytes_from_hexbytes(const char *hexbuf, size_t hexsize);
 /** Convert hex to binary */
 char *pc_hexbytes_from_bytes(const uint8_t *bytebuf, size_t bytesize);
 /** Read the the PCID from WKB form of a POINT/PATCH */
 uint32_t pc_wkb_get_pcid(const uint8_t *wkb);
+/** Write a double as printf "%g" does, return the length written */
+size_t pc_double_to_string(char *buf, double d);
 /** Build an empty #PCDIMSTATS based on the schema */
 PCDIMSTATS *pc_dimstats_make(const PCSCHEMA *schema);
 /** Get compression name from enum */
@@ -264,6 +433,10 @@ PCDIMENSION *pc_schema_get_dimension_by_name(const PCSCHEMA *s,
 uint32_t pc_schema_is_valid(const PCSCHEMA *s);
 /** Create a full copy of the schema and dimensions it contains */
 PCSCHEMA *pc_schema_clone(const PCSCHEMA *s);
+/** Write the schema in a compact binary form, in machine byte order */
+uint8_t *pc_schema_to_bytes(const PCSCHEMA *s, size_t *size);
+/** Read a schema back from its compact binary form */
+PCSCHEMA *pc_schema_from_bytes(const uint8_t *bytes, size_t size);
 /** Add/overwrite a dimension in a schema */
 void pc_schema_set_dimension(PCSCHEMA *s, PCDIMENSION *d);
 /** Check/set the xyzm positions in the dimension list */
@@ -274,6 +447,8 @@ size_t pc_schema_get_size(const PCSCHEMA *s);
 uint32_t pc_schema_same_dimensions(const PCSCHEMA *s1, const PCSCHEMA *s2);
 /** Check whether the schemas have compatible dimension interpretations */
 uint32_t pc_schema_same_interpretations(const PCSCHEMA *s1, const PCSCHEMA *s2);
+/** Check whether the dimensions of s2 can be read from s1 unchanged */
+uint32_t pc_schema_is_projection(const PCSCHEMA *s1, const PCSCHEMA *s2);
 
 /**********************************************************************
  * PCPOINTLIST
@@ -465,12 +640,58 @@ PCPATCH *pc_patch_filter_equal_by_name(const PCPATCH *pa, const char *name,
 PCPATCH *pc_patch_filter_between_by_name(const PCPATCH *pa, const char *name,
                                          double val1, double val2);
 
+/** Keep one point per voxel of the given size, see PC_VOXELMODE */
+PCPATCH *pc_patch_voxel_filter(const PCPATCH *pa, double voxelsize,
+                               PC_VOXELMODE mode);
+
+/** Read the voxel filter mode from its name */
+int pc_voxel_mode_from_string(const char *str, PC_VOXELMODE *mode);
+
 /** get point n */
 PCPOINT *pc_patch_pointn(const PCPATCH *patch, int n);
 
+/** Write the scaled values of the dimensions to vals, one column of npoints
+ * values after the other */
+int pc_patch_get_columns(const PCPATCH *pa, const PCDIMENSION **dims,
+                         uint32_t ndims, double *vals);
+
+/** Write the stored values of integer dimensions to vals, one column of
+ * npoints values after the other */
+int pc_patch_get_raw_columns(const PCPATCH *pa, const PCDIMENSION **dims,
+                             uint32_t ndims, int64_t *vals);
+
 /** Sorted patch after reordering points on dimensions */
 PCPATCH *pc_patch_sort(const PCPATCH *pa, const char **name, int ndims);
 
+/** Sorted patch after reordering points along a space filling curve */
+PCPATCH *pc_patch_sort_spatial(const PCPATCH *pa, PC_SPATIALSORT curve);
+
+/** Read the space filling curve from its name */
+int pc_spatialsort_from_string(const char *str, PC_SPATIALSORT *curve);
+
+/** Deepest level of detail, 3 axes of 21 bits fit a cell key */
+#define PC_LOD_MAXLEVEL 21
+
+/** Point counts of the levels of detail, then of the duplicate points */
+#define PC_LOD_NLEVELS (PC_LOD_MAXLEVEL + 2)
+
+/** Sorted patch with the points ordered by level of detail, coarse first,
+ * and the PC_LOD_NLEVELS point counts of its levels if counts is not NULL */
+PCPATCH *pc_patch_sort_lod(const PCPATCH *pa, uint32_t *counts);
+
+/** Number of leading points of the levels of detail down to level */
+uint32_t pc_patch_lod_npoints(const uint32_t *counts, int level);
+
+/** Leading points of a level of detail ordered patch, down to level */
+PCPATCH *pc_patch_lod(const PCPATCH *pa, const uint32_t *counts, int level);
+
+/** Split the patch into spatially coherent parts of at most maxpoints */
+PCPATCH **pc_patch_split(const PCPATCH *pa, uint32_t maxpoints,
+                         PC_SPLITMODE mode, uint32_t *nparts);
+
+/** Read the split mode from its name */
+int pc_splitmode_from_string(const char *str, PC_SPLITMODE *mode);
+
 /** True/false if the patch is sorted on dimension */
 uint32_t pc_patch_is_sorted(const PCPATCH *pa, const char **name, int ndims,
                             char strict);
@@ -486,4 +707,91 @@ PCPATCH *pc_patch_set_schema(PCPATCH *patch, const PCSCHEMA *schema,
 PCPATCH *pc_patch_transform(const PCPATCH *patch, const PCSCHEMA *schema,
                             double def);
 
+/** Keep the dimensions of a projected schema, without decoding dimensional
+ * patches */
+PCPATCH *pc_patch_project(const PCPATCH *patch, const PCSCHEMA *schema);
+
+/** Apply a 3x4 row-major affine matrix to the X, Y and Z dimensions */
+PCPATCH *pc_patch_affine(const PCPATCH *patch, const double *matrix);
+
+/** Compile the plan turning oschema points into nschema points, converting
+ * values if rescale is set, relabeling bytes otherwise */
+PCTRANSFORM *pc_transform_make(const PCSCHEMA *oschema,
+                               const PCSCHEMA *nschema, double def,
+                               int rescale);
+
+/** Free the plan memory */
+void pc_transform_free(PCTRANSFORM *plan);
+
+/** Apply a plan to a patch, returning an uncompressed patch, or a
+ * dimensional patch when a dimensional patch is only relabeled */
+PCPATCH *pc_patch_transform_plan(const PCPATCH *patch,
+                                 const PCTRANSFORM *plan);
+
+/**********************************************************************
+ * PCGRID
+ */
+
+/** Allocate an empty grid of ncols x nrows cells with lower-left corner at
+ * (xmin, ymin) */
+PCGRID *pc_grid_make(double xmin, double ymin, double cellsize,
+                     uint32_t ncols, uint32_t nrows, PC_GRIDAGG agg);
+
+/** Free the grid memory */
+void pc_grid_free(PCGRID *grid);
+
+/** Read the aggregation from its name: min, max, mean, count or last */
+int pc_grid_agg_from_string(const char *str, PC_GRIDAGG *agg);
+
+/** Accumulate the values of the named dimension into the grid cells */
+int pc_grid_add_patch(PCGRID *grid, const PCPATCH *pa, const char *dimname);
+
+/** Read the aggregated value of a cell, PC_FAILURE if the cell is empty */
+int pc_grid_get_value(const PCGRID *grid, uint32_t col, uint32_t row,
+                      double *val);
+
+/**********************************************************************
+ * PCRETILE
+ */
+
+/** Allocate an empty retiling into tiles of tilesize x tilesize holding at
+ * most maxpoints points */
+PCRETILE *pc_retile_make(const PCSCHEMA *schema, double tilesize,
+                         uint32_t maxpoints);
+
+/** Free the retiling memory, including the patches not popped */
+void pc_retile_free(PCRETILE *rt);
+
+/** Distribute the points of a patch into the tiles, flushing the full ones */
+int pc_retile_add_patch(PCRETILE *rt, const PCPATCH *pa);
+
+/** Flush all the tiles holding points */
+void pc_retile_flush(PCRETILE *rt);
+
+/** Pop the next flushed patch and its tile key, NULL if there is none */
+PCPATCH *pc_retile_pop(PCRETILE *rt, int64_t *key);
+
+/** Tile key of a tile column and row */
+int64_t pc_retile_key(int32_t col, int32_t row);
+
+/**********************************************************************
+ * PCARROW
+ */
+
+/** Start an Arrow stream of patches of the schema, with a column of the
+ * stored values of each dimension, or of their scaled float64 values */
+PCARROW *pc_arrow_make(const PCSCHEMA *schema, int scaled);
+
+/** Free the stream memory */
+void pc_arrow_free(PCARROW *arrow);
+
+/** Append the points of a patch as a record batch */
+int pc_arrow_add_patch(PCARROW *arrow, const PCPATCH *pa);
+
+/** Size of the stream, end of stream marker included */
+size_t pc_arrow_stream_size(const PCARROW *arrow);
+
+/** Copy the stream and its end marker to a buffer of pc_arrow_stream_size */
+void pc_arrow_stream_copy(const PCARROW *arrow, uint8_t *stream);
+
 #endif /* _PC_API_H */
@@ -91,6 +91,23 @@ typedef struct
   uint8_t *map;
 } PCBITMAP;
 
+/* PCCOLUMN is a read-only view over the values of one patch dimension */
+typedef struct
+{
+  const PCDIMENSION *dim;
+  const uint8_t *data; /* First value of the column */
+  size_t stride;       /* Distance in bytes between consecutive values */
+  uint32_t npoints;
+  uint8_t *mem; /* Decoded buffer owned by the column, or NULL */
+} PCCOLUMN;
+
+/* PCSORTKEY pairs a sort key with the index of its point */
+typedef struct
+{
+  uint64_t key;
+  uint32_t index;
+} PCSORTKEY;
+
 /** What is the endianness of this system? */
 char machine_endian(void);
 
@@ -129,12 +146,38 @@ double pc_value_scale_offset(double val, const PCDIMENSION *dim);
 /** Remove the scale/offset values from a number before storage */
 double pc_value_unscale_unoffset(double val, const PCDIMENSION *dim);
 
+/** Resolve the typed readers and writers of a dimension from its
+ * interpretation */
+void pc_dimension_set_accessors(PCDIMENSION *dim);
+
 /** Read interpretation type from buffer and cast to double */
 double pc_double_from_ptr(const uint8_t *ptr, uint32_t interpretation);
 
 /** Write value to buffer in the interpretation type */
 int pc_double_to_ptr(uint8_t *ptr, uint32_t interpretation, double val);
 
+/** Read n strided values of the given interpretation */
+void pc_double_array_from_ptr(double *vals, const uint8_t *ptr, size_t stride,
+                              uint32_t n, uint32_t interpretation);
+
+/** Read n strided values of a dimension and apply its scale/offset */
+void pc_value_array_from_ptr(double *vals, const uint8_t *ptr, size_t stride,
+                             uint32_t n, const PCDIMENSION *dim);
+
+/** Read n strided integers of the given interpretation, without
+ * converting them to double */
+int pc_int64_array_from_ptr(int64_t *vals, const uint8_t *ptr, size_t stride,
+                            uint32_t n, uint32_t interpretation);
+
+/** Write n strided values in the given interpretation */
+void pc_double_array_to_ptr(uint8_t *ptr, size_t stride, const double *vals,
+                            uint32_t n, uint32_t interpretation);
+
+/** Remove the scale/offset of a dimension from n values, in place, and write
+ * them strided */
+void pc_value_array_to_ptr(uint8_t *ptr, size_t stride, double *vals,
+                           uint32_t n, const PCDIMENSION *dim);
+
 /** Return number of bytes in a given interpretation */
 size_t pc_interpretation_size(uint32_t interp);
 
@@ -176,6 +219,25 @@ PCPATCH *pc_patch_filter(const PCPATCH *pa, uint32_t dimnum,
                          PC_FILTERTYPE filter, double val1, double val2);
 void pc_patch_free_stats(PCPATCH *pa);
 
+/* COLUMN ACCESS (uncompressed and dimensional patches only) */
+/** Patch to read columns from: pa itself, or pa decoded into *pu for
+ * lazperf patches. NULL if decoding failed */
+const PCPATCH *pc_patch_column_source(const PCPATCH *pa, PCPATCH **pu);
+int pc_patch_column_init(PCCOLUMN *col, const PCPATCH *pa,
+                         const PCDIMENSION *dim);
+void pc_patch_column_free(PCCOLUMN *col);
+void pc_patch_column_get_values(const PCCOLUMN *col, uint32_t first,
+                                uint32_t n, double *vals);
+void pc_patch_column_get_doubles(const PCCOLUMN *col, uint32_t first,
+                                 uint32_t n, double *vals);
+
+/* SORTING */
+/** Stable sort of the keys, in increasing key order */
+void pc_sortkeys_sort(PCSORTKEY *keys, uint32_t n);
+/** New patch of the n points indexed by the keys, in the keys order */
+PCPATCH *pc_patch_gather(const PCPATCH *pa, const PCSORTKEY *keys,
+                         uint32_t n);
+
 /* DIMENSIONAL PATCHES */
 char *pc_patch_dimensional_to_string(const PCPATCH_DIMENSIONAL *pa);
 PCPATCH_DIMENSIONAL *
@@ -194,10 +256,15 @@ PCPATCH_DIMENSIONAL *
 pc_patch_dimensional_from_pointlist(const PCPOINTLIST *pdl);
 PCPOINTLIST *pc_pointlist_from_dimensional(const PCPATCH_DIMENSIONAL *pdl);
 PCPATCH_DIMENSIONAL *
+pc_patch_dimensional_project(const PCPATCH_DIMENSIONAL *pdl,
+                             const PCSCHEMA *schema);
+PCPATCH_DIMENSIONAL *
 pc_patch_dimensional_clone(const PCPATCH_DIMENSIONAL *patch);
 PCPOINT *pc_patch_dimensional_pointn(const PCPATCH_DIMENSIONAL *pdl, int n);
 
 /* UNCOMPRESSED PATCHES */
+char *pc_patch_columns_to_string(const PCSCHEMA *s, uint32_t npoints,
+                                 uint8_t *const *cols, const size_t *strides);
 char *pc_patch_uncompressed_to_string(const PCPATCH_UNCOMPRESSED *patch);
 uint8_t *pc_patch_uncompressed_to_wkb(const PCPATCH_UNCOMPRESSED *patch,
                                       size_t *wkbsize);
@@ -240,6 +307,13 @@ PCPOINT *pc_patch_lazperf_pointn(const PCPATCH_LAZPERF *patch, int n);
 PCBYTES pc_bytes_make(const PCDIMENSION *dim, uint32_t npoints);
 /** Empty the byte array (free the byte buffer) */
 void pc_bytes_free(PCBYTES bytes);
+/** True if the byte array holds no bytes */
+int pc_bytes_empty(const PCBYTES *pcb);
+/** Copy the byte array, keeping its encoding */
+PCBYTES pc_bytes_clone(PCBYTES pcb);
+/** Make a run-length encoded column repeating one value */
+PCBYTES pc_bytes_make_constant(const PCDIMENSION *dim, const uint8_t *value,
+                               uint32_t npoints);
 /** Apply the compresstion to the byte array in place, freeing the original byte
  * buffer */
 PCBYTES pc_bytes_encode(PCBYTES pcb, int compression);
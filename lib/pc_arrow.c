@@ -0,0 +1,439 @@
+/***********************************************************************
+ * pc_arrow.c
+ *
+ *  Pointclound Arrow export. Write patches as record batches of an
+ *  Arrow IPC stream, one column per dimension of the schema.
+ *
+ *  The stream messages are flatbuffers, written here front to back:
+ *  an object is appended after the objects referencing it, and the
+ *  references are patched once its position is known.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <stdio.h>
+
+/* Arrow metadata version V5 */
+#define PC_ARROW_VERSION 4
+
+/* MessageHeader union members */
+#define PC_ARROW_SCHEMA 1
+#define PC_ARROW_RECORDBATCH 3
+
+/* Type union members */
+#define PC_ARROW_INT 2
+#define PC_ARROW_FLOATINGPOINT 3
+
+/* FloatingPoint precisions */
+#define PC_ARROW_SINGLE 1
+#define PC_ARROW_DOUBLE 2
+
+/* How many points are scaled at once */
+#define PC_ARROW_CHUNK 256
+
+/* A field of a flatbuffer table, references are patched later */
+typedef struct
+{
+  uint16_t id;    /* Field index in the table definition */
+  uint8_t size;   /* Size of the value, 4 for references */
+  uint8_t ref;    /* Reference to an object written later */
+  uint64_t value; /* Value of scalars */
+  size_t pos;     /* Where the field was written */
+} PCFBFIELD;
+
+static void pc_arrow_reserve(PCARROW *a, size_t n)
+{
+  if (a->size + n <= a->capacity)
+    return;
+  while (a->size + n > a->capacity)
+    a->capacity *= 2;
+  a->buf = pcrealloc(a->buf, a->capacity);
+}
+
+/* Append zeros up to a multiple of align, return the new position */
+static size_t pc_arrow_align(PCARROW *a, size_t align, size_t shift)
+{
+  size_t pad = (align + shift - a->size % align) % align;
+  pc_arrow_reserve(a, pad);
+  memset(a->buf + a->size, 0, pad);
+  a->size += pad;
+  return a->size;
+}
+
+/* Flatbuffers and Arrow metadata are little endian */
+static void pc_arrow_write_le(PCARROW *a, size_t pos, uint64_t v, size_t size)
+{
+  size_t i;
+  for (i = 0; i < size; i++)
+    a->buf[pos + i] = (v >> (8 * i)) & 0xFF;
+}
+
+static size_t pc_arrow_put_le(PCARROW *a, uint64_t v, size_t size)
+{
+  size_t pos = a->size;
+  pc_arrow_reserve(a, size);
+  pc_arrow_write_le(a, pos, v, size);
+  a->size += size;
+  return pos;
+}
+
+/* Point a reference written at pos to the object at target */
+static void pc_arrow_patch(PCARROW *a, size_t pos, size_t target)
+{
+  pc_arrow_write_le(a, pos, target - pos, 4);
+}
+
+/*
+ * Write a vtable and the table following it. The widest fields come first,
+ * so that all of them are aligned. Return the table position.
+ */
+static size_t pc_arrow_table(PCARROW *a, PCFBFIELD *fields, int nfields)
+{
+  uint16_t nslots = 0, tablesize = 4, offset;
+  size_t vtable, table;
+  int i, size, wide = 0;
+
+  for (i = 0; i < nfields; i++)
+  {
+    if (fields[i].id + 1 > nslots)
+      nslots = fields[i].id + 1;
+    if (fields[i].size == 8)
+      wide = 1;
+    tablesize += fields[i].size;
+  }
+
+  vtable = pc_arrow_align(a, 2, 0);
+  pc_arrow_put_le(a, 4 + 2 * nslots, 2);
+  pc_arrow_put_le(a, tablesize, 2);
+  for (i = 0; i < nslots; i++)
+    pc_arrow_put_le(a, 0, 2);
+
+  /* The 8 bytes fields start right after the vtable offset */
+  table = pc_arrow_align(a, wide ? 8 : 4, wide ? 4 : 0);
+  pc_arrow_put_le(a, (uint32_t)(table - vtable), 4);
+  offset = 4;
+  for (size = 8; size > 0; size /= 2)
+  {
+    for (i = 0; i < nfields; i++)
+    {
+      if (fields[i].size != size)
+        continue;
+      fields[i].pos = pc_arrow_put_le(a, fields[i].value, size);
+      pc_arrow_write_le(a, vtable + 4 + 2 * fields[i].id, offset, 2);
+      offset += size;
+    }
+  }
+  return table;
+}
+
+/* Write a vector of n references, return the position of the first one */
+static size_t pc_arrow_refs(PCARROW *a, size_t ref, uint32_t n)
+{
+  size_t vector = pc_arrow_align(a, 4, 0);
+  uint32_t i;
+
+  pc_arrow_patch(a, ref, vector);
+  pc_arrow_put_le(a, n, 4);
+  for (i = 0; i < n; i++)
+    pc_arrow_put_le(a, 0, 4);
+  return vector + 4;
+}
+
+static void pc_arrow_string(PCARROW *a, size_t ref, const char *str)
+{
+  size_t len = str ? strlen(str) : 0;
+  pc_arrow_patch(a, ref, pc_arrow_align(a, 4, 0));
+  pc_arrow_put_le(a, len, 4);
+  pc_arrow_reserve(a, len + 1);
+  memcpy(a->buf + a->size, str ? str : "", len + 1);
+  a->size += len + 1;
+}
+
+/* Write a vector of n pairs of int64 structs */
+static void pc_arrow_pairs(PCARROW *a, size_t ref, const int64_t *pairs,
+                           uint32_t n)
+{
+  uint32_t i;
+  pc_arrow_patch(a, ref, pc_arrow_align(a, 8, 4));
+  pc_arrow_put_le(a, n, 4);
+  for (i = 0; i < 2 * n; i++)
+    pc_arrow_put_le(a, pairs[i], 8);
+}
+
+/* Write a vector of key/value string pairs */
+static void pc_arrow_keyvalues(PCARROW *a, size_t ref, const char **keyvalues,
+                               uint32_t n)
+{
+  size_t elems = pc_arrow_refs(a, ref, n);
+  uint32_t i;
+
+  for (i = 0; i < n; i++)
+  {
+    PCFBFIELD kv[] = {{.id = 0, .size = 4, .ref = 1},
+                      {.id = 1, .size = 4, .ref = 1}};
+    pc_arrow_patch(a, elems + 4 * i, pc_arrow_table(a, kv, 2));
+    pc_arrow_string(a, kv[0].pos, keyvalues[2 * i]);
+    pc_arrow_string(a, kv[1].pos, keyvalues[2 * i + 1]);
+  }
+}
+
+/*
+ * Start a message of the given header type, return the position of the
+ * reference to the header. The message length is set by pc_arrow_end.
+ */
+static size_t pc_arrow_begin(PCARROW *a, uint8_t type, int64_t bodylength,
+                             size_t *start)
+{
+  PCFBFIELD message[] = {{.id = 0, .size = 2, .value = PC_ARROW_VERSION},
+                         {.id = 1, .size = 1, .value = type},
+                         {.id = 2, .size = 4, .ref = 1},
+                         {.id = 3, .size = 8, .value = bodylength}};
+  size_t root;
+
+  pc_arrow_put_le(a, 0xFFFFFFFF, 4);
+  *start = pc_arrow_put_le(a, 0, 4);
+  root = pc_arrow_put_le(a, 0, 4);
+  pc_arrow_patch(a, root, pc_arrow_table(a, message, 4));
+  return message[2].pos;
+}
+
+static void pc_arrow_end(PCARROW *a, size_t start)
+{
+  pc_arrow_align(a, 8, 0);
+  pc_arrow_write_le(a, start, a->size - start - 4, 4);
+}
+
+/* Type of the Arrow column of a dimension */
+static int pc_arrow_type(const PCDIMENSION *dim, int scaled, PCFBFIELD *type,
+                         int *ntype)
+{
+  uint32_t interp = dim->interpretation;
+  int is_signed = (interp == PC_INT8 || interp == PC_INT16 ||
+                   interp == PC_INT32 || interp == PC_INT64);
+
+  if (scaled || interp == PC_DOUBLE || interp == PC_FLOAT)
+  {
+    type[0] = (PCFBFIELD){.id = 0,
+                          .size = 2,
+                          .value = scaled || interp == PC_DOUBLE
+                                       ? PC_ARROW_DOUBLE
+                                       : PC_ARROW_SINGLE};
+    *ntype = 1;
+    return PC_ARROW_FLOATINGPOINT;
+  }
+
+  if (interp == PC_UNKNOWN || interp >= NUM_INTERPRETATIONS)
+  {
+    *ntype = 0;
+    return 0;
+  }
+
+  type[0] = (PCFBFIELD){
+      .id = 0, .size = 4, .value = 8 * pc_interpretation_size(interp)};
+  type[1] = (PCFBFIELD){.id = 1, .size = 1, .value = is_signed};
+  *ntype = 2;
+  return PC_ARROW_INT;
+}
+
+PCARROW *pc_arrow_make(const PCSCHEMA *schema, int scaled)
+{
+  PCARROW *a;
+  PCFBFIELD sch[] = {{.id = 0, .size = 2, .value = machine_endian() ? 0 : 1},
+                     {.id = 1, .size = 4, .ref = 1},
+                     {.id = 2, .size = 4, .ref = 1}};
+  char pcid[16], srid[16];
+  const char *meta[] = {"pcid", pcid, "srid", srid};
+  size_t start, header, fields;
+  uint32_t i;
+
+  for (i = 0; i < schema->ndims; i++)
+  {
+    if (!scaled && (schema->dims[i]->interpretation == PC_UNKNOWN ||
+                    schema->dims[i]->interpretation >= NUM_INTERPRETATIONS))
+    {
+      pcerror("%s: dimension '%s' has no known interpretation", __func__,
+              schema->dims[i]->name);
+      return NULL;
+    }
+  }
+
+  a = pcalloc(sizeof(PCARROW));
+  a->schema = schema;
+  a->scaled = scaled;
+  a->capacity = 1024;
+  a->buf = pcalloc(a->capacity);
+
+  sprintf(pcid, "%u", schema->pcid);
+  sprintf(srid, "%u", schema->srid);
+
+  header = pc_arrow_begin(a, PC_ARROW_SCHEMA, 0, &start);
+  pc_arrow_patch(a, header, pc_arrow_table(a, sch, 3));
+  fields = pc_arrow_refs(a, sch[1].pos, schema->ndims);
+
+  for (i = 0; i < schema->ndims; i++)
+  {
+    const PCDIMENSION *dim = schema->dims[i];
+    PCFBFIELD type[2];
+    int ntype = 0, nfield = 5;
+    PCFBFIELD field[] = {{.id = 0, .size = 4, .ref = 1},
+                         {.id = 1, .size = 1},
+                         {.id = 2, .size = 1},
+                         {.id = 3, .size = 4, .ref = 1},
+                         {.id = 5, .size = 4, .ref = 1},
+                         {.id = 6, .size = 4, .ref = 1}};
+
+    field[2].value = pc_arrow_type(dim, scaled, type, &ntype);
+
+    /* Raw values keep their scale and offset as field metadata */
+    if (!scaled && (dim->scale != 1 || dim->offset != 0))
+      nfield = 6;
+
+    pc_arrow_patch(a, fields + 4 * i, pc_arrow_table(a, field, nfield));
+    pc_arrow_string(a, field[0].pos, dim->name);
+    pc_arrow_patch(a, field[3].pos, pc_arrow_table(a, type, ntype));
+    pc_arrow_refs(a, field[4].pos, 0);
+    if (nfield == 6)
+    {
+      char scale[32], offset[32];
+      const char *kv[] = {"scale", scale, "offset", offset};
+      sprintf(scale, "%.17g", dim->scale);
+      sprintf(offset, "%.17g", dim->offset);
+      pc_arrow_keyvalues(a, field[5].pos, kv, 2);
+    }
+  }
+
+  pc_arrow_keyvalues(a, sch[2].pos, meta, 2);
+  pc_arrow_end(a, start);
+  return a;
+}
+
+void pc_arrow_free(PCARROW *a)
+{
+  pcfree(a->buf);
+  pcfree(a);
+}
+
+/* Write the values of a column at the end of the stream */
+static void pc_arrow_column(PCARROW *a, const PCDIMENSION *dim,
+                            const uint8_t *data, size_t stride,
+                            uint32_t npoints)
+{
+  uint32_t first, i;
+
+  if (!a->scaled)
+  {
+    uint8_t *out = a->buf + a->size;
+    if (stride == dim->size)
+    {
+      memcpy(out, data, (size_t)npoints * dim->size);
+      a->size += (size_t)npoints * dim->size;
+      return;
+    }
+    for (i = 0; i < npoints; i++)
+      memcpy(out + (size_t)i * dim->size, data + (size_t)i * stride, dim->size);
+    a->size += (size_t)npoints * dim->size;
+    return;
+  }
+
+  for (first = 0; first < npoints; first += PC_ARROW_CHUNK)
+  {
+    double *vals = (double *)(a->buf + a->size);
+    uint32_t n = npoints - first;
+    if (n > PC_ARROW_CHUNK)
+      n = PC_ARROW_CHUNK;
+
+    pc_value_array_from_ptr(vals, data + first * stride, stride, n, dim);
+    a->size += n * sizeof(double);
+  }
+}
+
+int pc_arrow_add_patch(PCARROW *a, const PCPATCH *pa)
+{
+  const PCSCHEMA *s = a->schema;
+  PCFBFIELD batch[] = {{.id = 0, .size = 8, .value = pa->npoints},
+                       {.id = 1, .size = 4, .ref = 1},
+                       {.id = 2, .size = 4, .ref = 1}};
+  PCPATCH *pu = NULL;
+  PCBYTES *decoded = NULL;
+  int64_t *nodes, *buffers, body = 0;
+  size_t start, header, width;
+  uint32_t i;
+
+  if (pa->schema->pcid != s->pcid)
+  {
+    pcerror("%s: patch pcid (%u) differs from stream pcid (%u)", __func__,
+            pa->schema->pcid, s->pcid);
+    return PC_FAILURE;
+  }
+
+  nodes = pcalloc(2 * s->ndims * sizeof(int64_t));
+  buffers = pcalloc(4 * s->ndims * sizeof(int64_t));
+  for (i = 0; i < s->ndims; i++)
+  {
+    width = a->scaled ? sizeof(double) : s->dims[i]->size;
+    nodes[2 * i] = pa->npoints;
+    nodes[2 * i + 1] = 0;
+    /* No validity bitmap, then the values */
+    buffers[4 * i] = body;
+    buffers[4 * i + 1] = 0;
+    buffers[4 * i + 2] = body;
+    buffers[4 * i + 3] = width * pa->npoints;
+    body += (width * pa->npoints + 7) / 8 * 8;
+  }
+
+  header = pc_arrow_begin(a, PC_ARROW_RECORDBATCH, body, &start);
+  pc_arrow_patch(a, header, pc_arrow_table(a, batch, 3));
+  pc_arrow_pairs(a, batch[1].pos, nodes, s->ndims);
+  pc_arrow_pairs(a, batch[2].pos, buffers, 2 * s->ndims);
+  pc_arrow_end(a, start);
+  pcfree(nodes);
+  pcfree(buffers);
+
+  /* Columns go to the body straight from the patch, or its decoded bytes */
+  pc_arrow_reserve(a, body);
+  if (pa->type == PC_DIMENSIONAL)
+  {
+    const PCPATCH_DIMENSIONAL *pdl = (const PCPATCH_DIMENSIONAL *)pa;
+    decoded = pcalloc(s->ndims * sizeof(PCBYTES));
+    for (i = 0; pa->npoints && i < s->ndims; i++)
+    {
+      decoded[i] = pc_bytes_decode(pdl->bytes[i]);
+      pc_arrow_column(a, s->dims[i], decoded[i].bytes, s->dims[i]->size,
+                      pa->npoints);
+      pc_bytes_free(decoded[i]);
+      pc_arrow_align(a, 8, 0);
+    }
+    pcfree(decoded);
+    return PC_SUCCESS;
+  }
+
+  if (pa->type != PC_NONE)
+    pa = pu = pc_patch_uncompress(pa);
+
+  for (i = 0; pa->npoints && i < s->ndims; i++)
+  {
+    pc_arrow_column(a, s->dims[i],
+                    ((const PCPATCH_UNCOMPRESSED *)pa)->data +
+                        s->dims[i]->byteoffset,
+                    s->size, pa->npoints);
+    pc_arrow_align(a, 8, 0);
+  }
+
+  if (pu)
+    pc_patch_free(pu);
+  return PC_SUCCESS;
+}
+
+size_t pc_arrow_stream_size(const PCARROW *a) { return a->size + 8; }
+
+void pc_arrow_stream_copy(const PCARROW *a, uint8_t *stream)
+{
+  /* End of stream marker */
+  static const uint8_t eos[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0};
+  memcpy(stream, a->buf, a->size);
+  memcpy(stream + a->size, eos, 8);
+}
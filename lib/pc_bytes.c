@@ -24,6 +24,9 @@
 #include <float.h>
 #include <stdarg.h>
 
+/* Values read at once when scanning uncompressed bytes */
+#define PC_BYTES_CHUNK 256
+
 void pc_bytes_free(PCBYTES pcb)
 {
   if (!pcb.readonly)
@@ -48,7 +51,7 @@ pc_bytes_make(const PCDIMENSION *dim, uint32_t npoints)
   return pcb;
 }
 
-static PCBYTES pc_bytes_clone(PCBYTES pcb)
+PCBYTES pc_bytes_clone(PCBYTES pcb)
 {
   PCBYTES pcbnew = pcb;
   if (!pc_bytes_empty(&pcb))
@@ -60,6 +63,35 @@ static PCBYTES pc_bytes_clone(PCBYTES pcb)
   return pcbnew;
 }
 
+PCBYTES pc_bytes_make_constant(const PCDIMENSION *dim, const uint8_t *value,
+                               uint32_t npoints)
+{
+  PCBYTES pcb;
+  uint8_t *ptr;
+  uint32_t nruns = (npoints + 254) / 255;
+  uint32_t i;
+
+  if (!npoints)
+    return pc_bytes_make(dim, 0);
+
+  /* Write the runs directly, there is nothing to scan */
+  pcb.size = nruns * (1 + dim->size);
+  pcb.bytes = pcalloc(pcb.size);
+  pcb.npoints = npoints;
+  pcb.interpretation = dim->interpretation;
+  pcb.compression = PC_DIM_RLE;
+  pcb.readonly = PC_FALSE;
+
+  ptr = pcb.bytes;
+  for (i = 0; i < nruns; i++)
+  {
+    *ptr = (i + 1 < nruns) ? 255 : npoints - i * 255;
+    memcpy(ptr + 1, value, dim->size);
+    ptr += 1 + dim->size;
+  }
+  return pcb;
+}
+
 PCBYTES
 pc_bytes_encode(PCBYTES pcb, int compression)
 {
@@ -1375,20 +1407,29 @@ int pc_bytes_deserialize(const uint8_t *buf, const PCDIMENSION *dim,
 static int pc_bytes_uncompressed_minmax(const PCBYTES *pcb, double *min,
                                         double *max, double *avg)
 {
-  int i;
-  int element_size = pc_interpretation_size(pcb->interpretation);
+  uint32_t first, i, n;
+  size_t element_size = pc_interpretation_size(pcb->interpretation);
+  double vals[PC_BYTES_CHUNK];
   double d;
   double mn = FLT_MAX;
   double mx = -1 * FLT_MAX;
   double sm = 0.0;
-  for (i = 0; i < pcb->npoints; i++)
+  for (first = 0; first < pcb->npoints; first += PC_BYTES_CHUNK)
   {
-    d = pc_double_from_ptr(pcb->bytes + i * element_size, pcb->interpretation);
-    if (d < mn)
-      mn = d;
-    if (d > mx)
-      mx = d;
-    sm += d;
+    n = pcb->npoints - first;
+    if (n > PC_BYTES_CHUNK)
+      n = PC_BYTES_CHUNK;
+    pc_double_array_from_ptr(vals, pcb->bytes + first * element_size,
+                             element_size, n, pcb->interpretation);
+    for (i = 0; i < n; i++)
+    {
+      d = vals[i];
+      if (d < mn)
+        mn = d;
+      if (d > mx)
+        mx = d;
+      sm += d;
+    }
   }
   *min = mn;
   *max = mx;
@@ -1644,19 +1685,20 @@ static PCBITMAP *pc_bytes_uncompressed_bitmap(const PCBYTES *pcb,
                                               PC_FILTERTYPE filter, double val1,
                                               double val2)
 {
-  int i = 0;
-  double d;
+  uint32_t first, i, n;
+  double vals[PC_BYTES_CHUNK];
   PCBITMAP *map = pc_bitmap_new(pcb->npoints);
-  int element_size = pc_interpretation_size(pcb->interpretation);
-  uint8_t *buf = pcb->bytes;
+  size_t element_size = pc_interpretation_size(pcb->interpretation);
 
-  while (i < pcb->npoints)
+  for (first = 0; first < pcb->npoints; first += PC_BYTES_CHUNK)
   {
-    d = pc_double_from_ptr(buf, pcb->interpretation);
-    pc_bitmap_filter(map, filter, i, d, val1, val2);
-    /* Advance the pointer */
-    buf += element_size;
-    i++;
+    n = pcb->npoints - first;
+    if (n > PC_BYTES_CHUNK)
+      n = PC_BYTES_CHUNK;
+    pc_double_array_from_ptr(vals, pcb->bytes + first * element_size,
+                             element_size, n, pcb->interpretation);
+    for (i = 0; i < n; i++)
+      pc_bitmap_filter(map, filter, first + i, vals[i], val1, val2);
   }
   return map;
 }
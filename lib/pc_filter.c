@@ -10,6 +10,11 @@
 #include "pc_api_internal.h"
 #include <assert.h>
 #include <float.h>
+#include <math.h>
+#include <strings.h>
+
+/* How many values of a dimension are read at once */
+#define PC_FILTER_CHUNK 256
 
 PCBITMAP *pc_bitmap_new(uint32_t npoints)
 {
@@ -63,25 +68,22 @@ static PCBITMAP *pc_patch_uncompressed_bitmap(const PCPATCH_UNCOMPRESSED *pa,
                                               PC_FILTERTYPE filter, double val1,
                                               double val2)
 {
-  PCPOINT pt;
-  uint32_t i = 0;
-  uint8_t *buf = pa->data;
-  double d;
+  const PCDIMENSION *dim = pa->schema->dims[dimnum];
   size_t sz = pa->schema->size;
+  double vals[PC_FILTER_CHUNK];
+  uint32_t first, i, n;
   PCBITMAP *map = pc_bitmap_new(pa->npoints);
 
-  pt.readonly = PC_TRUE;
-  pt.schema = pa->schema;
-
-  while (i < pa->npoints)
+  for (first = 0; first < pa->npoints; first += PC_FILTER_CHUNK)
   {
-    pt.data = buf;
-    pc_point_get_double(&pt, pa->schema->dims[dimnum], &d);
+    n = pa->npoints - first;
+    if (n > PC_FILTER_CHUNK)
+      n = PC_FILTER_CHUNK;
+    pc_value_array_from_ptr(vals, pa->data + first * sz + dim->byteoffset, sz,
+                            n, dim);
     /* Apply the filter to the bitmap */
-    pc_bitmap_filter(map, filter, i, d, val1, val2);
-    /* Advance data pointer and counter */
-    buf += sz;
-    i++;
+    for (i = 0; i < n; i++)
+      pc_bitmap_filter(map, filter, first + i, vals[i], val1, val2);
   }
 
   return map;
@@ -362,3 +364,283 @@ PCPATCH *pc_patch_filter_between_by_name(const PCPATCH *pa, const char *name,
 
   return pc_patch_filter(pa, d->position, PC_BETWEEN, val1, val2);
 }
+
+/* VOXEL FILTER ******************************************************/
+
+/* How many points are quantized at once */
+#define PC_VOXEL_CHUNK 256
+
+/* Marker of an unused hash table slot */
+#define PC_VOXEL_EMPTY UINT32_MAX
+
+static const char *PC_VOXELMODE_NAMES[] = {"first", "centroid", "closest"};
+
+typedef struct
+{
+  int64_t key[3];
+  uint32_t first;   /* first point of the voxel, PC_VOXEL_EMPTY if unused */
+  uint32_t closest; /* point closest to the centroid */
+  uint32_t count;
+  double sum[3]; /* sum of the raw coordinates */
+  double dist;
+} PCVOXEL;
+
+int pc_voxel_mode_from_string(const char *str, PC_VOXELMODE *mode)
+{
+  int i;
+  for (i = PC_VOXEL_FIRST; i <= PC_VOXEL_CLOSEST; i++)
+  {
+    if (strcasecmp(str, PC_VOXELMODE_NAMES[i]) == 0)
+    {
+      *mode = i;
+      return PC_SUCCESS;
+    }
+  }
+  return PC_FAILURE;
+}
+
+static inline size_t pc_voxel_hash(const int64_t *key)
+{
+  uint64_t h = (uint64_t)key[0] * UINT64_C(0x9E3779B97F4A7C15);
+  h ^= (uint64_t)key[1] * UINT64_C(0xC2B2AE3D27D4EB4F);
+  h ^= (uint64_t)key[2] * UINT64_C(0x165667B19E3779F9);
+  h ^= h >> 32;
+  h *= UINT64_C(0xD6E8FEB86659FD93);
+  h ^= h >> 32;
+  return (size_t)h;
+}
+
+/* Subset a patch of any compression on a bitmap */
+static PCPATCH *pc_patch_bitmap_filter(const PCPATCH *pa, const PCBITMAP *map)
+{
+  switch (pa->type)
+  {
+  case PC_NONE:
+    return (PCPATCH *)pc_patch_uncompressed_filter((PCPATCH_UNCOMPRESSED *)pa,
+                                                   map);
+  case PC_DIMENSIONAL:
+    return (PCPATCH *)pc_patch_dimensional_filter((PCPATCH_DIMENSIONAL *)pa,
+                                                  map);
+  }
+  pcerror("%s: unsupported compression %d requested", __func__, pa->type);
+  return NULL;
+}
+
+/* Copy the first point of every voxel, moved to the voxel centroid, in the
+ * compression of the schema */
+static PCPATCH *pc_patch_voxel_centroids(const PCPATCH *pa,
+                                         const PCVOXEL *voxels,
+                                         const uint32_t *slots,
+                                         const PCBITMAP *map,
+                                         const PCDIMENSION **dims, int ndims)
+{
+  const PCSCHEMA *schema = pa->schema;
+  PCPATCH_UNCOMPRESSED *pu = (PCPATCH_UNCOMPRESSED *)pc_patch_uncompress(pa);
+  PCPATCH_UNCOMPRESSED *fpu;
+  PCPATCH *paout;
+  uint8_t *buf, *fbuf;
+  uint32_t i;
+  int d;
+
+  if (!pu)
+  {
+    pcerror("%s: patch uncompression failed", __func__);
+    return NULL;
+  }
+
+  fpu = pc_patch_uncompressed_make(schema, map->nset);
+  buf = pu->data;
+  fbuf = fpu->data;
+  for (i = 0; i < pu->npoints; i++, buf += schema->size)
+  {
+    const PCVOXEL *v;
+    if (!pc_bitmap_get(map, i))
+      continue;
+    memcpy(fbuf, buf, schema->size);
+    v = voxels + slots[i];
+    for (d = 0; d < ndims; d++)
+      dims[d]->write(fbuf + dims[d]->byteoffset, v->sum[d] / v->count);
+    fbuf += schema->size;
+  }
+  fpu->maxpoints = fpu->npoints = map->nset;
+
+  if ((PCPATCH *)pu != pa)
+    pc_patch_free((PCPATCH *)pu);
+
+  if (PC_FAILURE == pc_patch_uncompressed_compute_extent(fpu) ||
+      PC_FAILURE == pc_patch_uncompressed_compute_stats(fpu))
+  {
+    pcerror("%s: failed to compute patch extent and stats", __func__);
+    pc_patch_free((PCPATCH *)fpu);
+    return NULL;
+  }
+
+  paout = pc_patch_compress((PCPATCH *)fpu, NULL);
+  if (paout != (PCPATCH *)fpu)
+    pc_patch_free((PCPATCH *)fpu);
+  return paout;
+}
+
+PCPATCH *pc_patch_voxel_filter(const PCPATCH *pa, double voxelsize,
+                               PC_VOXELMODE mode)
+{
+  const PCSCHEMA *schema = pa->schema;
+  const PCDIMENSION *dims[3];
+  PCCOLUMN cols[3];
+  double origin[3], inv[3];
+  double raw[3][PC_VOXEL_CHUNK];
+  PCPATCH *pu = NULL;
+  PCPATCH *paout = NULL;
+  PCVOXEL *voxels;
+  PCBITMAP *map;
+  uint32_t *slots;
+  size_t capacity, mask;
+  uint32_t i, j, n;
+  int d, ndims = 0;
+
+  if (!(voxelsize > 0) || !isfinite(voxelsize))
+  {
+    pcerror("%s: voxel size must be a positive number", __func__);
+    return NULL;
+  }
+
+  if (!schema->xdim || !schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return NULL;
+  }
+
+  if (!pa->npoints)
+    return (PCPATCH *)pc_patch_uncompressed_make(schema, 0);
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
+    return NULL;
+
+  dims[ndims++] = schema->xdim;
+  dims[ndims++] = schema->ydim;
+  if (schema->zdim)
+    dims[ndims++] = schema->zdim;
+
+  /* Quantize the raw values: raw * scale + offset = voxel * voxelsize */
+  for (d = 0; d < ndims; d++)
+  {
+    origin[d] = -dims[d]->offset / dims[d]->scale;
+    inv[d] = dims[d]->scale / voxelsize;
+    pc_patch_column_init(&cols[d], pa, dims[d]);
+  }
+
+  capacity = 2;
+  while (capacity < 2 * (size_t)pa->npoints)
+    capacity <<= 1;
+  mask = capacity - 1;
+
+  voxels = pcalloc(capacity * sizeof(PCVOXEL));
+  for (i = 0; i < capacity; i++)
+    voxels[i].first = PC_VOXEL_EMPTY;
+  slots = pcalloc(pa->npoints * sizeof(uint32_t));
+  map = pc_bitmap_new(pa->npoints);
+
+  /* Accumulate every point into the voxel it falls in */
+  for (i = 0; i < pa->npoints; i += n)
+  {
+    n = pa->npoints - i;
+    if (n > PC_VOXEL_CHUNK)
+      n = PC_VOXEL_CHUNK;
+
+    for (d = 0; d < ndims; d++)
+      pc_patch_column_get_doubles(&cols[d], i, n, raw[d]);
+
+    for (j = 0; j < n; j++)
+    {
+      int64_t key[3] = {0, 0, 0};
+      PCVOXEL *v;
+      size_t h;
+
+      for (d = 0; d < ndims; d++)
+      {
+        double q = floor((raw[d][j] - origin[d]) * inv[d]);
+        /* written so that NaN coordinates fail too */
+        if (!(q > -9.0e18 && q < 9.0e18))
+        {
+          pcerror("%s: point %u cannot be assigned to a voxel", __func__,
+                  i + j);
+          goto cleanup;
+        }
+        key[d] = (int64_t)q;
+      }
+
+      h = pc_voxel_hash(key) & mask;
+      while (voxels[h].first != PC_VOXEL_EMPTY &&
+             memcmp(voxels[h].key, key, sizeof(key)) != 0)
+        h = (h + 1) & mask;
+
+      v = voxels + h;
+      if (v->first == PC_VOXEL_EMPTY)
+      {
+        memcpy(v->key, key, sizeof(key));
+        v->first = v->closest = i + j;
+        v->dist = DBL_MAX;
+      }
+      v->count++;
+      for (d = 0; d < ndims; d++)
+        v->sum[d] += raw[d][j];
+      slots[i + j] = (uint32_t)h;
+    }
+  }
+
+  /* Find the point nearest to the centroid of each voxel */
+  if (mode == PC_VOXEL_CLOSEST)
+  {
+    for (i = 0; i < pa->npoints; i += n)
+    {
+      n = pa->npoints - i;
+      if (n > PC_VOXEL_CHUNK)
+        n = PC_VOXEL_CHUNK;
+
+      for (d = 0; d < ndims; d++)
+        pc_patch_column_get_doubles(&cols[d], i, n, raw[d]);
+
+      for (j = 0; j < n; j++)
+      {
+        PCVOXEL *v = voxels + slots[i + j];
+        double dist = 0;
+        for (d = 0; d < ndims; d++)
+        {
+          double delta = (raw[d][j] - v->sum[d] / v->count) * dims[d]->scale;
+          dist += delta * delta;
+        }
+        if (dist < v->dist)
+        {
+          v->dist = dist;
+          v->closest = i + j;
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < capacity; i++)
+  {
+    if (voxels[i].first == PC_VOXEL_EMPTY)
+      continue;
+    pc_bitmap_set(map, mode == PC_VOXEL_CLOSEST ? voxels[i].closest
+                                                : voxels[i].first,
+                  1);
+  }
+
+  if (mode == PC_VOXEL_CENTROID)
+    paout = pc_patch_voxel_centroids(pa, voxels, slots, map, dims, ndims);
+  else
+    paout = pc_patch_bitmap_filter(pa, map);
+
+cleanup:
+  for (d = 0; d < ndims; d++)
+    pc_patch_column_free(&cols[d]);
+  pc_bitmap_free(map);
+  pcfree(slots);
+  pcfree(voxels);
+  if (pu)
+    pc_patch_free(pu);
+
+  return paout;
+}
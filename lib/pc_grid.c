@@ -0,0 +1,252 @@
+/***********************************************************************
+ * pc_grid.c
+ *
+ *  Pointclound patch gridding. Bin the points of patches into the
+ *  cells of a regular XY grid and aggregate a dimension per cell.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <assert.h>
+#include <math.h>
+#include <strings.h>
+
+/* How many points are binned at once */
+#define PC_GRID_CHUNK 256
+
+/* Cell index of points falling outside the grid */
+#define PC_GRID_NOCELL UINT32_MAX
+
+static const char *PC_GRIDAGG_NAMES[] = {"min", "max", "mean", "count",
+                                         "last"};
+
+PCGRID *pc_grid_make(double xmin, double ymin, double cellsize,
+                     uint32_t ncols, uint32_t nrows, PC_GRIDAGG agg)
+{
+  PCGRID *grid;
+  size_t ncells = (size_t)ncols * nrows;
+
+  if (!(cellsize > 0) || !isfinite(cellsize))
+  {
+    pcerror("%s: cell size must be a positive number", __func__);
+    return NULL;
+  }
+
+  if (!isfinite(xmin) || !isfinite(ymin))
+  {
+    pcerror("%s: grid origin must be finite", __func__);
+    return NULL;
+  }
+
+  if (ncells == 0 || ncells >= PC_GRID_NOCELL)
+  {
+    pcerror("%s: invalid grid size %u x %u", __func__, ncols, nrows);
+    return NULL;
+  }
+
+  grid = pcalloc(sizeof(PCGRID));
+  grid->xmin = xmin;
+  grid->ymin = ymin;
+  grid->cellsize = cellsize;
+  grid->ncols = ncols;
+  grid->nrows = nrows;
+  grid->agg = agg;
+  grid->values = pcalloc(ncells * sizeof(double));
+  grid->counts = pcalloc(ncells * sizeof(uint32_t));
+  return grid;
+}
+
+void pc_grid_free(PCGRID *grid)
+{
+  if (!grid)
+    return;
+  pcfree(grid->values);
+  pcfree(grid->counts);
+  pcfree(grid);
+}
+
+int pc_grid_agg_from_string(const char *str, PC_GRIDAGG *agg)
+{
+  int i;
+  for (i = PC_GRID_MIN; i <= PC_GRID_LAST; i++)
+  {
+    if (strcasecmp(str, PC_GRIDAGG_NAMES[i]) == 0)
+    {
+      *agg = i;
+      return PC_SUCCESS;
+    }
+  }
+  return PC_FAILURE;
+}
+
+/* Compute the cell index of each point, PC_GRID_NOCELL if outside the grid */
+static void pc_grid_cells(const PCGRID *grid, const double *x, const double *y,
+                          uint32_t n, uint32_t *cells)
+{
+  uint32_t i;
+  for (i = 0; i < n; i++)
+  {
+    double col = floor((x[i] - grid->xmin) / grid->cellsize);
+    double row = floor((y[i] - grid->ymin) / grid->cellsize);
+    /* written so that NaN coordinates fall outside */
+    if (col >= 0 && col < grid->ncols && row >= 0 && row < grid->nrows)
+      cells[i] = (uint32_t)row * grid->ncols + (uint32_t)col;
+    else
+      cells[i] = PC_GRID_NOCELL;
+  }
+}
+
+/* Accumulation kernels, one loop per aggregation */
+static void pc_grid_accumulate(PCGRID *grid, const uint32_t *cells,
+                               const double *vals, uint32_t n)
+{
+  double *values = grid->values;
+  uint32_t *counts = grid->counts;
+  uint32_t i, c;
+
+  switch (grid->agg)
+  {
+  case PC_GRID_MIN:
+    for (i = 0; i < n; i++)
+    {
+      if ((c = cells[i]) == PC_GRID_NOCELL)
+        continue;
+      if (!counts[c]++ || vals[i] < values[c])
+        values[c] = vals[i];
+    }
+    break;
+  case PC_GRID_MAX:
+    for (i = 0; i < n; i++)
+    {
+      if ((c = cells[i]) == PC_GRID_NOCELL)
+        continue;
+      if (!counts[c]++ || vals[i] > values[c])
+        values[c] = vals[i];
+    }
+    break;
+  case PC_GRID_MEAN:
+    for (i = 0; i < n; i++)
+    {
+      if ((c = cells[i]) == PC_GRID_NOCELL)
+        continue;
+      counts[c]++;
+      values[c] += vals[i];
+    }
+    break;
+  case PC_GRID_LAST:
+    for (i = 0; i < n; i++)
+    {
+      if ((c = cells[i]) == PC_GRID_NOCELL)
+        continue;
+      counts[c]++;
+      values[c] = vals[i];
+    }
+    break;
+  case PC_GRID_COUNT:
+    for (i = 0; i < n; i++)
+    {
+      if ((c = cells[i]) == PC_GRID_NOCELL)
+        continue;
+      counts[c]++;
+    }
+    break;
+  }
+}
+
+int pc_grid_add_patch(PCGRID *grid, const PCPATCH *pa, const char *dimname)
+{
+  const PCSCHEMA *schema = pa->schema;
+  const PCDIMENSION *dim = NULL;
+  PCPATCH *pu = NULL;
+  PCCOLUMN xcol, ycol, vcol;
+  PCBOUNDS extent;
+  double x[PC_GRID_CHUNK], y[PC_GRID_CHUNK], v[PC_GRID_CHUNK];
+  uint32_t cells[PC_GRID_CHUNK];
+  uint32_t i, n;
+
+  if (grid->agg != PC_GRID_COUNT)
+  {
+    dim = pc_schema_get_dimension_by_name(schema, dimname);
+    if (!dim)
+    {
+      pcerror("%s: dimension \"%s\" does not exist", __func__, dimname);
+      return PC_FAILURE;
+    }
+  }
+
+  /* Skip patches that cannot touch any cell */
+  extent.xmin = grid->xmin;
+  extent.ymin = grid->ymin;
+  extent.xmax = grid->xmin + grid->ncols * grid->cellsize;
+  extent.ymax = grid->ymin + grid->nrows * grid->cellsize;
+  if (!pa->npoints || !pc_bounds_intersects(&extent, &pa->bounds))
+    return PC_SUCCESS;
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
+    return PC_FAILURE;
+
+  xcol.mem = ycol.mem = vcol.mem = NULL;
+  if (PC_FAILURE == pc_patch_column_init(&xcol, pa, schema->xdim) ||
+      PC_FAILURE == pc_patch_column_init(&ycol, pa, schema->ydim) ||
+      (dim && PC_FAILURE == pc_patch_column_init(&vcol, pa, dim)))
+  {
+    pc_patch_column_free(&xcol);
+    pc_patch_column_free(&ycol);
+    pc_patch_column_free(&vcol);
+    if (pu)
+      pc_patch_free(pu);
+    return PC_FAILURE;
+  }
+
+  for (i = 0; i < pa->npoints; i += n)
+  {
+    n = pa->npoints - i;
+    if (n > PC_GRID_CHUNK)
+      n = PC_GRID_CHUNK;
+
+    pc_patch_column_get_values(&xcol, i, n, x);
+    pc_patch_column_get_values(&ycol, i, n, y);
+    pc_grid_cells(grid, x, y, n, cells);
+    if (dim)
+      pc_patch_column_get_values(&vcol, i, n, v);
+    pc_grid_accumulate(grid, cells, v, n);
+  }
+
+  pc_patch_column_free(&xcol);
+  pc_patch_column_free(&ycol);
+  pc_patch_column_free(&vcol);
+  if (pu)
+    pc_patch_free(pu);
+
+  return PC_SUCCESS;
+}
+
+int pc_grid_get_value(const PCGRID *grid, uint32_t col, uint32_t row,
+                      double *val)
+{
+  uint32_t c;
+
+  assert(col < grid->ncols && row < grid->nrows);
+  c = row * grid->ncols + col;
+
+  if (grid->agg == PC_GRID_COUNT)
+  {
+    *val = grid->counts[c];
+    return PC_SUCCESS;
+  }
+
+  if (!grid->counts[c])
+    return PC_FAILURE;
+
+  if (grid->agg == PC_GRID_MEAN)
+    *val = grid->values[c] / grid->counts[c];
+  else
+    *val = grid->values[c];
+
+  return PC_SUCCESS;
+}
@@ -529,196 +529,219 @@ PCPOINT *pc_patch_pointn(const PCPATCH *patch, int n)
   return NULL;
 }
 
-static void pc_patch_point_set(PCPOINT *p, const uint8_t *data,
-                               PCDIMENSION **dims, const uint8_t *def)
-{
-  size_t i;
-  for (i = 0; i < p->schema->ndims; i++)
-  {
-    const PCDIMENSION *ddim = dims[i];
-    const PCDIMENSION *pdim = p->schema->dims[i];
-    uint8_t *pdata = p->data + pdim->byteoffset;
-    const uint8_t *ddata =
-        ddim ? data + ddim->byteoffset : def + pdim->byteoffset;
-    memcpy(pdata, ddata, pdim->size);
-  }
-}
-
 /** set schema for patch */
 PCPATCH *pc_patch_set_schema(PCPATCH *patch, const PCSCHEMA *new_schema,
                              double def)
 {
-  PCDIMENSION **new_dimensions = new_schema->dims;
-  PCDIMENSION *old_dimensions[new_schema->ndims];
-  const PCSCHEMA *old_schema = patch->schema;
-  PCPATCH_UNCOMPRESSED *paout;
-  PCPOINT opt, npt;
-  PCPATCH *pain;
-  PCPOINT *dpt;
-  size_t i, j;
+  PCTRANSFORM *plan;
+  PCPATCH *paout;
 
-  // create a point for storing the default values
-  dpt = pc_point_make(new_schema);
+  plan = pc_transform_make(patch->schema, new_schema, def, PC_FALSE);
+  if (!plan)
+    return NULL;
 
-  for (j = 0; j < new_schema->ndims; j++)
-  {
-    PCDIMENSION *ndim = new_dimensions[j];
-    PCDIMENSION *odim = pc_schema_get_dimension_by_name(old_schema, ndim->name);
-    old_dimensions[j] = odim;
-    if (odim)
-    {
-      if (ndim->interpretation != odim->interpretation)
-      {
-        pcerror("dimension interpretations are not matching");
-        pc_point_free(dpt);
-        return NULL;
-      }
-    }
-    else
-    {
-      pc_point_set_double(dpt, ndim, def);
-    }
-  }
+  paout = pc_patch_transform_plan(patch, plan);
+  pc_transform_free(plan);
+  return paout;
+}
 
-  pain = pc_patch_uncompress(patch);
-  paout = pc_patch_uncompressed_make(new_schema, patch->npoints);
-  paout->npoints = pain->npoints;
+/**
+ * Read all the points from "patch", and transform them based on "new_schema".
+ * Return a new patch with the transformed points.
+ */
+PCPATCH *pc_patch_transform(const PCPATCH *patch, const PCSCHEMA *new_schema,
+                            double def)
+{
+  PCTRANSFORM *plan;
+  PCPATCH *paout;
 
-  opt.schema = old_schema;
-  npt.schema = new_schema;
-  opt.readonly = PC_TRUE;
-  npt.readonly = PC_TRUE;
+  plan = pc_transform_make(patch->schema, new_schema, def, PC_TRUE);
+  if (!plan)
+    return NULL;
 
-  opt.data = ((PCPATCH_UNCOMPRESSED *)pain)->data;
-  npt.data = paout->data;
+  paout = pc_patch_transform_plan(patch, plan);
+  pc_transform_free(plan);
+  return paout;
+}
+
+/**
+ * Keep the dimensions of "new_schema", which must all be in the patch
+ * schema with the same interpretations, scales and offsets. Dimensional
+ * patches keep their encoded columns, other patches are copied in a
+ * single pass.
+ */
+PCPATCH *pc_patch_project(const PCPATCH *patch, const PCSCHEMA *new_schema)
+{
+  PCTRANSFORM *plan;
+  PCPATCH *paout;
 
-  for (i = 0; i < patch->npoints; i++)
+  if (!pc_schema_is_projection(patch->schema, new_schema))
   {
-    pc_patch_point_set(&npt, opt.data, old_dimensions, dpt->data);
-    opt.data += old_schema->size;
-    npt.data += new_schema->size;
+    pcerror("%s: dimensions are missing or do not have the same "
+            "interpretations, scales and offsets in both schemas",
+            __func__);
+    return NULL;
   }
 
-  if (patch->stats)
-  {
-    paout->stats = pc_stats_new(new_schema);
+  if (patch->type == PC_DIMENSIONAL)
+    return (PCPATCH *)pc_patch_dimensional_project(
+        (const PCPATCH_DIMENSIONAL *)patch, new_schema);
+
+  plan = pc_transform_make(patch->schema, new_schema, 0.0, PC_FALSE);
+  if (!plan)
+    return NULL;
 
-    opt.data = patch->stats->min.data;
-    npt.data = paout->stats->min.data;
-    pc_patch_point_set(&npt, opt.data, old_dimensions, dpt->data);
+  paout = pc_patch_transform_plan(patch, plan);
+  pc_transform_free(plan);
+  return paout;
+}
 
-    opt.data = patch->stats->max.data;
-    npt.data = paout->stats->max.data;
-    pc_patch_point_set(&npt, opt.data, old_dimensions, dpt->data);
+/**
+ * Lazperf has no per-dimension access, its columns are read from the
+ * decoded points. The decoded patch is returned in *pu for the caller to
+ * free, *pu is NULL when the patch is used as is.
+ */
+const PCPATCH *pc_patch_column_source(const PCPATCH *pa, PCPATCH **pu)
+{
+  *pu = NULL;
+  if (pa->type != PC_LAZPERF)
+    return pa;
+
+  *pu = pc_patch_uncompress(pa);
+  if (!*pu)
+    pcerror("%s: patch uncompression failed", __func__);
+  return *pu;
+}
 
-    opt.data = patch->stats->avg.data;
-    npt.data = paout->stats->avg.data;
-    pc_patch_point_set(&npt, opt.data, old_dimensions, dpt->data);
+/**
+ * Set up a read-only view over the values of one dimension of an
+ * uncompressed or dimensional patch. Dimensional columns are decoded
+ * on their own, without touching the other dimensions.
+ */
+int pc_patch_column_init(PCCOLUMN *col, const PCPATCH *pa,
+                         const PCDIMENSION *dim)
+{
+  col->dim = dim;
+  col->npoints = pa->npoints;
+  col->mem = NULL;
 
-    pc_point_get_x(&paout->stats->min, &paout->bounds.xmin);
-    pc_point_get_y(&paout->stats->min, &paout->bounds.ymin);
-    pc_point_get_x(&paout->stats->max, &paout->bounds.xmax);
-    pc_point_get_y(&paout->stats->max, &paout->bounds.ymax);
+  switch (pa->type)
+  {
+  case PC_NONE:
+  {
+    const PCPATCH_UNCOMPRESSED *pu = (const PCPATCH_UNCOMPRESSED *)pa;
+    col->data = pu->data + dim->byteoffset;
+    col->stride = pa->schema->size;
+    return PC_SUCCESS;
   }
-  else
+  case PC_DIMENSIONAL:
   {
-    double xscale = npt.schema->xdim->scale / opt.schema->xdim->scale;
-    double yscale = npt.schema->ydim->scale / opt.schema->ydim->scale;
-    double xoffset = npt.schema->xdim->offset - opt.schema->xdim->offset;
-    double yoffset = npt.schema->ydim->offset - opt.schema->ydim->offset;
-
-    paout->bounds.xmin = patch->bounds.xmin * xscale + xoffset;
-    paout->bounds.xmax = patch->bounds.xmax * xscale + xoffset;
-    paout->bounds.ymin = patch->bounds.ymin * yscale + yoffset;
-    paout->bounds.xmax = patch->bounds.ymax * yscale + yoffset;
+    const PCPATCH_DIMENSIONAL *pdl = (const PCPATCH_DIMENSIONAL *)pa;
+    PCBYTES pcb = pdl->bytes[dim->position];
+    if (pcb.compression != PC_DIM_NONE)
+    {
+      pcb = pc_bytes_decode(pcb);
+      col->mem = pcb.bytes;
+    }
+    col->data = pcb.bytes;
+    col->stride = dim->size;
+    return PC_SUCCESS;
+  }
   }
+  pcerror("%s: unsupported compression %d requested", __func__, pa->type);
+  return PC_FAILURE;
+}
 
-  pc_point_free(dpt);
+void pc_patch_column_free(PCCOLUMN *col)
+{
+  if (col->mem)
+    pcfree(col->mem);
+  col->mem = NULL;
+}
 
-  if (pain != patch)
-    pc_patch_free(pain);
+/** Read n scaled values of the column, starting at point first */
+void pc_patch_column_get_values(const PCCOLUMN *col, uint32_t first,
+                                uint32_t n, double *vals)
+{
+  assert(first + n <= col->npoints);
+  pc_value_array_from_ptr(vals, col->data + first * col->stride, col->stride,
+                          n, col->dim);
+}
 
-  return (PCPATCH *)paout;
+/** Read n raw (unscaled) values of the column, starting at point first */
+void pc_patch_column_get_doubles(const PCCOLUMN *col, uint32_t first,
+                                 uint32_t n, double *vals)
+{
+  assert(first + n <= col->npoints);
+  col->dim->read_array(vals, col->data + first * col->stride, col->stride, n);
 }
 
-/**
- * Read all the points from "patch", and transform them based on "new_schema".
- * Return a new patch with the transformed points.
+/*
+ * Read whole columns, one after the other, scaled as doubles or raw as
+ * int64. Only the requested dimensions of dimensional patches are decoded,
+ * other compressions are uncompressed once for all the columns.
  */
-PCPATCH *pc_patch_transform(const PCPATCH *patch, const PCSCHEMA *new_schema,
-                            double def)
+static int pc_patch_get_columns_internal(const PCPATCH *pa,
+                                         const PCDIMENSION **dims,
+                                         uint32_t ndims, void *vals, int raw)
 {
-  PCDIMENSION **new_dimensions = new_schema->dims;
-  PCDIMENSION *old_dimensions[new_schema->ndims];
-  const PCSCHEMA *old_schema = patch->schema;
-  PCPATCH_UNCOMPRESSED *paout;
-  PCPOINT opt, npt;
-  PCPATCH *pain;
-  size_t i, j;
+  const PCPATCH *pu = pa;
+  PCCOLUMN col;
+  uint32_t d;
+  int rv = PC_SUCCESS;
+
+  if (!pa->npoints || !ndims)
+    return PC_SUCCESS;
 
-  if (old_schema->srid != new_schema->srid)
+  if (pa->type != PC_NONE && pa->type != PC_DIMENSIONAL)
   {
-    pcwarn("old and new schemas have different srids, and data "
-           "reprojection is not yet supported");
-    return NULL;
+    pu = pc_patch_uncompress(pa);
+    if (!pu)
+      return PC_FAILURE;
   }
 
-  for (j = 0; j < new_schema->ndims; j++)
+  for (d = 0; d < ndims && rv == PC_SUCCESS; d++)
   {
-    PCDIMENSION *ndim = new_dimensions[j];
-    PCDIMENSION *odim = pc_schema_get_dimension_by_name(old_schema, ndim->name);
-    old_dimensions[j] = odim;
-  }
+    rv = pc_patch_column_init(&col, pu, dims[d]);
+    if (rv != PC_SUCCESS)
+      break;
 
-  pain = pc_patch_uncompress(patch);
+    if (raw)
+      rv = pc_int64_array_from_ptr((int64_t *)vals + (size_t)d * pu->npoints,
+                                   col.data, col.stride, pu->npoints,
+                                   dims[d]->interpretation);
+    else
+      pc_value_array_from_ptr((double *)vals + (size_t)d * pu->npoints,
+                              col.data, col.stride, pu->npoints, dims[d]);
+    pc_patch_column_free(&col);
+  }
 
-  paout = pc_patch_uncompressed_make(new_schema, patch->npoints);
-  paout->npoints = pain->npoints;
+  if (pu != pa)
+    pc_patch_free((PCPATCH *)pu);
+  return rv;
+}
 
-  opt.schema = old_schema;
-  npt.schema = new_schema;
-  opt.readonly = PC_TRUE;
-  npt.readonly = PC_TRUE;
+int pc_patch_get_columns(const PCPATCH *pa, const PCDIMENSION **dims,
+                         uint32_t ndims, double *vals)
+{
+  return pc_patch_get_columns_internal(pa, dims, ndims, vals, PC_FALSE);
+}
 
-  opt.data = ((PCPATCH_UNCOMPRESSED *)pain)->data;
-  npt.data = paout->data;
+int pc_patch_get_raw_columns(const PCPATCH *pa, const PCDIMENSION **dims,
+                             uint32_t ndims, int64_t *vals)
+{
+  uint32_t d;
 
-  // reinterpret the data and fill the output patch
-  //
-  // TODO: for the case where the old and new dimension sets don't intersect
-  // (all the values in old_dimensions are NULL) a faster path could probably
-  // be used
-  for (i = 0; i < patch->npoints; i++)
+  /* Fail before decoding anything */
+  for (d = 0; d < ndims; d++)
   {
-    for (j = 0; j < new_schema->ndims; j++)
+    if (dims[d]->interpretation == PC_FLOAT ||
+        dims[d]->interpretation == PC_DOUBLE)
     {
-      // pc_point_get_double returns immediately w/o changing val if the
-      // dimension it is passed is NULL
-      double val = def;
-      pc_point_get_double(&opt, old_dimensions[j], &val);
-      pc_point_set_double(&npt, new_dimensions[j], val);
+      pcerror("%s: dimension \"%s\" does not hold integers", __func__,
+              dims[d]->name);
+      return PC_FAILURE;
     }
-
-    opt.data += old_schema->size;
-    npt.data += new_schema->size;
-  }
-
-  if (pain != patch)
-    pc_patch_free(pain);
-
-  if (PC_FAILURE == pc_patch_uncompressed_compute_extent(paout))
-  {
-    pcerror("%s: failed to compute patch extent", __func__);
-    pc_patch_free((PCPATCH *)paout);
-    return NULL;
-  }
-
-  if (PC_FAILURE == pc_patch_uncompressed_compute_stats(paout))
-  {
-    pcerror("%s: failed to compute patch stats", __func__);
-    pc_patch_free((PCPATCH *)paout);
-    return NULL;
   }
-
-  return (PCPATCH *)paout;
+  return pc_patch_get_columns_internal(pa, dims, ndims, vals, PC_TRUE);
 }
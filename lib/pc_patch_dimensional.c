@@ -52,9 +52,28 @@ size_t pc_patch_dimensional_serialized_size(const PCPATCH_DIMENSIONAL *patch)
 
 char *pc_patch_dimensional_to_string(const PCPATCH_DIMENSIONAL *pa)
 {
-  PCPATCH_UNCOMPRESSED *patch = pc_patch_uncompressed_from_dimensional(pa);
-  char *str = pc_patch_uncompressed_to_string(patch);
-  pc_patch_free((PCPATCH *)patch);
+  const PCSCHEMA *s = pa->schema;
+  PCBYTES *decoded = pcalloc(s->ndims * sizeof(PCBYTES));
+  uint8_t **cols = pcalloc(s->ndims * sizeof(uint8_t *));
+  size_t *strides = pcalloc(s->ndims * sizeof(size_t));
+  char *str;
+  uint32_t i;
+
+  /* Decode the columns, without interleaving them into points */
+  for (i = 0; pa->npoints && i < s->ndims; i++)
+  {
+    decoded[i] = pc_bytes_decode(pa->bytes[i]);
+    cols[i] = decoded[i].bytes;
+    strides[i] = s->dims[i]->size;
+  }
+
+  str = pc_patch_columns_to_string(s, pa->npoints, cols, strides);
+
+  for (i = 0; pa->npoints && i < s->ndims; i++)
+    pc_bytes_free(decoded[i]);
+  pcfree(decoded);
+  pcfree(cols);
+  pcfree(strides);
   return str;
 }
 
@@ -180,6 +199,52 @@ void pc_patch_dimensional_free(PCPATCH_DIMENSIONAL *pdl)
   pcfree(pdl);
 }
 
+/**
+ * Keep the columns of the dimensions of a projected schema as they
+ * are encoded, along with their stats. The caller checks that the
+ * dimensions have the same interpretations, scales and offsets.
+ */
+PCPATCH_DIMENSIONAL *
+pc_patch_dimensional_project(const PCPATCH_DIMENSIONAL *pdl,
+                             const PCSCHEMA *schema)
+{
+  PCPATCH_DIMENSIONAL *pdlout = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+  uint32_t i;
+
+  pdlout->type = PC_DIMENSIONAL;
+  pdlout->readonly = PC_FALSE;
+  pdlout->schema = schema;
+  pdlout->npoints = pdl->npoints;
+  pdlout->bounds = pdl->bounds;
+  pdlout->stats = pdl->stats ? pc_stats_new(schema) : NULL;
+  pdlout->bytes = pcalloc(schema->ndims * sizeof(PCBYTES));
+
+  for (i = 0; i < schema->ndims; i++)
+  {
+    const PCDIMENSION *ndim = schema->dims[i];
+    const PCDIMENSION *odim =
+        pc_schema_get_dimension_by_name(pdl->schema, ndim->name);
+
+    /* Clones of empty columns would share their buffer */
+    if (pc_bytes_empty(&pdl->bytes[odim->position]))
+      pdlout->bytes[i] = pc_bytes_make(ndim, 0);
+    else
+      pdlout->bytes[i] = pc_bytes_clone(pdl->bytes[odim->position]);
+
+    if (pdlout->stats)
+    {
+      memcpy(pdlout->stats->min.data + ndim->byteoffset,
+             pdl->stats->min.data + odim->byteoffset, ndim->size);
+      memcpy(pdlout->stats->max.data + ndim->byteoffset,
+             pdl->stats->max.data + odim->byteoffset, ndim->size);
+      memcpy(pdlout->stats->avg.data + ndim->byteoffset,
+             pdl->stats->avg.data + odim->byteoffset, ndim->size);
+    }
+  }
+
+  return pdlout;
+}
+
 int pc_patch_dimensional_compute_extent(PCPATCH_DIMENSIONAL *pdl)
 {
   double xmin, xmax, ymin, ymax, xavg, yavg;
@@ -18,7 +18,9 @@ void pc_patch_lazperf_free(PCPATCH_LAZPERF *pal)
   assert(pal);
   assert(pal->schema);
   pc_patch_free_stats((PCPATCH *)pal);
-  pcfree(pal->lazperf);
+  /* A read-only patch references the buffer of its serialization */
+  if (!pal->readonly)
+    pcfree(pal->lazperf);
   pcfree(pal);
 }
 
@@ -88,14 +90,15 @@ pc_patch_uncompressed_from_lazperf(const PCPATCH_LAZPERF *palaz)
 #endif
 
   PCPATCH_UNCOMPRESSED *pcu = NULL;
-  uint8_t *decompressed;
+  size_t datasize = palaz->schema->size * palaz->npoints;
+  /* Decompress right into the patch buffer, from the context manager */
+  uint8_t *decompressed = (uint8_t *)pcalloc(datasize);
 
   // cpp call to uncompressed data
-  size_t size = lazperf_uncompress_from_compressed(palaz, &decompressed);
+  size_t size = lazperf_uncompress_from_compressed(palaz, decompressed);
 
   if (size != -1)
   {
-    size_t datasize;
     pcu = pcalloc(sizeof(PCPATCH_UNCOMPRESSED));
     pcu->type = PC_NONE;
     pcu->readonly = PC_FALSE;
@@ -103,19 +106,15 @@ pc_patch_uncompressed_from_lazperf(const PCPATCH_LAZPERF *palaz)
     pcu->npoints = palaz->npoints;
     pcu->bounds = palaz->bounds;
     pcu->stats = pc_stats_clone(palaz->stats);
-
-    // not optimal but we have to pass by the context manager otherwise
-    // a segfault happenned (sometimes) during a pcfree of lazperf field
-    datasize = palaz->schema->size * palaz->npoints;
-    pcu->data = (uint8_t *)pcalloc(datasize);
-    memcpy(pcu->data, decompressed, datasize);
-    free(decompressed);
-
+    pcu->data = decompressed;
     pcu->datasize = datasize;
     pcu->maxpoints = palaz->npoints;
   }
   else
+  {
+    pcfree(decompressed);
     pcerror("%s: lazperf uncompression failed", __func__);
+  }
 
   return pcu;
 }
@@ -11,64 +11,87 @@
  ***********************************************************************/
 
 #include "pc_api_internal.h"
-#include "stringbuffer.h"
 #include <assert.h>
 
-/* TODO: expose to API ? Would require also exposing stringbuffer
- *  See https://github.com/pgpointcloud/pointcloud/issues/74
+/* How many points are formatted at once */
+#define PC_STRING_CHUNK 256
+
+/*
+ * Write the JSON form of a patch from its columns, one strided column per
+ * dimension. The buffer is sized for short numbers, and grows at most once
+ * per point.
  */
-static int
-pc_patch_uncompressed_to_stringbuffer(const PCPATCH_UNCOMPRESSED *patch,
-                                      stringbuffer_t *sb)
+char *pc_patch_columns_to_string(const PCSCHEMA *s, uint32_t npoints,
+                                 uint8_t *const *cols, const size_t *strides)
 {
-  PCPOINTLIST *pl;
-  int i, j;
-
   /* { "pcid":1, "points":[[<dim1>, <dim2>, <dim3>, <dim4>],[<dim1>, <dim2>,
    * <dim3>, <dim4>]] }*/
+  uint32_t ndims = s->ndims;
+  size_t size = 64 + (size_t)npoints * (3 + 8 * ndims);
+  size_t len, room = 4 + ndims * PC_DOUBLE_STRING_SIZE;
+  double *vals = pcalloc(PC_STRING_CHUNK * ndims * sizeof(double));
+  char *str = pcalloc(size);
+  uint32_t first, i, j;
+
+  len = sprintf(str, "{\"pcid\":%d,\"pts\":[", s->pcid);
+  for (first = 0; first < npoints; first += PC_STRING_CHUNK)
+  {
+    uint32_t n = npoints - first;
+    if (n > PC_STRING_CHUNK)
+      n = PC_STRING_CHUNK;
 
-  /* TODO: reserve space in buffer ? */
+    for (j = 0; j < ndims; j++)
+    {
+      double *v = vals + j * PC_STRING_CHUNK;
+      pc_value_array_from_ptr(v, cols[j] + first * strides[j], strides[j], n,
+                              s->dims[j]);
+    }
 
-  pl = pc_pointlist_from_uncompressed(patch);
-  stringbuffer_aprintf(sb, "{\"pcid\":%d,\"pts\":[", patch->schema->pcid);
-  for (i = 0; i < pl->npoints; i++)
-  {
-    PCPOINT *pt = pc_pointlist_get_point(pl, i);
-    if (i)
-      stringbuffer_append(sb, ",[");
-    else
-      stringbuffer_append(sb, "[");
-    for (j = 0; j < pt->schema->ndims; j++)
+    for (i = 0; i < n; i++)
     {
-      double d;
-      if (!pc_point_get_double_by_index(pt, j, &d))
+      if (len + room > size)
+      {
+        size = size * 2 > len + room ? size * 2 : len + room;
+        str = pcrealloc(str, size);
+      }
+      if (first + i)
+        str[len++] = ',';
+      str[len++] = '[';
+      for (j = 0; j < ndims; j++)
       {
-        pcerror("%s: unable to read double at index %d", __func__, j);
-        return PC_FAILURE;
+        if (j)
+          str[len++] = ',';
+        len += pc_double_to_string(str + len, vals[j * PC_STRING_CHUNK + i]);
       }
-      if (j)
-        stringbuffer_aprintf(sb, ",%g", d);
-      else
-        stringbuffer_aprintf(sb, "%g", d);
+      str[len++] = ']';
     }
-    stringbuffer_append(sb, "]");
   }
-  stringbuffer_append(sb, "]}");
 
-  /* All done, copy and clean up */
-  pc_pointlist_free(pl);
+  if (len + 3 > size)
+    str = pcrealloc(str, len + 3);
+  memcpy(str + len, "]}", 3);
 
-  return PC_SUCCESS;
+  pcfree(vals);
+  return str;
 }
 
 char *pc_patch_uncompressed_to_string(const PCPATCH_UNCOMPRESSED *patch)
 {
-  stringbuffer_t *sb = stringbuffer_create();
+  const PCSCHEMA *s = patch->schema;
+  uint8_t **cols = pcalloc(s->ndims * sizeof(uint8_t *));
+  size_t *strides = pcalloc(s->ndims * sizeof(size_t));
   char *str;
-  if (PC_FAILURE == pc_patch_uncompressed_to_stringbuffer(patch, sb))
-    return NULL;
-  str = stringbuffer_release_string(sb);
-  stringbuffer_destroy(sb);
+  uint32_t i;
+
+  for (i = 0; i < s->ndims; i++)
+  {
+    cols[i] = patch->data + s->dims[i]->byteoffset;
+    strides[i] = s->size;
+  }
+
+  str = pc_patch_columns_to_string(s, patch->npoints, cols, strides);
+  pcfree(cols);
+  pcfree(strides);
   return str;
 }
 
@@ -81,8 +81,7 @@ int pc_point_get_double(const PCPOINT *pt, const PCDIMENSION *dim, double *val)
 
   /* Read raw value from byte buffer */
   ptr = pt->data + dim->byteoffset;
-  d = pc_double_from_ptr(ptr, dim->interpretation);
-  d = pc_value_scale_offset(d, dim);
+  d = pc_value_scale_offset(dim->read(ptr), dim);
 
   *val = d;
   return PC_SUCCESS;
@@ -116,7 +115,8 @@ int pc_point_set_double(PCPOINT *pt, const PCDIMENSION *dim, double val)
   /* Get pointer into byte buffer */
   ptr = pt->data + dim->byteoffset;
 
-  return pc_double_to_ptr(ptr, dim->interpretation, val);
+  dim->write(ptr, val);
+  return PC_SUCCESS;
 }
 
 int pc_point_set_double_by_index(PCPOINT *pt, uint32_t idx, double val)
@@ -184,6 +184,7 @@ char *pc_point_to_string(const PCPOINT *pt)
   for (i = 0; i < pt->schema->ndims; i++)
   {
     double d;
+    char num[PC_DOUBLE_STRING_SIZE];
     if (!pc_point_get_double_by_index(pt, i, &d))
     {
       pcerror("pc_point_to_string: unable to read double at position %d", i);
@@ -192,7 +193,8 @@ char *pc_point_to_string(const PCPOINT *pt)
     {
       stringbuffer_append(sb, ",");
     }
-    stringbuffer_aprintf(sb, "%g", d);
+    pc_double_to_string(num, d);
+    stringbuffer_append(sb, num);
   }
   stringbuffer_append(sb, "]}");
   str = stringbuffer_getstringcopy(sb);
@@ -0,0 +1,291 @@
+/***********************************************************************
+ * pc_retile.c
+ *
+ *  Pointclound patch retiling. Redistribute the points of a stream of
+ *  patches into the tiles of a regular XY grid aligned on the origin.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <assert.h>
+#include <math.h>
+
+/* How many points are assigned to tiles at once */
+#define PC_RETILE_CHUNK 256
+
+/* Initial number of points buffered per tile */
+#define PC_RETILE_MINPOINTS 64
+
+PCRETILE *pc_retile_make(const PCSCHEMA *schema, double tilesize,
+                         uint32_t maxpoints)
+{
+  PCRETILE *rt;
+
+  if (!schema->xdim || !schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return NULL;
+  }
+
+  if (!(tilesize > 0) || !isfinite(tilesize))
+  {
+    pcerror("%s: tile size must be a positive number", __func__);
+    return NULL;
+  }
+
+  if (!maxpoints)
+  {
+    pcerror("%s: the maximum number of points must be positive", __func__);
+    return NULL;
+  }
+
+  rt = pcalloc(sizeof(PCRETILE));
+  rt->schema = schema;
+  rt->tilesize = tilesize;
+  rt->maxpoints = maxpoints;
+  return rt;
+}
+
+void pc_retile_free(PCRETILE *rt)
+{
+  uint32_t i;
+
+  if (!rt)
+    return;
+  for (i = 0; i < rt->ntiles; i++)
+  {
+    if (rt->tiles[i].data)
+      pcfree(rt->tiles[i].data);
+  }
+  for (i = rt->nextdone; i < rt->ndone; i++)
+    pc_patch_free(rt->done[i]);
+  if (rt->tiles)
+    pcfree(rt->tiles);
+  if (rt->slots)
+    pcfree(rt->slots);
+  if (rt->done)
+    pcfree(rt->done);
+  if (rt->donekeys)
+    pcfree(rt->donekeys);
+  pcfree(rt);
+}
+
+static inline uint32_t pc_retile_hash(int64_t key)
+{
+  uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+  return (uint32_t)(h >> 32);
+}
+
+/* Rebuild the hash table on twice as many slots */
+static void pc_retile_rehash(PCRETILE *rt)
+{
+  uint32_t nslots = rt->nslots ? rt->nslots * 2 : 64;
+  uint32_t mask = nslots - 1;
+  uint32_t i, s;
+
+  if (rt->slots)
+    pcfree(rt->slots);
+  rt->slots = pcalloc(nslots * sizeof(uint32_t));
+  rt->nslots = nslots;
+
+  for (i = 0; i < rt->ntiles; i++)
+  {
+    s = pc_retile_hash(rt->tiles[i].key) & mask;
+    while (rt->slots[s])
+      s = (s + 1) & mask;
+    rt->slots[s] = i + 1;
+  }
+}
+
+/* Find the tile of a key, adding it if it is not there yet */
+static PCTILE *pc_retile_get_tile(PCRETILE *rt, int64_t key)
+{
+  uint32_t mask, s;
+  PCTILE *tile;
+
+  /* Keep the hash table at most half full */
+  if (2 * (rt->ntiles + 1) > rt->nslots)
+    pc_retile_rehash(rt);
+
+  mask = rt->nslots - 1;
+  s = pc_retile_hash(key) & mask;
+  while (rt->slots[s])
+  {
+    tile = rt->tiles + rt->slots[s] - 1;
+    if (tile->key == key)
+      return tile;
+    s = (s + 1) & mask;
+  }
+
+  if (rt->ntiles == rt->maxtiles)
+  {
+    rt->maxtiles = rt->maxtiles ? rt->maxtiles * 2 : 64;
+    rt->tiles = rt->tiles ? pcrealloc(rt->tiles, rt->maxtiles * sizeof(PCTILE))
+                          : pcalloc(rt->maxtiles * sizeof(PCTILE));
+  }
+  tile = rt->tiles + rt->ntiles;
+  tile->key = key;
+  tile->npoints = 0;
+  tile->maxpoints = 0;
+  tile->data = NULL;
+  rt->slots[s] = ++rt->ntiles;
+  return tile;
+}
+
+/* Turn the points buffered in a tile into a patch ready to be popped */
+static void pc_retile_flush_tile(PCRETILE *rt, PCTILE *tile)
+{
+  PCPATCH_UNCOMPRESSED *pu;
+
+  if (!tile->npoints)
+    return;
+
+  /* The patch takes over the tile buffer */
+  pu = pc_patch_uncompressed_make(rt->schema, 0);
+  pu->data = tile->data;
+  pu->maxpoints = tile->maxpoints;
+  pu->datasize = (size_t)tile->maxpoints * rt->schema->size;
+  pu->npoints = tile->npoints;
+  pc_patch_uncompressed_compute_extent(pu);
+  pc_patch_uncompressed_compute_stats(pu);
+
+  tile->data = NULL;
+  tile->npoints = 0;
+  tile->maxpoints = 0;
+
+  if (rt->ndone == rt->maxdone)
+  {
+    rt->maxdone = rt->maxdone ? rt->maxdone * 2 : 16;
+    rt->done = rt->done ? pcrealloc(rt->done, rt->maxdone * sizeof(PCPATCH *))
+                        : pcalloc(rt->maxdone * sizeof(PCPATCH *));
+    rt->donekeys = rt->donekeys
+                       ? pcrealloc(rt->donekeys, rt->maxdone * sizeof(int64_t))
+                       : pcalloc(rt->maxdone * sizeof(int64_t));
+  }
+  rt->donekeys[rt->ndone] = tile->key;
+  rt->done[rt->ndone++] = (PCPATCH *)pu;
+}
+
+/* Compute the tile index of a coordinate */
+static int pc_retile_index(double v, double tilesize, int32_t *idx)
+{
+  double i = floor(v / tilesize);
+  /* written so that NaN coordinates fail */
+  if (!(i >= INT32_MIN && i <= INT32_MAX))
+  {
+    pcerror("%s: coordinate %g is out of the tiling range", __func__, v);
+    return PC_FAILURE;
+  }
+  *idx = (int32_t)i;
+  return PC_SUCCESS;
+}
+
+int pc_retile_add_patch(PCRETILE *rt, const PCPATCH *pa)
+{
+  const PCSCHEMA *schema = rt->schema;
+  PCPATCH_UNCOMPRESSED *pu;
+  PCCOLUMN xcol, ycol;
+  double x[PC_RETILE_CHUNK], y[PC_RETILE_CHUNK];
+  size_t size = schema->size;
+  uint32_t first, i;
+
+  if (pa->schema->pcid != schema->pcid)
+  {
+    pcerror("%s: patch pcid %u does not match the tiling pcid %u", __func__,
+            pa->schema->pcid, schema->pcid);
+    return PC_FAILURE;
+  }
+
+  if (!pa->npoints)
+    return PC_SUCCESS;
+
+  /* Decode the points once, they are then copied verbatim into the tiles */
+  if (pa->type == PC_NONE)
+    pu = (PCPATCH_UNCOMPRESSED *)pa;
+  else
+    pu = (PCPATCH_UNCOMPRESSED *)pc_patch_uncompress(pa);
+
+  pc_patch_column_init(&xcol, (PCPATCH *)pu, schema->xdim);
+  pc_patch_column_init(&ycol, (PCPATCH *)pu, schema->ydim);
+
+  for (first = 0; first < pu->npoints; first += PC_RETILE_CHUNK)
+  {
+    uint32_t n = pu->npoints - first;
+    if (n > PC_RETILE_CHUNK)
+      n = PC_RETILE_CHUNK;
+
+    pc_patch_column_get_values(&xcol, first, n, x);
+    pc_patch_column_get_values(&ycol, first, n, y);
+
+    for (i = 0; i < n; i++)
+    {
+      int32_t col, row;
+      PCTILE *tile;
+
+      if (!pc_retile_index(x[i], rt->tilesize, &col) ||
+          !pc_retile_index(y[i], rt->tilesize, &row))
+      {
+        pc_patch_column_free(&xcol);
+        pc_patch_column_free(&ycol);
+        if ((PCPATCH *)pu != pa)
+          pc_patch_free((PCPATCH *)pu);
+        return PC_FAILURE;
+      }
+
+      tile = pc_retile_get_tile(rt, pc_retile_key(col, row));
+
+      /* Grow the tile buffer geometrically, up to the tile capacity */
+      if (tile->npoints == tile->maxpoints)
+      {
+        tile->maxpoints = tile->maxpoints ? tile->maxpoints * 2
+                                          : PC_RETILE_MINPOINTS;
+        if (tile->maxpoints > rt->maxpoints)
+          tile->maxpoints = rt->maxpoints;
+        tile->data = tile->data
+                         ? pcrealloc(tile->data, tile->maxpoints * size)
+                         : pcalloc(tile->maxpoints * size);
+      }
+
+      memcpy(tile->data + tile->npoints * size, pu->data + (first + i) * size,
+             size);
+
+      if (++tile->npoints == rt->maxpoints)
+        pc_retile_flush_tile(rt, tile);
+    }
+  }
+
+  pc_patch_column_free(&xcol);
+  pc_patch_column_free(&ycol);
+  if ((PCPATCH *)pu != pa)
+    pc_patch_free((PCPATCH *)pu);
+
+  return PC_SUCCESS;
+}
+
+void pc_retile_flush(PCRETILE *rt)
+{
+  uint32_t i;
+  for (i = 0; i < rt->ntiles; i++)
+    pc_retile_flush_tile(rt, rt->tiles + i);
+}
+
+PCPATCH *pc_retile_pop(PCRETILE *rt, int64_t *key)
+{
+  if (rt->nextdone == rt->ndone)
+  {
+    rt->nextdone = rt->ndone = 0;
+    return NULL;
+  }
+  if (key)
+    *key = rt->donekeys[rt->nextdone];
+  return rt->done[rt->nextdone++];
+}
+
+int64_t pc_retile_key(int32_t col, int32_t row)
+{
+  return (int64_t)(((uint64_t)(uint32_t)col << 32) | (uint32_t)row);
+}
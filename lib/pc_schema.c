@@ -184,6 +184,7 @@ static void pc_schema_calculate_byteoffsets(PCSCHEMA *pcs)
     {
       pcs->dims[i]->byteoffset = byteoffset;
       pcs->dims[i]->size = pc_interpretation_size(pcs->dims[i]->interpretation);
+      pc_dimension_set_accessors(pcs->dims[i]);
       byteoffset += pcs->dims[i]->size;
     }
   }
@@ -220,6 +221,157 @@ PCSCHEMA *pc_schema_clone(const PCSCHEMA *s)
   return pcs;
 }
 
+/* Strings of the binary form are stored with their terminator, 0 is NULL */
+static size_t pc_schema_string_size(const char *str)
+{
+  return str ? strlen(str) + 1 : 0;
+}
+
+static uint8_t *pc_schema_set_string(uint8_t *ptr, const char *str)
+{
+  size_t size = pc_schema_string_size(str);
+  ptr = wkb_set_uint32(ptr, size);
+  if (size)
+    memcpy(ptr, str, size);
+  return ptr + size;
+}
+
+uint8_t *pc_schema_to_bytes(const PCSCHEMA *s, size_t *size)
+{
+  const PCDIMENSION *xyzm[4] = {s->xdim, s->ydim, s->zdim, s->mdim};
+  uint8_t *bytes, *ptr;
+  size_t sz = 8 * 4;
+  int i;
+
+  for (i = 0; i < s->ndims; i++)
+  {
+    if (!s->dims[i])
+    {
+      pcerror("%s: dimension %d is missing", __func__, i);
+      return NULL;
+    }
+    sz += 4 + 1 + 2 * 8 + 2 * 4;
+    sz += pc_schema_string_size(s->dims[i]->name);
+    sz += pc_schema_string_size(s->dims[i]->description);
+  }
+
+  bytes = ptr = pcalloc(sz);
+  ptr = wkb_set_uint32(ptr, s->pcid);
+  ptr = wkb_set_uint32(ptr, s->srid);
+  ptr = wkb_set_uint32(ptr, s->compression);
+  ptr = wkb_set_uint32(ptr, s->ndims);
+  for (i = 0; i < 4; i++)
+    ptr = wkb_set_uint32(ptr, xyzm[i] ? xyzm[i]->position + 1 : 0);
+
+  for (i = 0; i < s->ndims; i++)
+  {
+    const PCDIMENSION *d = s->dims[i];
+    ptr = wkb_set_uint32(ptr, d->interpretation);
+    ptr = wkb_set_char(ptr, d->active);
+    ptr = wkb_set_double(ptr, d->scale);
+    ptr = wkb_set_double(ptr, d->offset);
+    ptr = pc_schema_set_string(ptr, d->name);
+    ptr = pc_schema_set_string(ptr, d->description);
+  }
+
+  *size = sz;
+  return bytes;
+}
+
+/* Read n bytes, failing when they run past the end of the buffer */
+static int pc_schema_read(const uint8_t **ptr, const uint8_t *end, void *out,
+                          size_t n)
+{
+  if ((size_t)(end - *ptr) < n)
+    return PC_FAILURE;
+  memcpy(out, *ptr, n);
+  *ptr += n;
+  return PC_SUCCESS;
+}
+
+static int pc_schema_read_string(const uint8_t **ptr, const uint8_t *end,
+                                 char **str)
+{
+  uint32_t size;
+
+  *str = NULL;
+  if (!pc_schema_read(ptr, end, &size, 4))
+    return PC_FAILURE;
+  if (!size)
+    return PC_SUCCESS;
+  if ((size_t)(end - *ptr) < size || (*ptr)[size - 1] != '\0')
+    return PC_FAILURE;
+  *str = pcstrdup((const char *)*ptr);
+  *ptr += size;
+  return PC_SUCCESS;
+}
+
+PCSCHEMA *pc_schema_from_bytes(const uint8_t *bytes, size_t size)
+{
+  const uint8_t *ptr = bytes;
+  const uint8_t *end = bytes + size;
+  uint32_t pcid, srid, compression, ndims, xyzm[4];
+  PCSCHEMA *s;
+  int i;
+
+  if (!pc_schema_read(&ptr, end, &pcid, 4) ||
+      !pc_schema_read(&ptr, end, &srid, 4) ||
+      !pc_schema_read(&ptr, end, &compression, 4) ||
+      !pc_schema_read(&ptr, end, &ndims, 4) ||
+      !pc_schema_read(&ptr, end, xyzm, sizeof(xyzm)))
+  {
+    pcerror("%s: schema bytes are truncated", __func__);
+    return NULL;
+  }
+
+  /* Every dimension takes at least 33 bytes */
+  if (ndims > (size_t)(end - ptr) / 33)
+  {
+    pcerror("%s: schema bytes are truncated", __func__);
+    return NULL;
+  }
+
+  s = pc_schema_new(ndims);
+  s->pcid = pcid;
+  s->srid = srid;
+  s->compression = compression;
+
+  for (i = 0; i < ndims; i++)
+  {
+    PCDIMENSION *d = pc_dimension_new();
+    d->position = i;
+    if (!pc_schema_read(&ptr, end, &d->interpretation, 4) ||
+        !pc_schema_read(&ptr, end, &d->active, 1) ||
+        !pc_schema_read(&ptr, end, &d->scale, 8) ||
+        !pc_schema_read(&ptr, end, &d->offset, 8) ||
+        !pc_schema_read_string(&ptr, end, &d->name) ||
+        !pc_schema_read_string(&ptr, end, &d->description) ||
+        d->interpretation >= NUM_INTERPRETATIONS)
+    {
+      pcerror("%s: dimension %d is not valid", __func__, i);
+      pc_dimension_free(d);
+      pc_schema_free(s);
+      return NULL;
+    }
+    pc_schema_set_dimension(s, d);
+  }
+
+  for (i = 0; i < 4; i++)
+  {
+    if (xyzm[i] > ndims)
+    {
+      pcerror("%s: coordinate dimension is out of range", __func__);
+      pc_schema_free(s);
+      return NULL;
+    }
+  }
+  s->xdim = xyzm[0] ? s->dims[xyzm[0] - 1] : NULL;
+  s->ydim = xyzm[1] ? s->dims[xyzm[1] - 1] : NULL;
+  s->zdim = xyzm[2] ? s->dims[xyzm[2] - 1] : NULL;
+  s->mdim = xyzm[3] ? s->dims[xyzm[3] - 1] : NULL;
+  return s;
+}
+
 /** Release the memory behind the PCSCHEMA struct */
 void pc_schema_free(PCSCHEMA *pcs)
 {
@@ -664,3 +816,21 @@ uint32_t pc_schema_same_interpretations(const PCSCHEMA *s1, const PCSCHEMA *s2)
 
   return PC_TRUE;
 }
+
+/**
+ * Return true if all the dimensions of s2 are also in s1, with the same
+ * interpretations, scales and offsets, and if both schemas have the same
+ * srid. The values of s2 can then be read from s1 data without conversion.
+ */
+uint32_t pc_schema_is_projection(const PCSCHEMA *s1, const PCSCHEMA *s2)
+{
+  size_t i;
+
+  for (i = 0; i < s2->ndims; i++)
+  {
+    if (!pc_schema_get_dimension_by_name(s1, s2->dims[i]->name))
+      return PC_FALSE;
+  }
+
+  return pc_schema_same_interpretations(s1, s2);
+}
@@ -9,8 +9,9 @@
  *
  ***********************************************************************/
 #include "pc_api_internal.h"
-#include "sort_r/sort_r.h"
 #include <assert.h>
+#include <float.h>
+#include <strings.h>
 
 // NULL terminated array of PCDIMENSION pointers
 typedef PCDIMENSION **PCDIMENSION_LIST;
@@ -23,9 +24,8 @@ int pc_compare_dim(const void *a, const void *b, void *arg)
 {
   PCDIMENSION_LIST dim = (PCDIMENSION_LIST)arg;
   uint32_t byteoffset = dim[0]->byteoffset;
-  uint32_t interpretation = dim[0]->interpretation;
-  double da = pc_double_from_ptr(a + byteoffset, interpretation);
-  double db = pc_double_from_ptr(b + byteoffset, interpretation);
+  double da = dim[0]->read(a + byteoffset);
+  double db = dim[0]->read(b + byteoffset);
   int cmp = ((da > db) - (da < db));
   return (cmp == 0 && dim[1]) ? pc_compare_dim(a, b, dim + 1) : cmp;
 }
@@ -42,20 +42,101 @@ int pc_compare_pcb(const void *a, const void *b, const void *arg)
  * Sort
  */
 
-PCPATCH_UNCOMPRESSED *pc_patch_uncompressed_sort(const PCPATCH_UNCOMPRESSED *pu,
-                                                 PCDIMENSION_LIST dim)
+#define PC_SORTKEYS_FROM_PTR(type, tokey)                                      \
+  do                                                                           \
+  {                                                                            \
+    type v;                                                                    \
+    for (i = 0; i < n; i++)                                                    \
+    {                                                                          \
+      memcpy(&(v), ptr + keys[i].index * stride, sizeof(type));               \
+      keys[i].key = tokey(v);                                                  \
+    }                                                                          \
+  } while (0)
+
+/* Unsigned keys in the same order as the values */
+#define PC_UKEY(v) ((uint64_t)(v))
+#define PC_IKEY(v) ((uint64_t)(int64_t)(v) ^ (UINT64_C(1) << 63))
+#define PC_FKEY(v) pc_double_to_sortkey(v)
+
+static inline uint64_t pc_double_to_sortkey(double d)
 {
-  PCPATCH_UNCOMPRESSED *spu =
-      pc_patch_uncompressed_make(pu->schema, pu->npoints);
+  uint64_t bits;
+  /* -0 and 0 compare equal */
+  if (d == 0)
+    d = 0;
+  memcpy(&bits, &d, sizeof(double));
+  return (bits & (UINT64_C(1) << 63)) ? ~bits : bits | (UINT64_C(1) << 63);
+}
 
-  memcpy(spu->data, pu->data, pu->datasize);
-  spu->npoints = pu->npoints;
-  spu->bounds = pu->bounds;
-  spu->stats = pc_stats_clone(pu->stats);
+/* Set the keys to the values of the points they index */
+static void pc_sortkeys_from_ptr(PCSORTKEY *keys, uint32_t n,
+                                 const uint8_t *ptr, size_t stride,
+                                 uint32_t interpretation)
+{
+  uint32_t i;
+  switch (interpretation)
+  {
+  case PC_UINT8:
+    PC_SORTKEYS_FROM_PTR(uint8_t, PC_UKEY);
+    break;
+  case PC_UINT16:
+    PC_SORTKEYS_FROM_PTR(uint16_t, PC_UKEY);
+    break;
+  case PC_UINT32:
+    PC_SORTKEYS_FROM_PTR(uint32_t, PC_UKEY);
+    break;
+  case PC_UINT64:
+    PC_SORTKEYS_FROM_PTR(uint64_t, PC_UKEY);
+    break;
+  case PC_INT8:
+    PC_SORTKEYS_FROM_PTR(int8_t, PC_IKEY);
+    break;
+  case PC_INT16:
+    PC_SORTKEYS_FROM_PTR(int16_t, PC_IKEY);
+    break;
+  case PC_INT32:
+    PC_SORTKEYS_FROM_PTR(int32_t, PC_IKEY);
+    break;
+  case PC_INT64:
+    PC_SORTKEYS_FROM_PTR(int64_t, PC_IKEY);
+    break;
+  case PC_FLOAT:
+    PC_SORTKEYS_FROM_PTR(float, PC_FKEY);
+    break;
+  case PC_DOUBLE:
+    PC_SORTKEYS_FROM_PTR(double, PC_FKEY);
+    break;
+  default:
+    pcerror("unknown interpretation type %d encountered in %s",
+            interpretation, __func__);
+  }
+}
 
-  sort_r(spu->data, spu->npoints, pu->schema->size, pc_compare_dim, dim);
+/*
+ * Lexicographic sort as a sequence of stable radix sorts, from the last
+ * dimension to the first one
+ */
+static PCSORTKEY *pc_patch_sortkeys(const PCPATCH *pa, PCDIMENSION_LIST dim,
+                                    int ndims)
+{
+  PCSORTKEY *keys = pcalloc(pa->npoints * sizeof(PCSORTKEY));
+  uint32_t i;
+  int d;
 
-  return spu;
+  for (i = 0; i < pa->npoints; i++)
+    keys[i].index = i;
+
+  for (d = ndims - 1; d >= 0; d--)
+  {
+    PCCOLUMN col;
+    pc_patch_column_init(&col, pa, dim[d]);
+    pc_sortkeys_from_ptr(keys, pa->npoints, col.data, col.stride,
+                         dim[d]->interpretation);
+    pc_patch_column_free(&col);
+    pc_sortkeys_sort(keys, pa->npoints);
+  }
+
+  return keys;
 }
 
 PCDIMENSION_LIST pc_schema_get_dimensions_by_name(const PCSCHEMA *schema,
@@ -68,6 +149,7 @@ PCDIMENSION_LIST pc_schema_get_dimensions_by_name(const PCSCHEMA *schema,
     dim[i] = pc_schema_get_dimension_by_name(schema, name[i]);
     if (!dim[i])
     {
+      pcfree(dim);
       pcerror("dimension \"%s\" does not exist", name[i]);
       return NULL;
     }
@@ -81,20 +163,28 @@ PCPATCH *pc_patch_sort(const PCPATCH *pa, const char **name, int ndims)
 {
   PCDIMENSION_LIST dim =
       pc_schema_get_dimensions_by_name(pa->schema, name, ndims);
-  PCPATCH *pu = pc_patch_uncompress(pa);
-  if (!pu)
+  PCPATCH *pu = NULL;
+  PCPATCH *ps;
+  PCSORTKEY *keys;
+
+  if (!dim)
+    return NULL;
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
   {
     pcfree(dim);
-    pcerror("Patch uncompression failed");
     return NULL;
   }
-  PCPATCH_UNCOMPRESSED *ps =
-      pc_patch_uncompressed_sort((PCPATCH_UNCOMPRESSED *)pu, dim);
 
+  keys = pc_patch_sortkeys(pa, dim, ndims);
+  ps = pc_patch_gather(pa, keys, pa->npoints);
+
+  pcfree(keys);
   pcfree(dim);
-  if (pu != pa)
+  if (pu)
     pc_patch_free(pu);
-  return (PCPATCH *)ps;
+  return ps;
 }
 
 /**
@@ -262,3 +352,622 @@ uint32_t pc_patch_is_sorted(const PCPATCH *pa, const char **name, int ndims,
   pcfree(dim);
   return is_sorted;
 }
+
+/**
+ * Radix sort
+ */
+
+void pc_sortkeys_sort(PCSORTKEY *keys, uint32_t n)
+{
+  uint32_t hist[8][256];
+  PCSORTKEY *tmp, *src = keys, *dst;
+  uint32_t i;
+  int pass;
+
+  if (n < 2)
+    return;
+
+  /* Histograms of the eight key bytes, in a single pass */
+  memset(hist, 0, sizeof(hist));
+  for (i = 0; i < n; i++)
+  {
+    uint64_t key = keys[i].key;
+    for (pass = 0; pass < 8; pass++)
+      hist[pass][(key >> (8 * pass)) & 0xFF]++;
+  }
+
+  tmp = pcalloc(n * sizeof(PCSORTKEY));
+  dst = tmp;
+
+  for (pass = 0; pass < 8; pass++)
+  {
+    uint32_t *h = hist[pass];
+    uint32_t sum = 0, count;
+    int shift = 8 * pass;
+    int b;
+
+    /* All the keys share this byte, nothing to move */
+    if (h[(src[0].key >> shift) & 0xFF] == n)
+      continue;
+
+    for (b = 0; b < 256; b++)
+    {
+      count = h[b];
+      h[b] = sum;
+      sum += count;
+    }
+
+    for (i = 0; i < n; i++)
+      dst[h[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+    dst = src;
+    src = (src == keys) ? tmp : keys;
+  }
+
+  if (src != keys)
+    memcpy(keys, src, n * sizeof(PCSORTKEY));
+  pcfree(tmp);
+}
+
+/* Copy n elements of size bytes, picked in src by key index */
+static void pc_gather(uint8_t *dst, const uint8_t *src, size_t size,
+                      const PCSORTKEY *keys, uint32_t n)
+{
+  uint32_t i;
+  switch (size)
+  {
+  case 1:
+    for (i = 0; i < n; i++)
+      dst[i] = src[keys[i].index];
+    break;
+  case 2:
+    for (i = 0; i < n; i++)
+      memcpy(dst + 2 * i, src + 2 * (size_t)keys[i].index, 2);
+    break;
+  case 4:
+    for (i = 0; i < n; i++)
+      memcpy(dst + 4 * i, src + 4 * (size_t)keys[i].index, 4);
+    break;
+  case 8:
+    for (i = 0; i < n; i++)
+      memcpy(dst + 8 * i, src + 8 * (size_t)keys[i].index, 8);
+    break;
+  default:
+    for (i = 0; i < n; i++)
+      memcpy(dst + size * i, src + size * keys[i].index, size);
+  }
+}
+
+static PCPATCH_UNCOMPRESSED *
+pc_patch_uncompressed_gather(const PCPATCH_UNCOMPRESSED *pu,
+                             const PCSORTKEY *keys, uint32_t n)
+{
+  PCPATCH_UNCOMPRESSED *spu = pc_patch_uncompressed_make(pu->schema, n);
+
+  pc_gather(spu->data, pu->data, pu->schema->size, keys, n);
+  spu->npoints = n;
+
+  /* A permutation keeps the bounds and stats */
+  if (n == pu->npoints)
+  {
+    spu->bounds = pu->bounds;
+    spu->stats = pc_stats_clone(pu->stats);
+  }
+  else if (PC_FAILURE == pc_patch_uncompressed_compute_extent(spu) ||
+           PC_FAILURE == pc_patch_uncompressed_compute_stats(spu))
+  {
+    pcerror("%s: failed to compute patch extent and stats", __func__);
+    pc_patch_free((PCPATCH *)spu);
+    return NULL;
+  }
+  return spu;
+}
+
+/* Compute the bounds and stats of a dimensional patch of raw columns */
+static void pc_patch_dimensional_raw_stats(PCPATCH_DIMENSIONAL *pdl)
+{
+  const PCSCHEMA *schema = pdl->schema;
+  int i;
+
+  pdl->stats = pc_stats_new(schema);
+  for (i = 0; i < schema->ndims; i++)
+  {
+    const PCDIMENSION *dim = schema->dims[i];
+    double min, max, avg;
+
+    pc_bytes_minmax(&(pdl->bytes[i]), &min, &max, &avg);
+    min = pc_value_scale_offset(min, dim);
+    max = pc_value_scale_offset(max, dim);
+    avg = pc_value_scale_offset(avg, dim);
+
+    if (dim == schema->xdim)
+    {
+      pdl->bounds.xmin = min;
+      pdl->bounds.xmax = max;
+    }
+    else if (dim == schema->ydim)
+    {
+      pdl->bounds.ymin = min;
+      pdl->bounds.ymax = max;
+    }
+
+    pc_point_set_double_by_index(&(pdl->stats->min), i, min);
+    pc_point_set_double_by_index(&(pdl->stats->max), i, max);
+    pc_point_set_double_by_index(&(pdl->stats->avg), i, avg);
+  }
+}
+
+static PCPATCH_DIMENSIONAL *
+pc_patch_dimensional_gather(const PCPATCH_DIMENSIONAL *pdl,
+                            const PCSORTKEY *keys, uint32_t n)
+{
+  PCPATCH_DIMENSIONAL *spdl = pc_patch_dimensional_clone(pdl);
+  PCPATCH_DIMENSIONAL *spdlc;
+  int i;
+
+  spdl->npoints = n;
+
+  /* Permute each column on its own, no point is ever assembled */
+  for (i = 0; i < pdl->schema->ndims; i++)
+  {
+    const PCDIMENSION *dim = pdl->schema->dims[i];
+    PCBYTES pcb = pdl->bytes[i];
+    if (pcb.compression != PC_DIM_NONE)
+      pcb = pc_bytes_decode(pcb);
+    spdl->bytes[i] = pc_bytes_make(dim, n);
+    pc_gather(spdl->bytes[i].bytes, pcb.bytes, dim->size, keys, n);
+    if (pcb.bytes != pdl->bytes[i].bytes)
+      pc_bytes_free(pcb);
+  }
+
+  /* A permutation keeps the bounds and stats */
+  if (n == pdl->npoints)
+    spdl->stats = pc_stats_clone(pdl->stats);
+  else
+    pc_patch_dimensional_raw_stats(spdl);
+
+  /* The new order changes the best encodings, pick them again */
+  spdlc = pc_patch_dimensional_compress(spdl, NULL);
+  pc_patch_dimensional_free(spdl);
+  return spdlc;
+}
+
+PCPATCH *pc_patch_gather(const PCPATCH *pa, const PCSORTKEY *keys,
+                         uint32_t n)
+{
+  switch (pa->type)
+  {
+  case PC_NONE:
+    return (PCPATCH *)pc_patch_uncompressed_gather((PCPATCH_UNCOMPRESSED *)pa,
+                                                   keys, n);
+  case PC_DIMENSIONAL:
+    return (PCPATCH *)pc_patch_dimensional_gather((PCPATCH_DIMENSIONAL *)pa,
+                                                  keys, n);
+  case PC_LAZPERF:
+  {
+    PCPATCH_UNCOMPRESSED *pu =
+        pc_patch_uncompressed_from_lazperf((PCPATCH_LAZPERF *)pa);
+    PCPATCH_UNCOMPRESSED *spu;
+    if (!pu)
+    {
+      pcerror("Patch uncompression failed");
+      return NULL;
+    }
+    spu = pc_patch_uncompressed_gather(pu, keys, n);
+    pc_patch_free((PCPATCH *)pu);
+    return (PCPATCH *)spu;
+  }
+  }
+  pcerror("%s: unsupported compression %d requested", __func__, pa->type);
+  return NULL;
+}
+
+/**
+ * Spatial sort
+ */
+
+static const char *PC_SPATIALSORT_NAMES[] = {"morton", "hilbert", "lod"};
+
+int pc_spatialsort_from_string(const char *str, PC_SPATIALSORT *curve)
+{
+  int i;
+  for (i = PC_SORT_MORTON; i <= PC_SORT_LOD; i++)
+  {
+    if (strcasecmp(str, PC_SPATIALSORT_NAMES[i]) == 0)
+    {
+      *curve = i;
+      return PC_SUCCESS;
+    }
+  }
+  return PC_FAILURE;
+}
+
+/* Spread the 32 low bits of x over the even bits */
+static inline uint64_t pc_spread2(uint64_t x)
+{
+  x &= UINT64_C(0xFFFFFFFF);
+  x = (x | (x << 16)) & UINT64_C(0x0000FFFF0000FFFF);
+  x = (x | (x << 8)) & UINT64_C(0x00FF00FF00FF00FF);
+  x = (x | (x << 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+  x = (x | (x << 2)) & UINT64_C(0x3333333333333333);
+  x = (x | (x << 1)) & UINT64_C(0x5555555555555555);
+  return x;
+}
+
+/* Spread the 21 low bits of x over every third bit */
+static inline uint64_t pc_spread3(uint64_t x)
+{
+  x &= UINT64_C(0x1FFFFF);
+  x = (x | (x << 32)) & UINT64_C(0x001F00000000FFFF);
+  x = (x | (x << 16)) & UINT64_C(0x001F0000FF0000FF);
+  x = (x | (x << 8)) & UINT64_C(0x100F00F00F00F00F);
+  x = (x | (x << 4)) & UINT64_C(0x10C30C30C30C30C3);
+  x = (x | (x << 2)) & UINT64_C(0x1249249249249249);
+  return x;
+}
+
+/* Interleave the coordinate bits, the first coordinate is the most
+ * significant */
+static inline uint64_t pc_interleave(const uint32_t *q, int ndims)
+{
+  if (ndims == 2)
+    return (pc_spread2(q[0]) << 1) | pc_spread2(q[1]);
+  return (pc_spread3(q[0]) << 2) | (pc_spread3(q[1]) << 1) | pc_spread3(q[2]);
+}
+
+/* Turn coordinates of nbits into the transposed Hilbert index (Skilling,
+ * "Programming the Hilbert curve", 2004) */
+static inline void pc_hilbert_transpose(uint32_t *q, int nbits, int ndims)
+{
+  uint32_t m = (uint32_t)1 << (nbits - 1);
+  uint32_t p, s, t;
+  int i;
+
+  /* Inverse undo */
+  for (s = m; s > 1; s >>= 1)
+  {
+    p = s - 1;
+    for (i = 0; i < ndims; i++)
+    {
+      if (q[i] & s)
+        q[0] ^= p;
+      else
+      {
+        t = (q[0] ^ q[i]) & p;
+        q[0] ^= t;
+        q[i] ^= t;
+      }
+    }
+  }
+
+  /* Gray encode */
+  for (i = 1; i < ndims; i++)
+    q[i] ^= q[i - 1];
+  t = 0;
+  for (s = m; s > 1; s >>= 1)
+    if (q[ndims - 1] & s)
+      t ^= s - 1;
+  for (i = 0; i < ndims; i++)
+    q[i] ^= t;
+}
+
+PCPATCH *pc_patch_sort_spatial(const PCPATCH *pa, PC_SPATIALSORT curve)
+{
+  const PCSCHEMA *schema = pa->schema;
+  const PCDIMENSION *dims[3];
+  double *raw[3];
+  double rmin[3], factor[3];
+  PCSORTKEY *keys;
+  PCPATCH *pu = NULL;
+  PCPATCH *paout;
+  uint32_t i, maxq;
+  int d, nbits, ndims = 0;
+
+  if (curve == PC_SORT_LOD)
+    return pc_patch_sort_lod(pa, NULL);
+
+  if (!schema->xdim || !schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return NULL;
+  }
+
+  if (!pa->npoints)
+    return (PCPATCH *)pc_patch_uncompressed_make(schema, 0);
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
+    return NULL;
+
+  dims[ndims++] = schema->xdim;
+  dims[ndims++] = schema->ydim;
+  if (schema->zdim)
+    dims[ndims++] = schema->zdim;
+  nbits = (ndims == 2) ? 32 : 21;
+  maxq = (uint32_t)((UINT64_C(1) << nbits) - 1);
+
+  /* Read the raw coordinates and their range over the patch */
+  for (d = 0; d < ndims; d++)
+  {
+    PCCOLUMN col;
+    double rmax = -DBL_MAX;
+    rmin[d] = DBL_MAX;
+    raw[d] = pcalloc(pa->npoints * sizeof(double));
+    pc_patch_column_init(&col, pa, dims[d]);
+    pc_patch_column_get_doubles(&col, 0, pa->npoints, raw[d]);
+    pc_patch_column_free(&col);
+    for (i = 0; i < pa->npoints; i++)
+    {
+      if (raw[d][i] < rmin[d])
+        rmin[d] = raw[d][i];
+      if (raw[d][i] > rmax)
+        rmax = raw[d][i];
+    }
+    /* Integer coordinates keep their full resolution when they fit */
+    if (rmax - rmin[d] > maxq || dims[d]->interpretation == PC_FLOAT ||
+        dims[d]->interpretation == PC_DOUBLE)
+      factor[d] = (rmax > rmin[d]) ? maxq / (rmax - rmin[d]) : 1;
+    else
+      factor[d] = 1;
+  }
+
+  keys = pcalloc(pa->npoints * sizeof(PCSORTKEY));
+  for (i = 0; i < pa->npoints; i++)
+  {
+    uint32_t q[3];
+    for (d = 0; d < ndims; d++)
+    {
+      double v = (raw[d][i] - rmin[d]) * factor[d];
+      /* written so that NaN coordinates go first */
+      q[d] = (v > 0) ? (v < maxq ? (uint32_t)v : maxq) : 0;
+    }
+    if (curve == PC_SORT_HILBERT)
+      pc_hilbert_transpose(q, nbits, ndims);
+    keys[i].key = pc_interleave(q, ndims);
+    keys[i].index = i;
+  }
+
+  pc_sortkeys_sort(keys, pa->npoints);
+  paout = pc_patch_gather(pa, keys, pa->npoints);
+
+  for (d = 0; d < ndims; d++)
+    pcfree(raw[d]);
+  pcfree(keys);
+  if (pu)
+    pc_patch_free(pu);
+
+  return paout;
+}
+
+/**
+ * Level of detail
+ *
+ * Level l splits the patch extent into 2^l cells per axis. The points of
+ * level 0 to l hold a single point per cell of level l, so ordering the
+ * points by level makes each prefix of the patch a coarser version of it.
+ */
+
+/* Level of the points not assigned yet */
+#define PC_LOD_NOLEVEL UINT8_MAX
+
+typedef struct
+{
+  int ndims;
+  double *raw[3];
+  double rmin[3];
+  double range[3];
+  uint64_t *slots; /* Set of the occupied cells, key + 1 or 0 if empty */
+  uint32_t mask;
+} PCLOD;
+
+static int pc_lod_init(PCLOD *lod, const PCPATCH *pa)
+{
+  const PCSCHEMA *schema = pa->schema;
+  const PCDIMENSION *dims[3];
+  uint32_t i, nslots = 16;
+  int d;
+
+  if (!schema->xdim || !schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return PC_FAILURE;
+  }
+
+  lod->ndims = 0;
+  dims[lod->ndims++] = schema->xdim;
+  dims[lod->ndims++] = schema->ydim;
+  if (schema->zdim)
+    dims[lod->ndims++] = schema->zdim;
+
+  for (d = 0; d < lod->ndims; d++)
+  {
+    PCCOLUMN col;
+    double rmax = -DBL_MAX;
+    lod->rmin[d] = DBL_MAX;
+    lod->raw[d] = pcalloc(pa->npoints * sizeof(double));
+    pc_patch_column_init(&col, pa, dims[d]);
+    pc_patch_column_get_doubles(&col, 0, pa->npoints, lod->raw[d]);
+    pc_patch_column_free(&col);
+    for (i = 0; i < pa->npoints; i++)
+    {
+      if (lod->raw[d][i] < lod->rmin[d])
+        lod->rmin[d] = lod->raw[d][i];
+      if (lod->raw[d][i] > rmax)
+        rmax = lod->raw[d][i];
+    }
+    lod->range[d] = rmax - lod->rmin[d];
+  }
+
+  while (nslots < 2 * pa->npoints)
+    nslots <<= 1;
+  lod->slots = pcalloc(nslots * sizeof(uint64_t));
+  lod->mask = nslots - 1;
+  return PC_SUCCESS;
+}
+
+static void pc_lod_free(PCLOD *lod)
+{
+  int d;
+  for (d = 0; d < lod->ndims; d++)
+    pcfree(lod->raw[d]);
+  pcfree(lod->slots);
+}
+
+static void pc_lod_clear(PCLOD *lod)
+{
+  memset(lod->slots, 0, ((size_t)lod->mask + 1) * sizeof(uint64_t));
+}
+
+/* Key of the cell of a point at a level */
+static inline uint64_t pc_lod_cell(const PCLOD *lod, uint32_t i, int level)
+{
+  uint32_t ncells = (uint32_t)1 << level;
+  uint64_t key = 0;
+  int d;
+
+  for (d = 0; d < lod->ndims; d++)
+  {
+    double v = 0;
+    uint64_t c;
+    if (lod->range[d] > 0)
+      v = (lod->raw[d][i] - lod->rmin[d]) / lod->range[d] * ncells;
+    /* written so that NaN coordinates go to the first cell */
+    c = (v > 0) ? (v < ncells ? (uint64_t)v : ncells - 1) : 0;
+    key |= c << (d * PC_LOD_MAXLEVEL);
+  }
+  return key;
+}
+
+/* Mark a cell as occupied, PC_FALSE if it already was */
+static inline int pc_lod_occupy(PCLOD *lod, uint64_t key)
+{
+  uint32_t s = (uint32_t)((key * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+  for (s &= lod->mask; lod->slots[s]; s = (s + 1) & lod->mask)
+  {
+    if (lod->slots[s] == key + 1)
+      return PC_FALSE;
+  }
+  lod->slots[s] = key + 1;
+  return PC_TRUE;
+}
+
+PCPATCH *pc_patch_sort_lod(const PCPATCH *pa, uint32_t *counts)
+{
+  PCLOD lod;
+  PCSORTKEY *keys;
+  PCPATCH *pu = NULL;
+  PCPATCH *paout;
+  uint8_t *levels;
+  uint32_t i, remaining;
+  int l;
+
+  if (counts)
+    memset(counts, 0, PC_LOD_NLEVELS * sizeof(uint32_t));
+
+  if (!pa->npoints)
+    return (PCPATCH *)pc_patch_uncompressed_make(pa->schema, 0);
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
+    return NULL;
+
+  if (!pc_lod_init(&lod, pa))
+  {
+    if (pu)
+      pc_patch_free(pu);
+    return NULL;
+  }
+
+  levels = pcalloc(pa->npoints);
+  memset(levels, PC_LOD_NOLEVEL, pa->npoints);
+  remaining = pa->npoints;
+
+  for (l = 0; remaining && l <= PC_LOD_MAXLEVEL; l++)
+  {
+    /* The cells of the coarser levels are taken, the first point of each
+     * free cell goes to this level */
+    pc_lod_clear(&lod);
+    for (i = 0; i < pa->npoints; i++)
+    {
+      if (levels[i] != PC_LOD_NOLEVEL)
+        pc_lod_occupy(&lod, pc_lod_cell(&lod, i, l));
+    }
+    for (i = 0; i < pa->npoints; i++)
+    {
+      if (levels[i] == PC_LOD_NOLEVEL &&
+          pc_lod_occupy(&lod, pc_lod_cell(&lod, i, l)))
+      {
+        levels[i] = l;
+        remaining--;
+      }
+    }
+  }
+
+  /* Duplicate points at the finest level come last */
+  keys = pcalloc(pa->npoints * sizeof(PCSORTKEY));
+  for (i = 0; i < pa->npoints; i++)
+  {
+    keys[i].key = (levels[i] == PC_LOD_NOLEVEL) ? PC_LOD_MAXLEVEL + 1
+                                                 : levels[i];
+    keys[i].index = i;
+    if (counts)
+      counts[keys[i].key]++;
+  }
+
+  pc_sortkeys_sort(keys, pa->npoints);
+  paout = pc_patch_gather(pa, keys, pa->npoints);
+
+  pcfree(keys);
+  pcfree(levels);
+  pc_lod_free(&lod);
+  if (pu)
+    pc_patch_free(pu);
+
+  return paout;
+}
+
+uint32_t pc_patch_lod_npoints(const uint32_t *counts, int level)
+{
+  uint32_t n = 0;
+  int l;
+
+  for (l = 0; l <= level && l < PC_LOD_NLEVELS; l++)
+    n += counts[l];
+  return n;
+}
+
+PCPATCH *pc_patch_lod(const PCPATCH *pa, const uint32_t *counts, int level)
+{
+  PCSORTKEY *keys;
+  PCPATCH *paout;
+  uint32_t i, n;
+
+  if (level < 0)
+  {
+    pcerror("%s: level must not be negative", __func__);
+    return NULL;
+  }
+
+  /* The levels are the leading points, no cell has to be computed */
+  n = pc_patch_lod_npoints(counts, level);
+  if (n > pa->npoints)
+  {
+    pcerror("%s: level counts of %u points for a patch of %u points",
+            __func__, n, pa->npoints);
+    return NULL;
+  }
+
+  if (!n)
+    return (PCPATCH *)pc_patch_uncompressed_make(pa->schema, 0);
+
+  keys = pcalloc(n * sizeof(PCSORTKEY));
+  for (i = 0; i < n; i++)
+  {
+    keys[i].key = 0;
+    keys[i].index = i;
+  }
+  paout = pc_patch_gather(pa, keys, n);
+
+  pcfree(keys);
+  return paout;
+}
@@ -0,0 +1,283 @@
+/***********************************************************************
+ * pc_split.c
+ *
+ *  Pointclound patch splitting. Partition the points of a patch into
+ *  spatially coherent sub-patches of bounded size.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <assert.h>
+#include <float.h>
+#include <strings.h>
+
+/* Tree cells are not split beyond that depth, in case of duplicate points */
+#define PC_SPLIT_MAXDEPTH 32
+
+static const char *PC_SPLITMODE_NAMES[] = {"quadtree", "octree", "kdtree"};
+
+typedef struct
+{
+  double *coords[3]; /* point coordinates, per axis */
+  int naxes;
+  uint32_t maxpoints;
+  uint32_t *order;  /* point indexes, partitioned in place */
+  uint32_t *tmp;    /* scratch space for the partitions */
+  uint8_t *cells;   /* child cell of each point of the node being split */
+  uint32_t *starts; /* first index in order of each part */
+  uint32_t nparts;
+} PCSPLIT;
+
+int pc_splitmode_from_string(const char *str, PC_SPLITMODE *mode)
+{
+  int i;
+  for (i = PC_SPLIT_QUADTREE; i <= PC_SPLIT_KDTREE; i++)
+  {
+    if (strcasecmp(str, PC_SPLITMODE_NAMES[i]) == 0)
+    {
+      *mode = i;
+      return PC_SUCCESS;
+    }
+  }
+  return PC_FAILURE;
+}
+
+/* Record the parts of a range that is not split any further */
+static void pc_split_leaf(PCSPLIT *split, uint32_t lo, uint32_t hi)
+{
+  for (; lo < hi; lo += split->maxpoints)
+    split->starts[split->nparts++] = lo;
+}
+
+/* Partition a range on the child cells of a quadtree or octree node */
+static void pc_split_tree(PCSPLIT *split, uint32_t lo, uint32_t hi,
+                          const double *min, const double *max, int depth)
+{
+  uint32_t counts[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+  uint32_t offsets[8];
+  double mid[3], cmin[3], cmax[3];
+  int nchildren = 1 << split->naxes;
+  uint32_t i;
+  int a, c;
+
+  if (hi - lo <= split->maxpoints || depth >= PC_SPLIT_MAXDEPTH)
+  {
+    pc_split_leaf(split, lo, hi);
+    return;
+  }
+
+  for (a = 0; a < split->naxes; a++)
+    mid[a] = (min[a] + max[a]) / 2;
+
+  for (i = lo; i < hi; i++)
+  {
+    uint32_t p = split->order[i];
+    c = 0;
+    for (a = 0; a < split->naxes; a++)
+      c |= (split->coords[a][p] >= mid[a]) << a;
+    split->cells[i] = c;
+    counts[c]++;
+  }
+
+  /* Stable counting sort of the range on the child cells */
+  offsets[0] = lo;
+  for (c = 1; c < nchildren; c++)
+    offsets[c] = offsets[c - 1] + counts[c - 1];
+  for (i = lo; i < hi; i++)
+    split->tmp[offsets[split->cells[i]]++] = split->order[i];
+  memcpy(split->order + lo, split->tmp + lo, (hi - lo) * sizeof(uint32_t));
+
+  for (c = 0, i = lo; c < nchildren; c++)
+  {
+    if (!counts[c])
+      continue;
+    for (a = 0; a < split->naxes; a++)
+    {
+      cmin[a] = ((c >> a) & 1) ? mid[a] : min[a];
+      cmax[a] = ((c >> a) & 1) ? max[a] : mid[a];
+    }
+    pc_split_tree(split, i, i + counts[c], cmin, cmax, depth + 1);
+    i += counts[c];
+  }
+}
+
+/* Reorder order[lo, hi) so that order[k] holds the k-th smallest value */
+static void pc_split_select(uint32_t *order, const double *v, int64_t lo,
+                            int64_t hi, int64_t k)
+{
+  hi--;
+  while (lo < hi)
+  {
+    double pivot = v[order[lo + (hi - lo) / 2]];
+    int64_t i = lo, j = hi;
+    while (i <= j)
+    {
+      while (v[order[i]] < pivot)
+        i++;
+      while (v[order[j]] > pivot)
+        j--;
+      if (i <= j)
+      {
+        uint32_t t = order[i];
+        order[i++] = order[j];
+        order[j--] = t;
+      }
+    }
+    if (k <= j)
+      hi = j;
+    else if (k >= i)
+      lo = i;
+    else
+      break;
+  }
+}
+
+/* Split a range at the median of its widest axis */
+static void pc_split_kdtree(PCSPLIT *split, uint32_t lo, uint32_t hi)
+{
+  double extent = 0;
+  uint32_t i, mid;
+  int a, axis = 0;
+
+  if (hi - lo <= split->maxpoints)
+  {
+    pc_split_leaf(split, lo, hi);
+    return;
+  }
+
+  for (a = 0; a < split->naxes; a++)
+  {
+    const double *v = split->coords[a];
+    double min = DBL_MAX, max = -DBL_MAX;
+    for (i = lo; i < hi; i++)
+    {
+      if (v[split->order[i]] < min)
+        min = v[split->order[i]];
+      if (v[split->order[i]] > max)
+        max = v[split->order[i]];
+    }
+    if (max - min > extent)
+    {
+      extent = max - min;
+      axis = a;
+    }
+  }
+
+  /* All the points are at the same place */
+  if (!(extent > 0))
+  {
+    pc_split_leaf(split, lo, hi);
+    return;
+  }
+
+  mid = lo + (hi - lo) / 2;
+  pc_split_select(split->order, split->coords[axis], lo, hi, mid);
+  pc_split_kdtree(split, lo, mid);
+  pc_split_kdtree(split, mid, hi);
+}
+
+PCPATCH **pc_patch_split(const PCPATCH *pa, uint32_t maxpoints,
+                         PC_SPLITMODE mode, uint32_t *nparts)
+{
+  const PCSCHEMA *schema = pa->schema;
+  const PCDIMENSION *dims[3];
+  PCSPLIT split;
+  PCSORTKEY *keys;
+  PCPATCH **parts;
+  PCPATCH *pu = NULL;
+  double min[3], max[3];
+  uint32_t i;
+  int a;
+
+  *nparts = 0;
+
+  if (!maxpoints)
+  {
+    pcerror("%s: the maximum number of points must be positive", __func__);
+    return NULL;
+  }
+
+  if (!schema->xdim || !schema->ydim)
+  {
+    pcerror("%s: schema has no X and Y dimensions", __func__);
+    return NULL;
+  }
+
+  if (!pa->npoints)
+    return NULL;
+
+  pa = pc_patch_column_source(pa, &pu);
+  if (!pa)
+    return NULL;
+
+  memset(&split, 0, sizeof(PCSPLIT));
+  dims[split.naxes++] = schema->xdim;
+  dims[split.naxes++] = schema->ydim;
+  if (mode != PC_SPLIT_QUADTREE && schema->zdim)
+    dims[split.naxes++] = schema->zdim;
+
+  split.maxpoints = maxpoints;
+  split.order = pcalloc(pa->npoints * sizeof(uint32_t));
+  split.tmp = pcalloc(pa->npoints * sizeof(uint32_t));
+  split.cells = pcalloc(pa->npoints * sizeof(uint8_t));
+  split.starts = pcalloc(pa->npoints * sizeof(uint32_t));
+  for (i = 0; i < pa->npoints; i++)
+    split.order[i] = i;
+
+  for (a = 0; a < split.naxes; a++)
+  {
+    PCCOLUMN col;
+    split.coords[a] = pcalloc(pa->npoints * sizeof(double));
+    pc_patch_column_init(&col, pa, dims[a]);
+    pc_patch_column_get_values(&col, 0, pa->npoints, split.coords[a]);
+    pc_patch_column_free(&col);
+
+    min[a] = DBL_MAX;
+    max[a] = -DBL_MAX;
+    for (i = 0; i < pa->npoints; i++)
+    {
+      if (split.coords[a][i] < min[a])
+        min[a] = split.coords[a][i];
+      if (split.coords[a][i] > max[a])
+        max[a] = split.coords[a][i];
+    }
+  }
+
+  if (mode == PC_SPLIT_KDTREE)
+    pc_split_kdtree(&split, 0, pa->npoints);
+  else
+    pc_split_tree(&split, 0, pa->npoints, min, max, 0);
+
+  /* Gather the points of each part */
+  keys = pcalloc(pa->npoints * sizeof(PCSORTKEY));
+  for (i = 0; i < pa->npoints; i++)
+  {
+    keys[i].key = 0;
+    keys[i].index = split.order[i];
+  }
+
+  parts = pcalloc(split.nparts * sizeof(PCPATCH *));
+  for (i = 0; i < split.nparts; i++)
+  {
+    uint32_t start = split.starts[i];
+    uint32_t end = (i + 1 < split.nparts) ? split.starts[i + 1] : pa->npoints;
+    parts[i] = pc_patch_gather(pa, keys + start, end - start);
+  }
+  *nparts = split.nparts;
+
+  for (a = 0; a < split.naxes; a++)
+    pcfree(split.coords[a]);
+  pcfree(split.order);
+  pcfree(split.tmp);
+  pcfree(split.cells);
+  pcfree(split.starts);
+  pcfree(keys);
+  if (pu)
+    pc_patch_free(pu);
+
+  return parts;
+}
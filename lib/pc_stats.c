@@ -10,6 +10,9 @@
 #include "pc_api_internal.h"
 #include <float.h>
 
+/* How many values of a dimension are read at once */
+#define PC_STATS_CHUNK 256
+
 /*
  * Instantiate a new PCDOUBLESTATS for calculation, and set up
  * initial values for min/max/sum
@@ -145,39 +148,44 @@ PCSTATS *pc_stats_clone(const PCSTATS *stats)
 
 int pc_patch_uncompressed_compute_stats(PCPATCH_UNCOMPRESSED *pa)
 {
-  int i, j;
+  uint32_t first, i, n;
+  int j;
   const PCSCHEMA *schema = pa->schema;
-  double val;
+  double vals[PC_STATS_CHUNK];
   PCDOUBLESTATS *dstats = pc_dstats_new(pa->schema->ndims);
 
   if (pa->stats)
     pc_stats_free(pa->stats);
 
-  /* Point on stack for fast access to values in patch */
-  PCPOINT pt;
-  pt.readonly = PC_TRUE;
-  pt.schema = schema;
-  pt.data = pa->data;
-
   /* We know npoints right away */
   dstats->npoints = pa->npoints;
 
-  for (i = 0; i < pa->npoints; i++)
+  for (first = 0; first < pa->npoints; first += PC_STATS_CHUNK)
   {
+    n = pa->npoints - first;
+    if (n > PC_STATS_CHUNK)
+      n = PC_STATS_CHUNK;
+
     for (j = 0; j < schema->ndims; j++)
     {
-      pc_point_get_double(&pt, schema->dims[j], &val);
-      /* Check minimum */
-      if (val < dstats->dims[j].min)
-        dstats->dims[j].min = val;
-      /* Check maximum */
-      if (val > dstats->dims[j].max)
-        dstats->dims[j].max = val;
-      /* Add to sum */
-      dstats->dims[j].sum += val;
+      const PCDIMENSION *dim = schema->dims[j];
+      PCDOUBLESTAT *dstat = &(dstats->dims[j]);
+      pc_value_array_from_ptr(vals,
+                              pa->data + first * schema->size +
+                                  dim->byteoffset,
+                              schema->size, n, dim);
+      for (i = 0; i < n; i++)
+      {
+        /* Check minimum */
+        if (vals[i] < dstat->min)
+          dstat->min = vals[i];
+        /* Check maximum */
+        if (vals[i] > dstat->max)
+          dstat->max = vals[i];
+        /* Add to sum */
+        dstat->sum += vals[i];
+      }
     }
-    /* Advance to next point */
-    pt.data += schema->size;
   }
 
   pa->stats = pc_stats_new_from_dstats(pa->schema, dstats);
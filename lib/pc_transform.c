@@ -0,0 +1,315 @@
+/***********************************************************************
+ * pc_transform.c
+ *
+ *  Pointclound schema transforms. Compile once how the points of an old
+ *  schema map onto a new schema, then apply that plan to many patches.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_api_internal.h"
+#include <assert.h>
+
+/* How many values of a dimension are converted at once */
+#define PC_TRANSFORM_CHUNK 256
+
+/* Append a step to the plan, extending the previous one when they touch */
+static void pc_transform_add_op(PCTRANSFORM *plan, PC_TRANSFORMOP_TYPE type,
+                                const PCDIMENSION *odim,
+                                const PCDIMENSION *ndim)
+{
+  PCTRANSFORMOP *op = plan->nops ? plan->ops + plan->nops - 1 : NULL;
+  size_t from = odim ? odim->byteoffset : ndim->byteoffset;
+  size_t to = ndim->byteoffset;
+
+  if (op && type != PC_TRANSFORM_CONVERT && op->type == type &&
+      op->from + op->size == from && op->to + op->size == to)
+  {
+    op->size += ndim->size;
+    return;
+  }
+
+  op = plan->ops + plan->nops++;
+  op->type = type;
+  op->from = from;
+  op->to = to;
+  op->size = ndim->size;
+  op->odim = odim;
+  op->ndim = ndim;
+}
+
+PCTRANSFORM *pc_transform_make(const PCSCHEMA *oschema,
+                               const PCSCHEMA *nschema, double def,
+                               int rescale)
+{
+  PCTRANSFORM *plan;
+  PCPOINT dpt;
+  uint32_t i;
+
+  if (rescale && oschema->srid != nschema->srid)
+  {
+    pcwarn("old and new schemas have different srids, and data "
+           "reprojection is not yet supported");
+    return NULL;
+  }
+
+  plan = pcalloc(sizeof(PCTRANSFORM));
+  plan->oschema = oschema;
+  plan->nschema = nschema;
+  plan->def = def;
+  plan->rescale = rescale;
+  plan->nops = 0;
+  plan->ops = pcalloc(nschema->ndims * sizeof(PCTRANSFORMOP));
+  plan->defaults = pcalloc(nschema->size);
+  memset(plan->defaults, 0, nschema->size);
+
+  dpt.readonly = PC_TRUE;
+  dpt.schema = nschema;
+  dpt.data = plan->defaults;
+
+  for (i = 0; i < nschema->ndims; i++)
+  {
+    const PCDIMENSION *ndim = nschema->dims[i];
+    const PCDIMENSION *odim =
+        pc_schema_get_dimension_by_name(oschema, ndim->name);
+
+    if (!odim)
+    {
+      pc_point_set_double(&dpt, ndim, def);
+      pc_transform_add_op(plan, PC_TRANSFORM_FILL, NULL, ndim);
+    }
+    else if (!rescale)
+    {
+      if (ndim->interpretation != odim->interpretation)
+      {
+        pcerror("dimension interpretations are not matching");
+        pc_transform_free(plan);
+        return NULL;
+      }
+      pc_transform_add_op(plan, PC_TRANSFORM_COPY, odim, ndim);
+    }
+    else if (ndim->interpretation == odim->interpretation &&
+             ndim->scale == odim->scale && ndim->offset == odim->offset)
+    {
+      pc_transform_add_op(plan, PC_TRANSFORM_COPY, odim, ndim);
+    }
+    else
+    {
+      pc_transform_add_op(plan, PC_TRANSFORM_CONVERT, odim, ndim);
+    }
+  }
+
+  return plan;
+}
+
+void pc_transform_free(PCTRANSFORM *plan)
+{
+  if (!plan)
+    return;
+  pcfree(plan->ops);
+  pcfree(plan->defaults);
+  pcfree(plan);
+}
+
+/* Apply the byte-level steps of a plan to one point */
+static void pc_transform_point(const PCTRANSFORM *plan, const uint8_t *odata,
+                               uint8_t *ndata)
+{
+  uint32_t i;
+  for (i = 0; i < plan->nops; i++)
+  {
+    const PCTRANSFORMOP *op = plan->ops + i;
+    if (op->type == PC_TRANSFORM_COPY)
+      memcpy(ndata + op->to, odata + op->from, op->size);
+    else if (op->type == PC_TRANSFORM_FILL)
+      memcpy(ndata + op->to, plan->defaults + op->to, op->size);
+  }
+}
+
+/* Convert the values of one dimension, column by column */
+static void pc_transform_convert(const PCTRANSFORMOP *op,
+                                 const uint8_t *odata, size_t osize,
+                                 uint8_t *ndata, size_t nsize,
+                                 uint32_t npoints)
+{
+  double vals[PC_TRANSFORM_CHUNK];
+  uint32_t first;
+
+  for (first = 0; first < npoints; first += PC_TRANSFORM_CHUNK)
+  {
+    uint32_t n = npoints - first;
+    if (n > PC_TRANSFORM_CHUNK)
+      n = PC_TRANSFORM_CHUNK;
+
+    pc_value_array_from_ptr(vals, odata + first * osize + op->from, osize, n,
+                            op->odim);
+    pc_value_array_to_ptr(ndata + first * nsize + op->to, nsize, vals, n,
+                          op->ndim);
+  }
+}
+
+/* Map the bounds of a relabeled patch that has no stats */
+static void pc_transform_bounds(const PCTRANSFORM *plan, const PCBOUNDS *ob,
+                                PCBOUNDS *nb)
+{
+  const PCDIMENSION *oxdim = plan->oschema->xdim;
+  const PCDIMENSION *oydim = plan->oschema->ydim;
+  const PCDIMENSION *nxdim = plan->nschema->xdim;
+  const PCDIMENSION *nydim = plan->nschema->ydim;
+
+  /* The raw values are kept, so the bounds follow the new scale/offset */
+  double xscale = nxdim->scale / oxdim->scale;
+  double yscale = nydim->scale / oydim->scale;
+  double xoffset = nxdim->offset - oxdim->offset * xscale;
+  double yoffset = nydim->offset - oydim->offset * yscale;
+
+  nb->xmin = ob->xmin * xscale + xoffset;
+  nb->xmax = ob->xmax * xscale + xoffset;
+  nb->ymin = ob->ymin * yscale + yoffset;
+  nb->ymax = ob->ymax * yscale + yoffset;
+}
+
+/* Relabel the stats and bounds of a patch whose raw values are kept */
+static void pc_transform_relabel_stats(const PCTRANSFORM *plan,
+                                       const PCPATCH *patch, PCPATCH *paout)
+{
+  if (patch->stats)
+  {
+    /* Relabeled values keep their order, the stats are relabeled too */
+    paout->stats = pc_stats_new(plan->nschema);
+    pc_transform_point(plan, patch->stats->min.data, paout->stats->min.data);
+    pc_transform_point(plan, patch->stats->max.data, paout->stats->max.data);
+    pc_transform_point(plan, patch->stats->avg.data, paout->stats->avg.data);
+
+    pc_point_get_x(&paout->stats->min, &paout->bounds.xmin);
+    pc_point_get_y(&paout->stats->min, &paout->bounds.ymin);
+    pc_point_get_x(&paout->stats->max, &paout->bounds.xmax);
+    pc_point_get_y(&paout->stats->max, &paout->bounds.ymax);
+  }
+  else
+  {
+    pc_transform_bounds(plan, &patch->bounds, &paout->bounds);
+  }
+}
+
+/*
+ * Relabel a dimensional patch without decoding it: the encoded columns
+ * are copied over, and the new dimensions are filled with a run-length
+ * encoded default value.
+ */
+static PCPATCH *pc_transform_dimensional(const PCTRANSFORM *plan,
+                                         const PCPATCH_DIMENSIONAL *pdl)
+{
+  const PCSCHEMA *nschema = plan->nschema;
+  PCPATCH_DIMENSIONAL *pdlout = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+  uint32_t i;
+
+  pdlout->type = PC_DIMENSIONAL;
+  pdlout->readonly = PC_FALSE;
+  pdlout->schema = nschema;
+  pdlout->npoints = pdl->npoints;
+  pdlout->stats = NULL;
+  pdlout->bytes = pcalloc(nschema->ndims * sizeof(PCBYTES));
+
+  for (i = 0; i < nschema->ndims; i++)
+  {
+    const PCDIMENSION *ndim = nschema->dims[i];
+    const PCDIMENSION *odim =
+        pc_schema_get_dimension_by_name(plan->oschema, ndim->name);
+
+    if (!odim)
+      pdlout->bytes[i] = pc_bytes_make_constant(
+          ndim, plan->defaults + ndim->byteoffset, pdl->npoints);
+    /* Clones of empty columns would share their buffer */
+    else if (pc_bytes_empty(&pdl->bytes[odim->position]))
+      pdlout->bytes[i] = pc_bytes_make(ndim, 0);
+    else
+      pdlout->bytes[i] = pc_bytes_clone(pdl->bytes[odim->position]);
+  }
+
+  pc_transform_relabel_stats(plan, (const PCPATCH *)pdl, (PCPATCH *)pdlout);
+  return (PCPATCH *)pdlout;
+}
+
+PCPATCH *pc_patch_transform_plan(const PCPATCH *patch,
+                                 const PCTRANSFORM *plan)
+{
+  const PCSCHEMA *oschema = plan->oschema;
+  const PCSCHEMA *nschema = plan->nschema;
+  size_t osize = oschema->size;
+  size_t nsize = nschema->size;
+  PCPATCH_UNCOMPRESSED *paout;
+  const uint8_t *odata;
+  PCPATCH *pain;
+  uint32_t i, nconvert = 0;
+
+  if (patch->schema->pcid != oschema->pcid || patch->schema->size != osize)
+  {
+    pcerror("%s: patch pcid %u does not match the plan pcid %u", __func__,
+            patch->schema->pcid, oschema->pcid);
+    return NULL;
+  }
+
+  /* Relabeled columns can stay encoded */
+  if (!plan->rescale && patch->type == PC_DIMENSIONAL)
+    return pc_transform_dimensional(plan, (const PCPATCH_DIMENSIONAL *)patch);
+
+  pain = pc_patch_uncompress(patch);
+  paout = pc_patch_uncompressed_make(nschema, patch->npoints);
+  paout->npoints = pain->npoints;
+  odata = ((PCPATCH_UNCOMPRESSED *)pain)->data;
+
+  for (i = 0; i < plan->nops; i++)
+    nconvert += plan->ops[i].type == PC_TRANSFORM_CONVERT;
+
+  if (plan->nops == 1 && !nconvert && plan->ops[0].size == osize &&
+      plan->ops[0].size == nsize)
+  {
+    /* Same layout, the points are copied at once */
+    if (paout->npoints)
+      memcpy(paout->data, odata, paout->npoints * nsize);
+  }
+  else
+  {
+    if (nconvert < plan->nops)
+    {
+      for (i = 0; i < paout->npoints; i++)
+        pc_transform_point(plan, odata + i * osize, paout->data + i * nsize);
+    }
+    for (i = 0; i < plan->nops; i++)
+    {
+      if (plan->ops[i].type == PC_TRANSFORM_CONVERT)
+        pc_transform_convert(plan->ops + i, odata, osize, paout->data, nsize,
+                             paout->npoints);
+    }
+  }
+
+  if (pain != patch)
+    pc_patch_free(pain);
+
+  if (plan->rescale)
+  {
+    if (PC_FAILURE == pc_patch_uncompressed_compute_extent(paout))
+    {
+      pcerror("%s: failed to compute patch extent", __func__);
+      pc_patch_free((PCPATCH *)paout);
+      return NULL;
+    }
+
+    if (PC_FAILURE == pc_patch_uncompressed_compute_stats(paout))
+    {
+      pcerror("%s: failed to compute patch stats", __func__);
+      pc_patch_free((PCPATCH *)paout);
+      return NULL;
+    }
+  }
+  else
+  {
+    pc_transform_relabel_stats(plan, patch, (PCPATCH *)paout);
+  }
+
+  return (PCPATCH *)paout;
+}
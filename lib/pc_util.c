@@ -11,6 +11,8 @@
 
 #include "pc_api_internal.h"
 #include <float.h>
+#include <math.h>
+#include <stdio.h>
 
 /**********************************************************************************
  * WKB AND ENDIANESS UTILITIES
@@ -40,11 +42,28 @@ static uint8_t hex2char[256] = {
     20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
     20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20};
 
+/* How many bytes are decoded between two checks of the hex characters */
+#define PC_HEX_BLOCK 256
+
+/* Report the first invalid character of a hex string */
+static void pc_hexbytes_invalid(const char *hexbuf, size_t hexsize)
+{
+  size_t i;
+  for (i = 0; i < hexsize; i++)
+  {
+    if (hex2char[(uint8_t)hexbuf[i]] > 15)
+    {
+      pcerror("Invalid hex character (%c) encountered", hexbuf[i]);
+      return;
+    }
+  }
+}
+
 uint8_t *pc_bytes_from_hexbytes(const char *hexbuf, size_t hexsize)
 {
+  const uint8_t *hex = (const uint8_t *)hexbuf;
   uint8_t *buf = NULL;
-  register uint8_t h1, h2;
-  int i;
+  size_t first, i, n;
 
   if (hexsize % 2)
     pcerror("Invalid hex string, length (%d) has to be a multiple of two!",
@@ -55,37 +74,159 @@ uint8_t *pc_bytes_from_hexbytes(const char *hexbuf, size_t hexsize)
   if (!buf)
     pcerror("Unable to allocate memory buffer.");
 
-  for (i = 0; i < hexsize / 2; i++)
+  /*
+   * Decode a block without branching on every character: invalid characters
+   * map to 20, so their 0x10 bit ends up in the block mask, checked once.
+   */
+  for (first = 0; first < hexsize / 2; first += PC_HEX_BLOCK)
   {
-    h1 = hex2char[(int)hexbuf[2 * i]];
-    h2 = hex2char[(int)hexbuf[2 * i + 1]];
-    if (h1 > 15)
-      pcerror("Invalid hex character (%c) encountered", hexbuf[2 * i]);
-    if (h2 > 15)
-      pcerror("Invalid hex character (%c) encountered", hexbuf[2 * i + 1]);
-    /* First character is high bits, second is low bits */
-    buf[i] = ((h1 & 0x0F) << 4) | (h2 & 0x0F);
+    uint8_t invalid = 0;
+    n = hexsize / 2 - first;
+    if (n > PC_HEX_BLOCK)
+      n = PC_HEX_BLOCK;
+
+    for (i = first; i < first + n; i++)
+    {
+      /* First character is high bits, second is low bits */
+      uint8_t h1 = hex2char[hex[2 * i]];
+      uint8_t h2 = hex2char[hex[2 * i + 1]];
+      invalid |= h1 | h2;
+      buf[i] = (h1 << 4) | (h2 & 0x0F);
+    }
+
+    if (invalid & 0x10)
+      pc_hexbytes_invalid(hexbuf + 2 * first, 2 * n);
   }
   return buf;
 }
 
-static char *hexchr = "0123456789ABCDEF";
+/* The two hex characters of every byte value */
+static const char hexpairs[] =
+    "000102030405060708090A0B0C0D0E0F101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAFB0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECFD0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEFF0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
 
 char *pc_hexbytes_from_bytes(const uint8_t *bytebuf, size_t bytesize)
 {
   char *buf =
       pcalloc(2 * bytesize + 1); /* 2 chars per byte + null terminator */
-  int i;
+  size_t i;
   buf[2 * bytesize] = '\0';
   for (i = 0; i < bytesize; i++)
+    memcpy(buf + 2 * i, hexpairs + 2 * bytebuf[i], 2);
+
+  return buf;
+}
+
+/**********************************************************************************
+ * NUMBER FORMATTING
+ */
+
+static const double pow10_table[] = {1e0, 1e1, 1e2, 1e3, 1e4,
+                                     1e5, 1e6, 1e7, 1e8, 1e9};
+
+/* Write the decimal digits of a positive integer, return their count */
+static size_t pc_uint_to_string(char *buf, uint32_t v)
+{
+  char tmp[10];
+  size_t n = 0, i;
+  do
   {
-    /* Top four bits to 0-F */
-    buf[2 * i] = hexchr[bytebuf[i] >> 4];
-    /* Bottom four bits to 0-F */
-    buf[2 * i + 1] = hexchr[bytebuf[i] & 0x0F];
+    tmp[n++] = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  for (i = 0; i < n; i++)
+    buf[i] = tmp[n - 1 - i];
+  return n;
+}
+
+/*
+ * Most values of a patch are integers or have few significant digits:
+ * format those directly, and leave the others (exponents, values close to
+ * a rounding tie, nan, inf) to snprintf so the output never changes.
+ */
+size_t pc_double_to_string(char *buf, double d)
+{
+  size_t len = 0;
+  double a, m, r;
+  uint32_t v;
+  int e, i;
+  char digits[6];
+
+  if (d > -1e6 && d < 1e6 && d == (double)(int32_t)d && !(d == 0 && signbit(d)))
+  {
+    if (d < 0)
+      buf[len++] = '-';
+    len += pc_uint_to_string(buf + len, (uint32_t)fabs(d));
+    buf[len] = '\0';
+    return len;
   }
 
-  return buf;
+  /* %g uses a fixed notation for exponents from -4 to 5 */
+  a = fabs(d);
+  if (!(a >= 1e-4 && a < 1e6))
+    return snprintf(buf, PC_DOUBLE_STRING_SIZE, "%g", d);
+
+  /* Scale to six significant digits, in [1e5, 1e6) */
+  e = (int)floor(log10(a));
+  if (e < -4)
+    e = -4;
+  m = a * pow10_table[5 - e];
+  if (m >= 1e6 && e < 5)
+    m = a * pow10_table[5 - ++e];
+  else if (m < 1e5 && e > -4)
+    m = a * pow10_table[5 - --e];
+  if (m < 1e5 || m >= 1e6 || fabs(m - floor(m) - 0.5) < 1e-6)
+    return snprintf(buf, PC_DOUBLE_STRING_SIZE, "%g", d);
+
+  r = floor(m + 0.5);
+  if (r >= 1e6)
+  {
+    /* Rounded up to the next power of ten */
+    r = 1e5;
+    if (++e > 5)
+      return snprintf(buf, PC_DOUBLE_STRING_SIZE, "%g", d);
+  }
+
+  v = (uint32_t)r;
+  for (i = 5; i >= 0; i--)
+  {
+    digits[i] = '0' + v % 10;
+    v /= 10;
+  }
+
+  if (d < 0)
+    buf[len++] = '-';
+  if (e < 0)
+  {
+    buf[len++] = '0';
+    buf[len++] = '.';
+    for (i = -1; i > e; i--)
+      buf[len++] = '0';
+    for (i = 0; i < 6; i++)
+      buf[len++] = digits[i];
+  }
+  else
+  {
+    for (i = 0; i <= e; i++)
+      buf[len++] = digits[i];
+    buf[len++] = '.';
+    for (i = e + 1; i < 6; i++)
+      buf[len++] = digits[i];
+  }
+
+  /* Trailing zeros go, and the point with them */
+  while (buf[len - 1] == '0')
+    len--;
+  if (buf[len - 1] == '.')
+    len--;
+  buf[len] = '\0';
+  return len;
 }
 
 /* 0 = xdr | big endian    */
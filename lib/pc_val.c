@@ -39,187 +39,302 @@ double pc_value_scale_offset(double val, const PCDIMENSION *dim)
   return val;
 }
 
+#define CLAMP(v, min, max, t, format)                                          \
+  do                                                                           \
+  {                                                                            \
+    if (v > max)                                                               \
+    {                                                                          \
+      pcwarn("Value %g truncated to " format " to fit in " t, v, max);         \
+      v = max;                                                                 \
+    }                                                                          \
+    else if (v < min)                                                          \
+    {                                                                          \
+      pcwarn("Value %g truncated to " format " to fit in " t, v, min);         \
+      v = min;                                                                 \
+    }                                                                          \
+  } while (0)
+
+/*
+ * Typed readers and writers, one set per interpretation. They are resolved
+ * once per dimension by pc_dimension_set_accessors, so that the loops over
+ * the points do not switch on the interpretation for every value.
+ */
+
+#define PC_READERS(name, type)                                                 \
+  static double pc_##name##_read(const uint8_t *ptr)                           \
+  {                                                                            \
+    type v;                                                                    \
+    memcpy(&(v), ptr, sizeof(type));                                           \
+    return (double)v;                                                          \
+  }                                                                            \
+  static void pc_##name##_read_array(double *vals, const uint8_t *ptr,         \
+                                     size_t stride, uint32_t n)                \
+  {                                                                            \
+    type v;                                                                    \
+    uint32_t i;                                                                \
+    for (i = 0; i < n; i++, ptr += stride)                                     \
+    {                                                                          \
+      memcpy(&(v), ptr, sizeof(type));                                         \
+      vals[i] = (double)v;                                                     \
+    }                                                                          \
+  }
+
+#define PC_INTEGER_WRITERS(name, type, min, max, t, format)                    \
+  static void pc_##name##_write(uint8_t *ptr, double val)                      \
+  {                                                                            \
+    type v;                                                                    \
+    CLAMP(val, min, max, t, format);                                           \
+    v = (type)lround(val);                                                     \
+    memcpy(ptr, &(v), sizeof(type));                                           \
+  }                                                                            \
+  static void pc_##name##_write_array(uint8_t *ptr, size_t stride,             \
+                                      const double *vals, uint32_t n)          \
+  {                                                                            \
+    uint32_t i;                                                                \
+    for (i = 0; i < n; i++, ptr += stride)                                     \
+      pc_##name##_write(ptr, vals[i]);                                         \
+  }
+
+#define PC_FLOAT_WRITERS(name, type)                                           \
+  static void pc_##name##_write(uint8_t *ptr, double val)                      \
+  {                                                                            \
+    type v = (type)val;                                                        \
+    memcpy(ptr, &(v), sizeof(type));                                           \
+  }                                                                            \
+  static void pc_##name##_write_array(uint8_t *ptr, size_t stride,             \
+                                      const double *vals, uint32_t n)          \
+  {                                                                            \
+    uint32_t i;                                                                \
+    for (i = 0; i < n; i++, ptr += stride)                                     \
+      pc_##name##_write(ptr, vals[i]);                                         \
+  }
+
+PC_READERS(uint8, uint8_t)
+PC_READERS(uint16, uint16_t)
+PC_READERS(uint32, uint32_t)
+PC_READERS(uint64, uint64_t)
+PC_READERS(int8, int8_t)
+PC_READERS(int16, int16_t)
+PC_READERS(int32, int32_t)
+PC_READERS(int64, int64_t)
+PC_READERS(float, float)
+PC_READERS(double, double)
+
+PC_INTEGER_WRITERS(uint8, uint8_t, 0, UINT8_MAX, "uint8_t", "%u")
+PC_INTEGER_WRITERS(uint16, uint16_t, 0, UINT16_MAX, "uint16_t", "%u")
+PC_INTEGER_WRITERS(uint32, uint32_t, 0, UINT32_MAX, "uint32", "%u")
+PC_INTEGER_WRITERS(uint64, uint64_t, 0, UINT64_MAX, "uint64", "%u")
+PC_INTEGER_WRITERS(int8, int8_t, INT8_MIN, INT8_MAX, "int8", "%d")
+PC_INTEGER_WRITERS(int16, int16_t, INT16_MIN, INT16_MAX, "int16", "%d")
+PC_INTEGER_WRITERS(int32, int32_t, INT32_MIN, INT32_MAX, "int32", "%d")
+PC_INTEGER_WRITERS(int64, int64_t, INT64_MIN, INT64_MAX, "int64", "%d")
+PC_FLOAT_WRITERS(float, float)
+PC_FLOAT_WRITERS(double, double)
+
+/* Dimensions of unknown interpretation fail at their first access */
+static double pc_unknown_read(const uint8_t *ptr)
+{
+  pcerror("unknown interpretation type encountered in %s", __func__);
+  return 0.0;
+}
+
+static void pc_unknown_read_array(double *vals, const uint8_t *ptr,
+                                  size_t stride, uint32_t n)
+{
+  pcerror("unknown interpretation type encountered in %s", __func__);
+}
+
+static void pc_unknown_write(uint8_t *ptr, double val)
+{
+  pcerror("unknown interpretation type encountered in %s", __func__);
+}
+
+static void pc_unknown_write_array(uint8_t *ptr, size_t stride,
+                                   const double *vals, uint32_t n)
+{
+  pcerror("unknown interpretation type encountered in %s", __func__);
+}
+
+typedef struct
+{
+  PCDOUBLEREADER read;
+  PCDOUBLEWRITER write;
+  PCDOUBLEARRAYREADER read_array;
+  PCDOUBLEARRAYWRITER write_array;
+} PCACCESSORS;
+
+#define PC_ACCESSORS_OF(name)                                                  \
+  {                                                                            \
+    pc_##name##_read, pc_##name##_write, pc_##name##_read_array,               \
+        pc_##name##_write_array                                                \
+  }
+
+static const PCACCESSORS PC_ACCESSORS[NUM_INTERPRETATIONS] = {
+    [PC_UNKNOWN] = PC_ACCESSORS_OF(unknown),
+    [PC_INT8] = PC_ACCESSORS_OF(int8),
+    [PC_UINT8] = PC_ACCESSORS_OF(uint8),
+    [PC_INT16] = PC_ACCESSORS_OF(int16),
+    [PC_UINT16] = PC_ACCESSORS_OF(uint16),
+    [PC_INT32] = PC_ACCESSORS_OF(int32),
+    [PC_UINT32] = PC_ACCESSORS_OF(uint32),
+    [PC_INT64] = PC_ACCESSORS_OF(int64),
+    [PC_UINT64] = PC_ACCESSORS_OF(uint64),
+    [PC_DOUBLE] = PC_ACCESSORS_OF(double),
+    [PC_FLOAT] = PC_ACCESSORS_OF(float)};
+
+static int pc_interpretation_is_known(uint32_t interpretation)
+{
+  return interpretation != PC_UNKNOWN && interpretation < NUM_INTERPRETATIONS;
+}
+
+void pc_dimension_set_accessors(PCDIMENSION *dim)
+{
+  const PCACCESSORS *acc = &PC_ACCESSORS[PC_UNKNOWN];
+
+  if (pc_interpretation_is_known(dim->interpretation))
+    acc = &PC_ACCESSORS[dim->interpretation];
+
+  dim->read = acc->read;
+  dim->write = acc->write;
+  dim->read_array = acc->read_array;
+  dim->write_array = acc->write_array;
+}
+
 double pc_value_from_ptr(const uint8_t *ptr, const PCDIMENSION *dim)
 {
-  double val = pc_double_from_ptr(ptr, dim->interpretation);
-  return pc_value_scale_offset(val, dim);
+  return pc_value_scale_offset(dim->read(ptr), dim);
 }
 
 double pc_double_from_ptr(const uint8_t *ptr, uint32_t interpretation)
 {
-  switch (interpretation)
-  {
-  case PC_UINT8:
-  {
-    uint8_t v;
-    memcpy(&(v), ptr, sizeof(uint8_t));
-    return (double)v;
-  }
-  case PC_UINT16:
-  {
-    uint16_t v;
-    memcpy(&(v), ptr, sizeof(uint16_t));
-    return (double)v;
-  }
-  case PC_UINT32:
-  {
-    uint32_t v;
-    memcpy(&(v), ptr, sizeof(uint32_t));
-    return (double)v;
-  }
-  case PC_UINT64:
-  {
-    uint64_t v;
-    memcpy(&(v), ptr, sizeof(uint64_t));
-    return (double)v;
-  }
-  case PC_INT8:
+  if (!pc_interpretation_is_known(interpretation))
   {
-    int8_t v;
-    memcpy(&(v), ptr, sizeof(int8_t));
-    return (double)v;
-  }
-  case PC_INT16:
-  {
-    int16_t v;
-    memcpy(&(v), ptr, sizeof(int16_t));
-    return (double)v;
-  }
-  case PC_INT32:
-  {
-    int32_t v;
-    memcpy(&(v), ptr, sizeof(int32_t));
-    return (double)v;
+    pcerror("unknown interpretation type %d encountered in pc_double_from_ptr",
+            interpretation);
+    return 0.0;
   }
-  case PC_INT64:
+  return PC_ACCESSORS[interpretation].read(ptr);
+}
+
+int pc_double_to_ptr(uint8_t *ptr, uint32_t interpretation, double val)
+{
+  if (!pc_interpretation_is_known(interpretation))
   {
-    int64_t v;
-    memcpy(&(v), ptr, sizeof(int64_t));
-    return (double)v;
+    pcerror("unknown interpretation type %d encountered in pc_double_to_ptr",
+            interpretation);
+    return PC_FAILURE;
   }
-  case PC_FLOAT:
+  PC_ACCESSORS[interpretation].write(ptr, val);
+  return PC_SUCCESS;
+}
+
+void pc_double_array_to_ptr(uint8_t *ptr, size_t stride, const double *vals,
+                            uint32_t n, uint32_t interpretation)
+{
+  if (!pc_interpretation_is_known(interpretation))
   {
-    float v;
-    memcpy(&(v), ptr, sizeof(float));
-    return (double)v;
+    pcerror("unknown interpretation type %d encountered in %s",
+            interpretation, __func__);
+    return;
   }
-  case PC_DOUBLE:
+  PC_ACCESSORS[interpretation].write_array(ptr, stride, vals, n);
+}
+
+void pc_value_array_to_ptr(uint8_t *ptr, size_t stride, double *vals,
+                           uint32_t n, const PCDIMENSION *dim)
+{
+  double scale = dim->scale;
+  double offset = dim->offset;
+  uint32_t i;
+
+  if (scale != 1 || offset != 0)
   {
-    double v;
-    memcpy(&(v), ptr, sizeof(double));
-    return v;
+    for (i = 0; i < n; i++)
+      vals[i] = (vals[i] - offset) / scale;
   }
-  default:
+  dim->write_array(ptr, stride, vals, n);
+}
+
+void pc_double_array_from_ptr(double *vals, const uint8_t *ptr, size_t stride,
+                              uint32_t n, uint32_t interpretation)
+{
+  if (!pc_interpretation_is_known(interpretation))
   {
-    pcerror("unknown interpretation type %d encountered in pc_double_from_ptr",
-            interpretation);
-  }
+    pcerror("unknown interpretation type %d encountered in %s",
+            interpretation, __func__);
+    return;
   }
-  return 0.0;
+  PC_ACCESSORS[interpretation].read_array(vals, ptr, stride, n);
 }
 
-#define CLAMP(v, min, max, t, format)                                          \
+void pc_value_array_from_ptr(double *vals, const uint8_t *ptr, size_t stride,
+                             uint32_t n, const PCDIMENSION *dim)
+{
+  double scale = dim->scale;
+  double offset = dim->offset;
+  uint32_t i;
+
+  dim->read_array(vals, ptr, stride, n);
+  if (scale == 1 && offset == 0)
+    return;
+  for (i = 0; i < n; i++)
+    vals[i] = vals[i] * scale + offset;
+}
+
+#define PC_INT64_ARRAY_FROM_PTR(type)                                          \
   do                                                                           \
   {                                                                            \
-    if (v > max)                                                               \
-    {                                                                          \
-      pcwarn("Value %g truncated to " format " to fit in " t, v, max);         \
-      v = max;                                                                 \
-    }                                                                          \
-    else if (v < min)                                                          \
+    type v;                                                                    \
+    for (i = 0; i < n; i++, ptr += stride)                                     \
     {                                                                          \
-      pcwarn("Value %g truncated to " format " to fit in " t, v, min);         \
-      v = min;                                                                 \
+      memcpy(&(v), ptr, sizeof(type));                                         \
+      vals[i] = (int64_t)v;                                                    \
     }                                                                          \
   } while (0)
 
-int pc_double_to_ptr(uint8_t *ptr, uint32_t interpretation, double val)
+int pc_int64_array_from_ptr(int64_t *vals, const uint8_t *ptr, size_t stride,
+                            uint32_t n, uint32_t interpretation)
 {
+  uint32_t i;
+
   switch (interpretation)
   {
   case PC_UINT8:
-  {
-    uint8_t v;
-    CLAMP(val, 0, UINT8_MAX, "uint8_t", "%u");
-    v = (uint8_t)lround(val);
-    memcpy(ptr, &(v), sizeof(uint8_t));
+    PC_INT64_ARRAY_FROM_PTR(uint8_t);
     break;
-  }
   case PC_UINT16:
-  {
-    uint16_t v;
-    CLAMP(val, 0, UINT16_MAX, "uint16_t", "%u");
-    v = (uint16_t)lround(val);
-    memcpy(ptr, &(v), sizeof(uint16_t));
+    PC_INT64_ARRAY_FROM_PTR(uint16_t);
     break;
-  }
   case PC_UINT32:
-  {
-    uint32_t v;
-    CLAMP(val, 0, UINT32_MAX, "uint32", "%u");
-    v = (uint32_t)lround(val);
-    memcpy(ptr, &(v), sizeof(uint32_t));
+    PC_INT64_ARRAY_FROM_PTR(uint32_t);
     break;
-  }
   case PC_UINT64:
-  {
-    uint64_t v;
-    CLAMP(val, 0, UINT64_MAX, "uint64", "%u");
-    v = (uint64_t)lround(val);
-    memcpy(ptr, &(v), sizeof(uint64_t));
+    PC_INT64_ARRAY_FROM_PTR(uint64_t);
+    for (i = 0; i < n; i++)
+    {
+      if (vals[i] < 0)
+      {
+        pcerror("%s: uint64 value does not fit in an int64", __func__);
+        return PC_FAILURE;
+      }
+    }
     break;
-  }
   case PC_INT8:
-  {
-    int8_t v;
-    CLAMP(val, INT8_MIN, INT8_MAX, "int8", "%d");
-    v = (int8_t)lround(val);
-    memcpy(ptr, &(v), sizeof(int8_t));
+    PC_INT64_ARRAY_FROM_PTR(int8_t);
     break;
-  }
   case PC_INT16:
-  {
-    int16_t v;
-    CLAMP(val, INT16_MIN, INT16_MAX, "int16", "%d");
-    v = (int16_t)lround(val);
-    memcpy(ptr, &(v), sizeof(int16_t));
+    PC_INT64_ARRAY_FROM_PTR(int16_t);
     break;
-  }
   case PC_INT32:
-  {
-    int32_t v;
-    CLAMP(val, INT32_MIN, INT32_MAX, "int32", "%d");
-    v = (int32_t)lround(val);
-    memcpy(ptr, &(v), sizeof(int32_t));
+    PC_INT64_ARRAY_FROM_PTR(int32_t);
     break;
-  }
   case PC_INT64:
-  {
-    int64_t v;
-    CLAMP(val, INT64_MIN, INT64_MAX, "int64", "%d");
-    v = (int64_t)lround(val);
-    memcpy(ptr, &(v), sizeof(int64_t));
-    break;
-  }
-  case PC_FLOAT:
-  {
-    float v = (float)val;
-    memcpy(ptr, &(v), sizeof(float));
+    PC_INT64_ARRAY_FROM_PTR(int64_t);
     break;
-  }
-  case PC_DOUBLE:
-  {
-    double v = val;
-    memcpy(ptr, &(v), sizeof(double));
-    break;
-  }
   default:
-  {
-    pcerror("unknown interpretation type %d encountered in pc_double_to_ptr",
-            interpretation);
+    pcerror("%s: interpretation %s does not hold integers", __func__,
+            pc_interpretation_string(interpretation));
     return PC_FAILURE;
   }
-  }
-
   return PC_SUCCESS;
 }
@@ -12,17 +12,20 @@
 #include "pc_pgsql.h" /* Common PgSQL support for our type */
 #include "utils/numeric.h"
 
+#include "executor/spi.h"
 #include "funcapi.h"
 #include "lib/stringinfo.h"
+#include "miscadmin.h" /* for work_mem */
+#include "utils/memutils.h"
 #include "pc_api_internal.h" /* for pcpatch_summary */
 
-/* cstring array utility functions */
-const char **array_to_cstring_array(ArrayType *array, int *size);
-void pc_cstring_array_free(const char **array, int nelems);
-
 /* General SQL functions */
 Datum pcpoint_get_value(PG_FUNCTION_ARGS);
 Datum pcpoint_get_values(PG_FUNCTION_ARGS);
+Datum pcpatch_get_values(PG_FUNCTION_ARGS);
+Datum pcpatch_get_values_array(PG_FUNCTION_ARGS);
+Datum pcpatch_get_raw_values(PG_FUNCTION_ARGS);
+Datum pcpatch_get_raw_values_array(PG_FUNCTION_ARGS);
 Datum pcpatch_from_pcpoint_array(PG_FUNCTION_ARGS);
 Datum pcpatch_from_float_array(PG_FUNCTION_ARGS);
 Datum pcpatch_from_pcpatch_array(PG_FUNCTION_ARGS);
@@ -37,8 +40,12 @@ Datum pcpatch_compression(PG_FUNCTION_ARGS);
 Datum pcpatch_intersects(PG_FUNCTION_ARGS);
 Datum pcpatch_get_stat(PG_FUNCTION_ARGS);
 Datum pcpatch_filter(PG_FUNCTION_ARGS);
+Datum pcpatch_voxel_filter(PG_FUNCTION_ARGS);
 Datum pcpatch_sort(PG_FUNCTION_ARGS);
+Datum pcpatch_sort_spatial(PG_FUNCTION_ARGS);
+Datum pcpatch_lod(PG_FUNCTION_ARGS);
 Datum pcpatch_is_sorted(PG_FUNCTION_ARGS);
+Datum pcpatch_grid(PG_FUNCTION_ARGS);
 Datum pcpatch_size(PG_FUNCTION_ARGS);
 Datum pcpoint_size(PG_FUNCTION_ARGS);
 Datum pcpoint_pcid(PG_FUNCTION_ARGS);
@@ -60,8 +67,22 @@ Datum pcpoint_agg_final_array(PG_FUNCTION_ARGS);
 Datum pcpatch_agg_final_array(PG_FUNCTION_ARGS);
 Datum pcpatch_agg_final_pcpatch(PG_FUNCTION_ARGS);
 
+/* Gridding aggregation functions */
+Datum pcpatch_gridagg_transfn(PG_FUNCTION_ARGS);
+Datum pcpatch_gridagg_final(PG_FUNCTION_ARGS);
+Datum pcpatch_retile(PG_FUNCTION_ARGS);
+Datum pcpatch_voxelagg_transfn(PG_FUNCTION_ARGS);
+Datum pcpatch_voxelagg_final(PG_FUNCTION_ARGS);
+
+/* Arrow export functions */
+Datum pcpatch_as_arrow(PG_FUNCTION_ARGS);
+Datum pcpatch_arrowagg_transfn(PG_FUNCTION_ARGS);
+Datum pcpatch_arrowagg_final(PG_FUNCTION_ARGS);
+
 /* Deaggregation functions */
 Datum pcpatch_unnest(PG_FUNCTION_ARGS);
+Datum pcpatch_split(PG_FUNCTION_ARGS);
+Datum pcpatch_explode_columns(PG_FUNCTION_ARGS);
 
 /**
  * Read a named dimension from a PCPOINT
@@ -126,6 +147,156 @@ Datum pcpoint_get_values(PG_FUNCTION_ARGS)
   PG_RETURN_ARRAYTYPE_P(result);
 }
 
+/*
+ * A float8[] or int8[] of the given dimensions, with its values left to be
+ * written in place, rather than going through an array of Datums.
+ */
+static ArrayType *pc_array_make(int ndim, int *dims, Oid elemtype)
+{
+  int lbs[2] = {1, 1};
+  int nitems = ArrayGetNItems(ndim, dims);
+  Size nbytes;
+  ArrayType *result;
+
+  if (!nitems)
+    return construct_empty_array(elemtype);
+
+  /* float8 and int8 are both 8 bytes and 8-aligned */
+  nbytes = ARR_OVERHEAD_NONULLS(ndim) + (Size)nitems * sizeof(int64);
+  if (!AllocSizeIsValid(nbytes))
+    elog(ERROR, "too many values for an array");
+
+  result = (ArrayType *)palloc0(nbytes);
+  SET_VARSIZE(result, nbytes);
+  result->ndim = ndim;
+  result->dataoffset = 0;
+  result->elemtype = elemtype;
+  memcpy(ARR_DIMS(result), dims, ndim * sizeof(int));
+  memcpy(ARR_LBOUND(result), lbs, ndim * sizeof(int));
+  return result;
+}
+
+/* Dimensions of the schema named in a text[], in the array order */
+static const PCDIMENSION **pc_dimensions_from_array(const PCSCHEMA *schema,
+                                                    ArrayType *array,
+                                                    int *ndims)
+{
+  const char **names;
+  const PCDIMENSION **dims;
+  int i;
+
+  if (ARR_HASNULL(array))
+    elog(ERROR, "dimension names must not be null");
+
+  names = array_to_cstring_array(array, ndims);
+  dims = palloc(Max(*ndims, 1) * sizeof(PCDIMENSION *));
+  for (i = 0; i < *ndims; i++)
+  {
+    dims[i] = pc_schema_get_dimension_by_name(schema, names[i]);
+    if (!dims[i])
+      elog(ERROR, "dimension \"%s\" does not exist in schema", names[i]);
+  }
+  pc_cstring_array_free(names, *ndims);
+  return dims;
+}
+
+/*
+ * Columns of the named dimensions of a patch, as a float8[] for one name or
+ * a float8[][] with a row per name, scaled or as their raw int8 values.
+ */
+static ArrayType *pc_patch_get_array(FunctionCallInfo fcinfo, bool many,
+                                     bool raw)
+{
+  bool directory;
+  const PCSCHEMA *schema = pc_patch_getarg_schema(fcinfo, 0, &directory);
+  const PCDIMENSION **dims;
+  PCPATCH *patch;
+  ArrayType *result;
+  int arrdims[2];
+  int ndims, rv;
+
+  /* Look the names up before reading anything else */
+  if (many)
+  {
+    dims = pc_dimensions_from_array(schema, PG_GETARG_ARRAYTYPE_P(1), &ndims);
+  }
+  else
+  {
+    char *name = text_to_cstring(PG_GETARG_TEXT_P(1));
+    ndims = 1;
+    dims = palloc(sizeof(PCDIMENSION *));
+    dims[0] = pc_schema_get_dimension_by_name(schema, name);
+    if (!dims[0])
+      elog(ERROR, "dimension \"%s\" does not exist in schema", name);
+    pfree(name);
+  }
+
+  patch = pc_patch_getarg_dims(fcinfo, 0, schema, directory, dims, ndims);
+
+  arrdims[0] = ndims;
+  arrdims[1] = patch->npoints;
+  if (many)
+    result = pc_array_make(2, arrdims, raw ? INT8OID : FLOAT8OID);
+  else
+    result = pc_array_make(1, arrdims + 1, raw ? INT8OID : FLOAT8OID);
+
+  if (ARR_NDIM(result))
+  {
+    if (raw)
+      rv = pc_patch_get_raw_columns(patch, dims, ndims,
+                                    (int64_t *)ARR_DATA_PTR(result));
+    else
+      rv = pc_patch_get_columns(patch, dims, ndims,
+                                (double *)ARR_DATA_PTR(result));
+    if (rv != PC_SUCCESS)
+      elog(ERROR, "failed to read the patch values");
+  }
+
+  pc_patch_freearg(fcinfo, 0, patch);
+  pfree(dims);
+  return result;
+}
+
+/**
+ * Returns the values of a dimension of a patch
+ * PC_Get(patch pcpatch, dimname text) returns Float8[]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_get_values);
+Datum pcpatch_get_values(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_ARRAYTYPE_P(pc_patch_get_array(fcinfo, false, false));
+}
+
+/**
+ * Returns the values of dimensions of a patch, one row per dimension
+ * PC_Get(patch pcpatch, dimnames text[]) returns Float8[][]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_get_values_array);
+Datum pcpatch_get_values_array(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_ARRAYTYPE_P(pc_patch_get_array(fcinfo, true, false));
+}
+
+/**
+ * Returns the stored values of an integer dimension of a patch
+ * PC_GetRaw(patch pcpatch, dimname text) returns Int8[]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_get_raw_values);
+Datum pcpatch_get_raw_values(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_ARRAYTYPE_P(pc_patch_get_array(fcinfo, false, true));
+}
+
+/**
+ * Returns the stored values of integer dimensions of a patch
+ * PC_GetRaw(patch pcpatch, dimnames text[]) returns Int8[][]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_get_raw_values_array);
+Datum pcpatch_get_raw_values_array(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_ARRAYTYPE_P(pc_patch_get_array(fcinfo, true, true));
+}
+
 static inline bool array_get_isnull(const uint8 *nullbitmap, int offset)
 {
   if (nullbitmap == NULL)
@@ -544,6 +715,352 @@ Datum pcpatch_agg_final_pcpatch(PG_FUNCTION_ARGS)
   PG_RETURN_POINTER(serpa);
 }
 
+/* Number of input patches fetched at once by PC_Retile */
+#define PC_RETILE_FETCH 64
+
+/* Append the tiles flushed by the retiling to the result */
+static void pc_retile_store(PCRETILE *rt, Tuplestorestate *tupstore,
+                            TupleDesc tupdesc)
+{
+  Datum values[2];
+  bool nulls[2] = {false, false};
+  PCPATCH *pa;
+  int64_t key;
+
+  while ((pa = pc_retile_pop(rt, &key)))
+  {
+    SERIALIZED_PATCH *serpa = pc_patch_serialize(pa, NULL);
+    pc_patch_free(pa);
+    values[0] = Int64GetDatum(key);
+    values[1] = PointerGetDatum(serpa);
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+    pfree(serpa);
+  }
+}
+
+/**
+ * PC_Retile(patches text, tilesize float8, maxpoints int4)
+ * returns setof (tile_key int8, pa pcpatch)
+ *
+ * The patches query is read through a cursor. The flushed tiles go to a
+ * tuplestore, which spills to temporary files past work_mem, so only the
+ * tiles still being filled are held in memory.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_retile);
+Datum pcpatch_retile(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  char *query = text_to_cstring(PG_GETARG_TEXT_P(0));
+  float8 tilesize = PG_GETARG_FLOAT8(1);
+  int32 maxpoints = PG_GETARG_INT32(2);
+  TupleDesc tupdesc;
+  Tuplestorestate *tupstore;
+  MemoryContext oldcontext, retilecontext, batchcontext;
+  SPIPlanPtr plan;
+  Portal portal;
+  PCRETILE *rt = NULL;
+  Oid patchtype;
+  uint64 i;
+
+  if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+      !(rsinfo->allowedModes & SFRM_Materialize))
+    elog(ERROR, "set-valued function called in context that cannot accept a "
+                "set");
+
+  if (maxpoints <= 0)
+    elog(ERROR, "maximum number of points must be positive");
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+  patchtype = TupleDescAttr(tupdesc, 1)->atttypid;
+
+  /* The tuplestore and its descriptor are read after we return */
+  oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  tupdesc = CreateTupleDescCopy(tupdesc);
+  tupstore = tuplestore_begin_heap(
+      rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+  MemoryContextSwitchTo(oldcontext);
+
+  /* The open tiles live until the end, the input patches for one batch */
+  retilecontext = AllocSetContextCreate(
+      CurrentMemoryContext, "Pointcloud Retile", ALLOCSET_DEFAULT_SIZES);
+  batchcontext = AllocSetContextCreate(
+      CurrentMemoryContext, "Pointcloud Retile Batch", ALLOCSET_DEFAULT_SIZES);
+
+  if (SPI_OK_CONNECT != SPI_connect())
+    elog(ERROR, "%s: could not connect to SPI manager", __func__);
+
+  plan = SPI_prepare(query, 0, NULL);
+  if (!plan)
+    elog(ERROR, "%s: could not prepare the patches query: %s", __func__,
+         SPI_result_code_string(SPI_result));
+  portal = SPI_cursor_open(NULL, plan, NULL, NULL, true);
+
+  for (;;)
+  {
+    SPI_cursor_fetch(portal, true, PC_RETILE_FETCH);
+    if (!SPI_processed)
+      break;
+
+    if (SPI_tuptable->tupdesc->natts != 1 ||
+        SPI_gettypeid(SPI_tuptable->tupdesc, 1) != patchtype)
+      elog(ERROR, "the patches query must return a single pcpatch column");
+
+    oldcontext = MemoryContextSwitchTo(batchcontext);
+    for (i = 0; i < SPI_processed; i++)
+    {
+      SERIALIZED_PATCH *serpatch;
+      PCSCHEMA *schema;
+      PCPATCH *patch;
+      bool isnull;
+      Datum d = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1,
+                              &isnull);
+
+      if (isnull)
+        continue;
+
+      serpatch = (SERIALIZED_PATCH *)PG_DETOAST_DATUM(d);
+      schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+      patch = pc_patch_deserialize(serpatch, schema);
+      if (!patch)
+        elog(ERROR, "failed to deserialize patch");
+
+      MemoryContextSwitchTo(retilecontext);
+      if (!rt)
+        rt = pc_retile_make(schema, tilesize, maxpoints);
+      pc_retile_add_patch(rt, patch);
+      MemoryContextSwitchTo(batchcontext);
+
+      pc_retile_store(rt, tupstore, tupdesc);
+    }
+    MemoryContextSwitchTo(oldcontext);
+    MemoryContextReset(batchcontext);
+    SPI_freetuptable(SPI_tuptable);
+  }
+
+  /* the tiles that are not full are flushed at the end of the input */
+  if (rt)
+  {
+    oldcontext = MemoryContextSwitchTo(retilecontext);
+    pc_retile_flush(rt);
+    MemoryContextSwitchTo(oldcontext);
+    pc_retile_store(rt, tupstore, tupdesc);
+  }
+
+  SPI_cursor_close(portal);
+  SPI_finish();
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+  rsinfo->setDesc = tupdesc;
+
+  MemoryContextDelete(batchcontext);
+  MemoryContextDelete(retilecontext);
+  return (Datum)0;
+}
+
+/* Same size as abs_trans, see pointcloud_abs */
+typedef struct
+{
+  PCPATCH *patch;
+} voxelagg_trans;
+
+/**
+ * PC_VoxelFilterAgg(patch pcpatch, voxelsize float8) returns pcpatch
+ * Keeps the first point of every voxel of the aggregated patches. Each
+ * patch is merged into the points kept so far and filtered again, so the
+ * state never holds more than one point per voxel plus the current patch.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_voxelagg_transfn);
+Datum pcpatch_voxelagg_transfn(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcontext;
+  voxelagg_trans *v;
+  PCPATCH *patch, *merged;
+  PCPATCH *palist[2];
+  float8 voxelsize;
+
+  if (!AggCheckCallContext(fcinfo, &aggcontext))
+  {
+    elog(ERROR, "pcpatch_voxelagg_transfn called in non-aggregate context");
+    aggcontext = NULL; /* keep compiler quiet */
+  }
+
+  if (PG_ARGISNULL(0))
+  {
+    v = (voxelagg_trans *)MemoryContextAlloc(aggcontext,
+                                             sizeof(voxelagg_trans));
+    v->patch = NULL;
+  }
+  else
+  {
+    v = (voxelagg_trans *)PG_GETARG_POINTER(0);
+  }
+
+  if (PG_ARGISNULL(1))
+    PG_RETURN_POINTER(v);
+
+  if (PG_ARGISNULL(2))
+    elog(ERROR, "voxel size must not be null");
+  voxelsize = PG_GETARG_FLOAT8(2);
+
+  /* the points kept live as long as the aggregate */
+  patch = pc_patch_getarg(fcinfo, 1);
+  oldcontext = MemoryContextSwitchTo(aggcontext);
+  palist[1] = pc_patch_voxel_filter(patch, voxelsize, PC_VOXEL_FIRST);
+  MemoryContextSwitchTo(oldcontext);
+  pc_patch_freearg(fcinfo, 1, patch);
+  if (!palist[1])
+    elog(ERROR, "failed to filter patch");
+
+  if (!v->patch)
+  {
+    v->patch = palist[1];
+    PG_RETURN_POINTER(v);
+  }
+
+  palist[0] = v->patch;
+  oldcontext = MemoryContextSwitchTo(aggcontext);
+  merged = pc_patch_from_patchlist(palist, 2);
+  pc_patch_free(palist[1]);
+  if (merged)
+  {
+    pc_patch_free(v->patch);
+    v->patch = pc_patch_voxel_filter(merged, voxelsize, PC_VOXEL_FIRST);
+    pc_patch_free(merged);
+  }
+  MemoryContextSwitchTo(oldcontext);
+
+  if (!merged || !v->patch)
+    elog(ERROR, "failed to filter patch");
+
+  PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_voxelagg_final);
+Datum pcpatch_voxelagg_final(PG_FUNCTION_ARGS)
+{
+  voxelagg_trans *v;
+
+  if (PG_ARGISNULL(0))
+    PG_RETURN_NULL(); /* returns null iff no input values */
+
+  v = (voxelagg_trans *)PG_GETARG_POINTER(0);
+
+  /* Always treat zero-point patches as SQL NULL */
+  if (!v->patch || v->patch->npoints <= 0)
+    PG_RETURN_NULL();
+
+  PG_RETURN_POINTER(pc_patch_serialize(v->patch, NULL));
+}
+
+/* Copy an Arrow stream into a bytea */
+static bytea *pc_arrow_to_bytea(const PCARROW *arrow)
+{
+  size_t size = pc_arrow_stream_size(arrow);
+  bytea *result = palloc(VARHDRSZ + size);
+  pc_arrow_stream_copy(arrow, (uint8 *)VARDATA(result));
+  SET_VARSIZE(result, VARHDRSZ + size);
+  return result;
+}
+
+/**
+ * PC_AsArrow(patch pcpatch, scaled boolean default false) returns bytea
+ */
+PG_FUNCTION_INFO_V1(pcpatch_as_arrow);
+Datum pcpatch_as_arrow(PG_FUNCTION_ARGS)
+{
+  PCPATCH *patch = pc_patch_getarg(fcinfo, 0);
+  bool scaled = PG_NARGS() > 1 && PG_GETARG_BOOL(1);
+  PCARROW *arrow;
+  bytea *result;
+
+  arrow = pc_arrow_make(patch->schema, scaled);
+  pc_arrow_add_patch(arrow, patch);
+  pc_patch_freearg(fcinfo, 0, patch);
+
+  result = pc_arrow_to_bytea(arrow);
+  pc_arrow_free(arrow);
+  PG_RETURN_BYTEA_P(result);
+}
+
+/* Same size as abs_trans, see pointcloud_abs */
+typedef struct
+{
+  PCARROW *arrow;
+} arrow_trans;
+
+/**
+ * PC_AsArrowAgg(patch pcpatch [, scaled boolean]) returns bytea
+ */
+PG_FUNCTION_INFO_V1(pcpatch_arrowagg_transfn);
+Datum pcpatch_arrowagg_transfn(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcontext;
+  arrow_trans *a;
+  SERIALIZED_PATCH *serpatch;
+  PCSCHEMA *schema;
+  PCPATCH *patch;
+
+  if (!AggCheckCallContext(fcinfo, &aggcontext))
+  {
+    elog(ERROR, "pcpatch_arrowagg_transfn called in non-aggregate context");
+    aggcontext = NULL; /* keep compiler quiet */
+  }
+
+  if (PG_ARGISNULL(0))
+  {
+    a = (arrow_trans *)MemoryContextAlloc(aggcontext, sizeof(arrow_trans));
+    a->arrow = NULL;
+  }
+  else
+  {
+    a = (arrow_trans *)PG_GETARG_POINTER(0);
+  }
+
+  if (PG_ARGISNULL(1))
+    PG_RETURN_POINTER(a);
+
+  serpatch = PG_GETARG_SERPATCH_P(1);
+  if (a->arrow && a->arrow->schema->pcid != serpatch->pcid)
+    elog(ERROR, "patches of pcid %u and %u cannot be in the same stream",
+         a->arrow->schema->pcid, serpatch->pcid);
+
+  schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  patch = pc_patch_deserialize(serpatch, schema);
+  if (!patch)
+    elog(ERROR, "failed to deserialize patch");
+
+  /* the stream lives as long as the aggregate */
+  oldcontext = MemoryContextSwitchTo(aggcontext);
+  if (!a->arrow)
+  {
+    bool scaled = PG_NARGS() > 2 && !PG_ARGISNULL(2) && PG_GETARG_BOOL(2);
+    a->arrow = pc_arrow_make(schema, scaled);
+  }
+  pc_arrow_add_patch(a->arrow, patch);
+  MemoryContextSwitchTo(oldcontext);
+
+  pc_patch_free(patch);
+  PG_FREE_IF_COPY(serpatch, 1);
+  PG_RETURN_POINTER(a);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_arrowagg_final);
+Datum pcpatch_arrowagg_final(PG_FUNCTION_ARGS)
+{
+  arrow_trans *a;
+
+  if (PG_ARGISNULL(0))
+    PG_RETURN_NULL(); /* returns null iff no input values */
+
+  a = (arrow_trans *)PG_GETARG_POINTER(0);
+  if (!a->arrow)
+    PG_RETURN_NULL();
+
+  PG_RETURN_BYTEA_P(pc_arrow_to_bytea(a->arrow));
+}
+
 PG_FUNCTION_INFO_V1(pcpatch_unnest);
 Datum pcpatch_unnest(PG_FUNCTION_ARGS)
 {
@@ -581,12 +1098,9 @@ Datum pcpatch_unnest(PG_FUNCTION_ARGS)
      */
     serpatch = PG_GETARG_SERPATCH_P(0);
 
-    /* The schema cache is not initialized at that time but we need the
-     * constants cache
-     */
-    pointcloud_init_constants_cache();
+    /* fn_extra holds the function state, use the backend schema cache */
     patch = pc_patch_deserialize(serpatch,
-                                 pc_schema_from_pcid_uncached(serpatch->pcid));
+                                 pc_schema_from_pcid_backend(serpatch->pcid));
 
     /* allocate memory for user context */
     fctx = (pcpatch_unnest_fctx *)palloc(sizeof(pcpatch_unnest_fctx));
@@ -621,13 +1135,168 @@ Datum pcpatch_unnest(PG_FUNCTION_ARGS)
   }
 }
 
+/**
+ * PC_Split(patch pcpatch, maxpoints int4, mode text default 'quadtree')
+ * returns setof pcpatch
+ */
+PG_FUNCTION_INFO_V1(pcpatch_split);
+Datum pcpatch_split(PG_FUNCTION_ARGS)
+{
+  typedef struct
+  {
+    uint32_t nextelem;
+    uint32_t numelems;
+    PCPATCH **parts;
+  } pcpatch_split_fctx;
+
+  FuncCallContext *funcctx;
+  pcpatch_split_fctx *fctx;
+  MemoryContext oldcontext;
+
+  /* stuff done only on the first call of the function */
+  if (SRF_IS_FIRSTCALL())
+  {
+    PCPATCH *patch;
+    SERIALIZED_PATCH *serpatch;
+    int32 maxpoints = PG_GETARG_INT32(1);
+    char *mode_str = text_to_cstring(PG_GETARG_TEXT_P(2));
+    PC_SPLITMODE mode;
+
+    if (maxpoints <= 0)
+      elog(ERROR, "maximum number of points must be positive");
+
+    if (!pc_splitmode_from_string(mode_str, &mode))
+      elog(ERROR,
+           "Unrecognized split mode '%s'. Please specify 'quadtree', "
+           "'octree' or 'kdtree'",
+           mode_str);
+    pfree(mode_str);
+
+    /* create a function context for cross-call persistence */
+    funcctx = SRF_FIRSTCALL_INIT();
+
+    /* the parts live across calls, as the detoasted patch */
+    oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+    serpatch = PG_GETARG_SERPATCH_P(0);
+
+    /* fn_extra holds the function state, use the backend schema cache */
+    patch = pc_patch_deserialize(serpatch,
+                                 pc_schema_from_pcid_backend(serpatch->pcid));
+
+    fctx = (pcpatch_split_fctx *)palloc(sizeof(pcpatch_split_fctx));
+    fctx->nextelem = 0;
+    fctx->parts = pc_patch_split(patch, maxpoints, mode, &(fctx->numelems));
+    pc_patch_free(patch);
+
+    funcctx->user_fctx = fctx;
+    MemoryContextSwitchTo(oldcontext);
+  }
+
+  /* stuff done on every call of the function */
+  funcctx = SRF_PERCALL_SETUP();
+  fctx = funcctx->user_fctx;
+
+  if (fctx->nextelem < fctx->numelems)
+  {
+    PCPATCH *part = fctx->parts[fctx->nextelem];
+    SERIALIZED_PATCH *serpart = pc_patch_serialize(part, NULL);
+    pc_patch_free(part);
+    fctx->parts[fctx->nextelem++] = NULL;
+    SRF_RETURN_NEXT(funcctx, PointerGetDatum(serpart));
+  }
+  else
+  {
+    /* do when there is no more left */
+    SRF_RETURN_DONE(funcctx);
+  }
+}
+
+/**
+ * PC_ExplodeColumns(patch pcpatch, dimnames text[]) returns setof record
+ *
+ * One row of float8 per point, written at once from the decoded columns of
+ * the dimensions, without making a pcpoint of every point.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_explode_columns);
+Datum pcpatch_explode_columns(PG_FUNCTION_ARGS)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  const PCSCHEMA *schema;
+  const PCDIMENSION **dims;
+  PCPATCH *patch;
+  bool directory;
+  TupleDesc tupdesc;
+  Tuplestorestate *tupstore;
+  MemoryContext oldcontext;
+  Datum *values;
+  bool *nulls;
+  double *vals;
+  uint32 i;
+  int ndims, d;
+
+  if (!rsinfo || !IsA(rsinfo, ReturnSetInfo) ||
+      !(rsinfo->allowedModes & SFRM_Materialize))
+    elog(ERROR, "set-valued function called in context that cannot accept a "
+                "set");
+
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "a column definition list is required, with a float8 column "
+                "per dimension");
+
+  schema = pc_patch_getarg_schema(fcinfo, 0, &directory);
+  dims = pc_dimensions_from_array(schema, PG_GETARG_ARRAYTYPE_P(1), &ndims);
+  if (tupdesc->natts != ndims)
+    elog(ERROR, "expected %d columns, one per dimension, got %d", ndims,
+         tupdesc->natts);
+  for (d = 0; d < ndims; d++)
+  {
+    if (TupleDescAttr(tupdesc, d)->atttypid != FLOAT8OID)
+      elog(ERROR, "column \"%s\" must be of type float8",
+           NameStr(TupleDescAttr(tupdesc, d)->attname));
+  }
+
+  patch = pc_patch_getarg_dims(fcinfo, 0, schema, directory, dims, ndims);
+  vals = palloc(Max((Size)ndims * patch->npoints, 1) * sizeof(double));
+  if (pc_patch_get_columns(patch, dims, ndims, vals) != PC_SUCCESS)
+    elog(ERROR, "failed to read the patch values");
+
+  /* The tuplestore and its descriptor are read after we return */
+  oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  tupdesc = CreateTupleDescCopy(tupdesc);
+  tupstore = tuplestore_begin_heap(
+      rsinfo->allowedModes & SFRM_Materialize_Random, false, work_mem);
+  MemoryContextSwitchTo(oldcontext);
+
+  values = palloc(ndims * sizeof(Datum));
+  nulls = palloc0(ndims * sizeof(bool));
+  for (i = 0; i < patch->npoints; i++)
+  {
+    for (d = 0; d < ndims; d++)
+      values[d] = Float8GetDatum(vals[(Size)d * patch->npoints + i]);
+    tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+  }
+
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tupstore;
+  rsinfo->setDesc = tupdesc;
+
+  pc_patch_freearg(fcinfo, 0, patch);
+  pfree(vals);
+  pfree(dims);
+  return (Datum)0;
+}
+
 PG_FUNCTION_INFO_V1(pcpatch_uncompress);
 Datum pcpatch_uncompress(PG_FUNCTION_ARGS)
 {
   SERIALIZED_PATCH *serpa = PG_GETARG_SERPATCH_P(0);
   PCSCHEMA *schema = pc_schema_from_pcid(serpa->pcid, fcinfo);
   PCPATCH *patch = pc_patch_deserialize(serpa, schema);
-  SERIALIZED_PATCH *serpa_out = pc_patch_serialize_to_uncompressed(patch);
+  uint32_t counts[PC_LOD_NLEVELS];
+  bool lod = pc_patch_serialized_lod(serpa, schema, counts);
+  SERIALIZED_PATCH *serpa_out =
+      pc_patch_serialize_to_uncompressed(patch, lod ? counts : NULL);
   pc_patch_free(patch);
   PG_RETURN_POINTER(serpa_out);
 }
@@ -645,6 +1314,8 @@ Datum pcpatch_compress(PG_FUNCTION_ARGS)
   PCPATCH *pa = patch_in;
   SERIALIZED_PATCH *serpa_out;
   PCDIMSTATS *stats = NULL;
+  uint32_t counts[PC_LOD_NLEVELS];
+  bool lod = pc_patch_serialized_lod(serpa, schema, counts);
   int i;
 
   /* Uncompress first */
@@ -664,8 +1335,42 @@ Datum pcpatch_compress(PG_FUNCTION_ARGS)
   {
     {
       char *ptr = config_in;
-      PCPATCH_DIMENSIONAL *pdl =
-          pc_patch_dimensional_from_uncompressed((PCPATCH_UNCOMPRESSED *)pa);
+      PCPATCH_DIMENSIONAL *pdl;
+
+      /* Reorder the points along a space filling curve or by level of
+       * detail first */
+      if (strncmp(ptr, "spatialsort=", strlen("spatialsort=")) == 0)
+      {
+        PC_SPATIALSORT curve;
+        PCPATCH *pa_sorted;
+        char *curve_str;
+
+        ptr += strlen("spatialsort=");
+        curve_str = pnstrdup(ptr, strcspn(ptr, ","));
+        if (!pc_spatialsort_from_string(curve_str, &curve))
+        {
+          elog(ERROR,
+               "Unrecognized spatial sort '%s'. Please specify 'morton', "
+               "'hilbert' or 'lod'",
+               curve_str);
+        }
+        pfree(curve_str);
+        ptr += strcspn(ptr, ",");
+        if (*ptr)
+          ++ptr;
+
+        /* The levels of detail are kept in the header */
+        lod = (curve == PC_SORT_LOD);
+        if (lod)
+          pa_sorted = pc_patch_sort_lod(pa, counts);
+        else
+          pa_sorted = pc_patch_sort_spatial(pa, curve);
+        if (pa != patch_in)
+          pc_patch_free(pa);
+        pa = pa_sorted;
+      }
+
+      pdl = pc_patch_dimensional_from_uncompressed((PCPATCH_UNCOMPRESSED *)pa);
       schema->compression = PC_DIMENSIONAL;
       stats = pc_dimstats_make(schema);
       pc_dimstats_update(stats, pdl);
@@ -728,7 +1433,7 @@ Datum pcpatch_compress(PG_FUNCTION_ARGS)
   }
 
   pa->schema = schema; /* install overridden schema */
-  serpa_out = pc_patch_serialize(pa, stats);
+  serpa_out = pc_patch_serialize_lod(pa, stats, lod ? counts : NULL);
 
   if (pa != patch_in)
     pc_patch_free(pa);
@@ -741,7 +1446,12 @@ Datum pcpatch_compress(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(pcpatch_numpoints);
 Datum pcpatch_numpoints(PG_FUNCTION_ARGS)
 {
-  SERIALIZED_PATCH *serpa = PG_GETHEADER_SERPATCH_P(0);
+  SERIALIZED_PATCH *serpa;
+
+  if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(PG_GETARG_DATUM(0))))
+    PG_RETURN_INT32(pc_patch_getarg(fcinfo, 0)->npoints);
+
+  serpa = PG_GETHEADER_SERPATCH_P(0);
   PG_RETURN_INT32(serpa->npoints);
 }
 
@@ -804,6 +1514,7 @@ Datum pcpatch_summary(PG_FUNCTION_ARGS)
   PCSCHEMA *schema;
   PCSTATS *stats;
   PCPATCH *patch = NULL;
+  const uint8_t *directory = NULL;
   StringInfoData strdata;
   text *ret;
   const char *comma = "";
@@ -811,7 +1522,17 @@ Datum pcpatch_summary(PG_FUNCTION_ARGS)
 
   serpa = PG_GETHEADERX_SERPATCH_P(0, stats_size_guess);
   schema = pc_schema_from_pcid(serpa->pcid, fcinfo);
-  if (serpa->compression == PC_DIMENSIONAL)
+  if (SERPATCH_COMPRESSION(serpa) == PC_DIMENSIONAL &&
+      SERPATCH_VERSION(serpa) >= 1)
+  {
+    /* the directory has the compression of each dimension */
+    size_t size = SERPATCH_HEADER_SIZE(serpa, schema) +
+                  schema->ndims * sizeof(SERIALIZED_DIMENSION);
+    if (stats_size_guess < size)
+      serpa = PG_GETHEADERX_SERPATCH_P(0, size);
+    directory = serpa->data + SERPATCH_HEADER_SIZE(serpa, schema);
+  }
+  else if (SERPATCH_COMPRESSION(serpa) == PC_DIMENSIONAL)
   {
     /* need full data to inspect per-dimension compression */
     /* NOTE: memory usage could be optimized to only fetch slices
@@ -838,12 +1559,12 @@ Datum pcpatch_summary(PG_FUNCTION_ARGS)
                    "\"pcid\":%d, \"npts\":%d, \"srid\":%d, "
                    "\"compr\":\"%s\",\"dims\":[",
                    serpa->pcid, serpa->npoints, schema->srid,
-                   pc_compression_name(serpa->compression));
+                   pc_compression_name(SERPATCH_COMPRESSION(serpa)));
 
   for (i = 0; i < schema->ndims; ++i)
   {
     PCDIMENSION *dim = schema->dims[i];
-    PCBYTES bytes;
+    uint32_t compression;
     double val;
     appendStringInfo(&strdata,
                      "%s{\"pos\":%d,\"name\":\"%s\",\"size\":%d"
@@ -852,10 +1573,19 @@ Datum pcpatch_summary(PG_FUNCTION_ARGS)
                      pc_interpretation_string(dim->interpretation));
 
     /* Print per-dimension compression (if dimensional) */
-    if (serpa->compression == PC_DIMENSIONAL)
+    if (SERPATCH_COMPRESSION(serpa) == PC_DIMENSIONAL)
     {
-      bytes = ((PCPATCH_DIMENSIONAL *)patch)->bytes[i];
-      switch (bytes.compression)
+      if (directory)
+      {
+        SERIALIZED_DIMENSION entry;
+        memcpy(&entry, directory + i * sizeof(SERIALIZED_DIMENSION),
+               sizeof(SERIALIZED_DIMENSION));
+        compression = entry.compression;
+      }
+      else
+        compression = ((PCPATCH_DIMENSIONAL *)patch)->bytes[i].compression;
+
+      switch (compression)
       {
       case PC_DIM_RLE:
         appendStringInfoString(&strdata, ",\"compr\":\"rle\"");
@@ -871,19 +1601,23 @@ Datum pcpatch_summary(PG_FUNCTION_ARGS)
         break;
       default:
         appendStringInfo(&strdata, ",\"compr\":\"unknown(%d)\"",
-                         bytes.compression);
+                         compression);
         break;
       }
     }
 
     if (stats)
     {
-      pc_point_get_double_by_name(&(stats->min), dim->name, &val);
-      appendStringInfo(&strdata, ",\"stats\":{\"min\":%g", val);
-      pc_point_get_double_by_name(&(stats->max), dim->name, &val);
-      appendStringInfo(&strdata, ",\"max\":%g", val);
-      pc_point_get_double_by_name(&(stats->avg), dim->name, &val);
-      appendStringInfo(&strdata, ",\"avg\":%g}", val);
+      char num[PC_DOUBLE_STRING_SIZE];
+      pc_point_get_double(&(stats->min), dim, &val);
+      pc_double_to_string(num, val);
+      appendStringInfo(&strdata, ",\"stats\":{\"min\":%s", num);
+      pc_point_get_double(&(stats->max), dim, &val);
+      pc_double_to_string(num, val);
+      appendStringInfo(&strdata, ",\"max\":%s", num);
+      pc_point_get_double(&(stats->avg), dim, &val);
+      pc_double_to_string(num, val);
+      appendStringInfo(&strdata, ",\"avg\":%s}", num);
     }
     appendStringInfoString(&strdata, "}");
     comma = ",";
@@ -900,7 +1634,7 @@ PG_FUNCTION_INFO_V1(pcpatch_compression);
 Datum pcpatch_compression(PG_FUNCTION_ARGS)
 {
   SERIALIZED_PATCH *serpa = PG_GETHEADER_SERPATCH_P(0);
-  PG_RETURN_INT32(serpa->compression);
+  PG_RETURN_INT32(SERPATCH_COMPRESSION(serpa));
 }
 
 PG_FUNCTION_INFO_V1(pcpatch_intersects);
@@ -1064,22 +1798,17 @@ Datum pcpatch_get_stat(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(pcpatch_filter);
 Datum pcpatch_filter(PG_FUNCTION_ARGS)
 {
-  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
-  PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  PCPATCH *patch = pc_patch_getarg(fcinfo, 0);
   char *dim_name = text_to_cstring(PG_GETARG_TEXT_P(1));
   float8 value1 = PG_GETARG_FLOAT8(2);
   float8 value2 = PG_GETARG_FLOAT8(3);
   int32 mode = PG_GETARG_INT32(4);
-  PCPATCH *patch;
   PCPATCH *patch_filtered = NULL;
-  SERIALIZED_PATCH *serpatch_filtered;
+  MemoryContext context, oldcontext;
 
-  patch = pc_patch_deserialize(serpatch, schema);
-  if (!patch)
-  {
-    elog(ERROR, "failed to deserialize patch");
-    PG_RETURN_NULL();
-  }
+  /* the result stays deserialized for the next function */
+  context = pc_patch_expanded_context();
+  oldcontext = MemoryContextSwitchTo(context);
 
   switch (mode)
   {
@@ -1100,8 +1829,8 @@ Datum pcpatch_filter(PG_FUNCTION_ARGS)
     elog(ERROR, "unknown mode \"%d\"", mode);
   }
 
-  pc_patch_free(patch);
-  PG_FREE_IF_COPY(serpatch, 0);
+  MemoryContextSwitchTo(oldcontext);
+  pc_patch_freearg(fcinfo, 0, patch);
 
   if (!patch_filtered)
   {
@@ -1109,6 +1838,53 @@ Datum pcpatch_filter(PG_FUNCTION_ARGS)
   }
   pfree(dim_name);
 
+  /* Always treat zero-point patches as SQL NULL */
+  if (patch_filtered->npoints <= 0)
+  {
+    MemoryContextDelete(context);
+    PG_RETURN_NULL();
+  }
+
+  PG_RETURN_DATUM(pc_patch_expanded_datum(patch_filtered, context));
+}
+
+/**
+ * PC_VoxelFilter(patch pcpatch, voxelsize float8, mode text default 'first')
+ * returns pcpatch
+ */
+PG_FUNCTION_INFO_V1(pcpatch_voxel_filter);
+Datum pcpatch_voxel_filter(PG_FUNCTION_ARGS)
+{
+  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
+  PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  float8 voxelsize = PG_GETARG_FLOAT8(1);
+  char *mode_str = text_to_cstring(PG_GETARG_TEXT_P(2));
+  PC_VOXELMODE mode;
+  PCPATCH *patch;
+  PCPATCH *patch_filtered;
+  SERIALIZED_PATCH *serpatch_filtered;
+
+  if (!pc_voxel_mode_from_string(mode_str, &mode))
+    elog(ERROR,
+         "Unrecognized voxel filter mode '%s'. Please specify 'first', "
+         "'centroid' or 'closest'",
+         mode_str);
+  pfree(mode_str);
+
+  patch = pc_patch_deserialize(serpatch, schema);
+  if (!patch)
+  {
+    elog(ERROR, "failed to deserialize patch");
+    PG_RETURN_NULL();
+  }
+
+  patch_filtered = pc_patch_voxel_filter(patch, voxelsize, mode);
+  pc_patch_free(patch);
+  PG_FREE_IF_COPY(serpatch, 0);
+
+  if (!patch_filtered)
+    elog(ERROR, "failed to filter patch");
+
   /* Always treat zero-point patches as SQL NULL */
   if (patch_filtered->npoints <= 0)
   {
@@ -1122,6 +1898,7 @@ Datum pcpatch_filter(PG_FUNCTION_ARGS)
   PG_RETURN_POINTER(serpatch_filtered);
 }
 
+/* cstring array utility functions */
 const char **array_to_cstring_array(ArrayType *array, int *size)
 {
   int i, j, offset = 0;
@@ -1159,28 +1936,69 @@ void pc_cstring_array_free(const char **array, int nelems)
 PG_FUNCTION_INFO_V1(pcpatch_sort);
 Datum pcpatch_sort(PG_FUNCTION_ARGS)
 {
-  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
   ArrayType *array = PG_GETARG_ARRAYTYPE_P(1);
-  PCSCHEMA *schema = NULL;
   PCPATCH *patch = NULL;
   PCPATCH *patch_sorted = NULL;
-  SERIALIZED_PATCH *serpatch_sorted = NULL;
+  MemoryContext context, oldcontext;
 
   int ndims;
   const char **dim_name = array_to_cstring_array(array, &ndims);
   if (!ndims)
   {
     pc_cstring_array_free(dim_name, ndims);
-    PG_RETURN_POINTER(serpatch);
+    PG_RETURN_DATUM(PG_GETARG_DATUM(0));
   }
 
+  patch = pc_patch_getarg(fcinfo, 0);
+
+  /* the result stays deserialized for the next function */
+  context = pc_patch_expanded_context();
+  oldcontext = MemoryContextSwitchTo(context);
+  patch_sorted = pc_patch_sort(patch, dim_name, ndims);
+  MemoryContextSwitchTo(oldcontext);
+
+  pc_cstring_array_free(dim_name, ndims);
+  pc_patch_freearg(fcinfo, 0, patch);
+
+  if (!patch_sorted)
+  {
+    MemoryContextDelete(context);
+    PG_RETURN_NULL();
+  }
+
+  PG_RETURN_DATUM(pc_patch_expanded_datum(patch_sorted, context));
+}
+
+/**
+ * PC_SortSpatial(patch pcpatch, curve text default 'hilbert') returns pcpatch
+ */
+PG_FUNCTION_INFO_V1(pcpatch_sort_spatial);
+Datum pcpatch_sort_spatial(PG_FUNCTION_ARGS)
+{
+  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
+  char *curve_str = text_to_cstring(PG_GETARG_TEXT_P(1));
+  PCSCHEMA *schema = NULL;
+  PCPATCH *patch = NULL;
+  PCPATCH *patch_sorted = NULL;
+  SERIALIZED_PATCH *serpatch_sorted = NULL;
+  PC_SPATIALSORT curve;
+  uint32_t counts[PC_LOD_NLEVELS];
+
+  if (!pc_spatialsort_from_string(curve_str, &curve))
+    elog(ERROR,
+         "Unrecognized spatial sort '%s'. Please specify 'morton', "
+         "'hilbert' or 'lod'",
+         curve_str);
+  pfree(curve_str);
+
   schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
 
   patch = pc_patch_deserialize(serpatch, schema);
-  if (patch)
-    patch_sorted = pc_patch_sort(patch, dim_name, ndims);
+  if (patch && curve == PC_SORT_LOD)
+    patch_sorted = pc_patch_sort_lod(patch, counts);
+  else if (patch)
+    patch_sorted = pc_patch_sort_spatial(patch, curve);
 
-  pc_cstring_array_free(dim_name, ndims);
   if (patch)
     pc_patch_free(patch);
   PG_FREE_IF_COPY(serpatch, 0);
@@ -1188,11 +2006,86 @@ Datum pcpatch_sort(PG_FUNCTION_ARGS)
   if (!patch_sorted)
     PG_RETURN_NULL();
 
-  serpatch_sorted = pc_patch_serialize(patch_sorted, NULL);
+  /* The levels of detail are kept in the header for PC_LOD */
+  serpatch_sorted = pc_patch_serialize_lod(
+      patch_sorted, NULL, curve == PC_SORT_LOD ? counts : NULL);
   pc_patch_free(patch_sorted);
   PG_RETURN_POINTER(serpatch_sorted);
 }
 
+/**
+ * PC_LOD(patch pcpatch, level int4) returns pcpatch
+ *
+ * The level counts in the header give the number of leading points, so an
+ * uncompressed patch is only read from TOAST up to them.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_lod);
+Datum pcpatch_lod(PG_FUNCTION_ARGS)
+{
+  int32 level = PG_GETARG_INT32(1);
+  SERIALIZED_PATCH *serpatch = PG_GETHEADER_SERPATCH_P(0);
+  PCSCHEMA *schema = NULL;
+  PCPATCH *patch = NULL;
+  PCPATCH *patch_lod = NULL;
+  SERIALIZED_PATCH *serpatch_lod = NULL;
+  uint32_t counts[PC_LOD_NLEVELS];
+  size_t header_size;
+  uint32 n;
+
+  if (level < 0)
+    elog(ERROR, "level of detail must not be negative");
+
+  if (!SERPATCH_HAS_LOD(serpatch))
+    elog(ERROR, "patch has no levels of detail, sort it with "
+                "PC_SortSpatial(pa, 'lod') first");
+
+  schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  header_size = SERPATCH_HEADER_SIZE(serpatch, schema);
+  serpatch = PG_GETHEADERX_SERPATCH_P(0, header_size);
+  pc_patch_serialized_lod(serpatch, schema, counts);
+
+  n = pc_patch_lod_npoints(counts, level);
+  if (n > serpatch->npoints)
+    elog(ERROR, "level counts of %u points for a patch of %u points", n,
+         serpatch->npoints);
+  if (!n)
+    PG_RETURN_NULL();
+
+  if (SERPATCH_COMPRESSION(serpatch) == PC_NONE)
+  {
+    PCPATCH_UNCOMPRESSED *pu = pc_patch_uncompressed_make(schema, n);
+    size_t size = (size_t)n * schema->size;
+
+    serpatch = PG_GETHEADERX_SERPATCH_P(0, header_size + size);
+    memcpy(pu->data, serpatch->data + header_size, size);
+    pu->npoints = n;
+    if (PC_FAILURE == pc_patch_uncompressed_compute_extent(pu) ||
+        PC_FAILURE == pc_patch_uncompressed_compute_stats(pu))
+      elog(ERROR, "failed to compute patch extent and stats");
+    patch_lod = (PCPATCH *)pu;
+  }
+  else
+  {
+    serpatch = PG_GETARG_SERPATCH_P(0);
+    patch = pc_patch_deserialize(serpatch, schema);
+    if (patch)
+      patch_lod = pc_patch_lod(patch, counts, level);
+    if (patch)
+      pc_patch_free(patch);
+  }
+
+  if (!patch_lod)
+    PG_RETURN_NULL();
+
+  /* The coarse levels are ordered by level of detail as well */
+  if (level < PC_LOD_NLEVELS)
+    memset(counts + level + 1, 0,
+           (PC_LOD_NLEVELS - level - 1) * sizeof(uint32_t));
+  serpatch_lod = pc_patch_serialize_lod(patch_lod, NULL, counts);
+  pc_patch_free(patch_lod);
+  PG_RETURN_POINTER(serpatch_lod);
+}
+
 /** True/false if the patch is sorted on dimension */
 PG_FUNCTION_INFO_V1(pcpatch_is_sorted);
 Datum pcpatch_is_sorted(PG_FUNCTION_ARGS)
@@ -1224,3 +2117,168 @@ Datum pcpatch_is_sorted(PG_FUNCTION_ARGS)
 
   PG_RETURN_BOOL(res);
 }
+
+/**
+ * Build an empty grid from the (origin, cellsize, ncols, nrows, dimname,
+ * agg) arguments starting at argno
+ */
+static PCGRID *pc_grid_from_args(FunctionCallInfo fcinfo, int argno)
+{
+  ArrayType *origin = PG_GETARG_ARRAYTYPE_P(argno);
+  float8 cellsize = PG_GETARG_FLOAT8(argno + 1);
+  int32 ncols = PG_GETARG_INT32(argno + 2);
+  int32 nrows = PG_GETARG_INT32(argno + 3);
+  char *agg_str = text_to_cstring(PG_GETARG_TEXT_P(argno + 5));
+  PC_GRIDAGG agg;
+  float8 *xy;
+
+  if (ARR_ELEMTYPE(origin) != FLOAT8OID || ARR_NDIM(origin) != 1 ||
+      ARR_DIMS(origin)[0] != 2 || ARR_HASNULL(origin))
+    elog(ERROR, "grid origin must be a float8[] of two non-null values");
+
+  if (ncols <= 0 || nrows <= 0)
+    elog(ERROR, "grid size must be positive");
+
+  if ((Size)ncols * nrows > MaxArraySize)
+    elog(ERROR, "grid of %d x %d cells is too large", ncols, nrows);
+
+  if (!pc_grid_agg_from_string(agg_str, &agg))
+    elog(ERROR,
+         "Unrecognized grid aggregate '%s'. Please specify 'min', 'max', "
+         "'mean', 'count' or 'last'",
+         agg_str);
+  pfree(agg_str);
+
+  xy = (float8 *)ARR_DATA_PTR(origin);
+  return pc_grid_make(xy[0], xy[1], cellsize, ncols, nrows, agg);
+}
+
+/**
+ * Return the grid as a float8[nrows][ncols], empty cells being NULL
+ */
+static ArrayType *pc_grid_to_array(const PCGRID *grid)
+{
+  size_t ncells = (size_t)grid->ncols * grid->nrows;
+  Datum *elems = palloc(ncells * sizeof(Datum));
+  bool *nulls = palloc(ncells * sizeof(bool));
+  int dims[2];
+  int lbs[2];
+  uint32 col, row;
+  size_t i = 0;
+
+  for (row = 0; row < grid->nrows; row++)
+  {
+    for (col = 0; col < grid->ncols; col++, i++)
+    {
+      double val;
+      nulls[i] = !pc_grid_get_value(grid, col, row, &val);
+      elems[i] = nulls[i] ? (Datum)0 : Float8GetDatum(val);
+    }
+  }
+
+  dims[0] = grid->nrows;
+  dims[1] = grid->ncols;
+  lbs[0] = lbs[1] = 1;
+  return construct_md_array(elems, nulls, 2, dims, lbs, FLOAT8OID,
+                            sizeof(float8), FLOAT8PASSBYVAL, 'd');
+}
+
+/**
+ * PC_Grid(patch pcpatch, origin float8[], cellsize float8, ncols int4,
+ *         nrows int4, dimname text, agg text) returns float8[][]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_grid);
+Datum pcpatch_grid(PG_FUNCTION_ARGS)
+{
+  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
+  char *dim_name = text_to_cstring(PG_GETARG_TEXT_P(5));
+  PCGRID *grid = pc_grid_from_args(fcinfo, 1);
+  PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  PCPATCH *patch = pc_patch_deserialize(serpatch, schema);
+  ArrayType *result;
+
+  if (!patch)
+    elog(ERROR, "failed to deserialize patch");
+
+  pc_grid_add_patch(grid, patch, dim_name);
+  pc_patch_free(patch);
+  PG_FREE_IF_COPY(serpatch, 0);
+  pfree(dim_name);
+
+  result = pc_grid_to_array(grid);
+  pc_grid_free(grid);
+  PG_RETURN_ARRAYTYPE_P(result);
+}
+
+/* Same size as abs_trans, see pointcloud_abs */
+typedef struct
+{
+  PCGRID *grid;
+} grid_trans;
+
+/**
+ * PC_GridAgg(patch pcpatch, origin float8[], cellsize float8, ncols int4,
+ *            nrows int4, dimname text, agg text) returns float8[][]
+ */
+PG_FUNCTION_INFO_V1(pcpatch_gridagg_transfn);
+Datum pcpatch_gridagg_transfn(PG_FUNCTION_ARGS)
+{
+  MemoryContext aggcontext, oldcontext;
+  grid_trans *g;
+  int i;
+
+  if (!AggCheckCallContext(fcinfo, &aggcontext))
+  {
+    elog(ERROR, "pcpatch_gridagg_transfn called in non-aggregate context");
+    aggcontext = NULL; /* keep compiler quiet */
+  }
+
+  if (PG_ARGISNULL(0))
+  {
+    for (i = 2; i < PG_NARGS(); i++)
+    {
+      if (PG_ARGISNULL(i))
+        elog(ERROR, "grid parameters must not be null");
+    }
+
+    /* the grid lives as long as the aggregate */
+    oldcontext = MemoryContextSwitchTo(aggcontext);
+    g = (grid_trans *)palloc(sizeof(grid_trans));
+    g->grid = pc_grid_from_args(fcinfo, 2);
+    MemoryContextSwitchTo(oldcontext);
+  }
+  else
+  {
+    g = (grid_trans *)PG_GETARG_POINTER(0);
+  }
+
+  if (!PG_ARGISNULL(1))
+  {
+    SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(1);
+    char *dim_name = text_to_cstring(PG_GETARG_TEXT_P(6));
+    PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+    PCPATCH *patch = pc_patch_deserialize(serpatch, schema);
+
+    if (!patch)
+      elog(ERROR, "failed to deserialize patch");
+
+    pc_grid_add_patch(g->grid, patch, dim_name);
+    pc_patch_free(patch);
+    PG_FREE_IF_COPY(serpatch, 1);
+    pfree(dim_name);
+  }
+
+  PG_RETURN_POINTER(g);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_gridagg_final);
+Datum pcpatch_gridagg_final(PG_FUNCTION_ARGS)
+{
+  grid_trans *g;
+
+  if (PG_ARGISNULL(0))
+    PG_RETURN_NULL(); /* returns null iff no input values */
+
+  g = (grid_trans *)PG_GETARG_POINTER(0);
+  PG_RETURN_ARRAYTYPE_P(pc_grid_to_array(g->grid));
+}
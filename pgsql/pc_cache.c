@@ -0,0 +1,288 @@
+/***********************************************************************
+ * pc_cache.c
+ *
+ *  Per-query cache of decoded patches, so that a toasted patch used by
+ *  several expressions of a query, like PC_PatchAvg(pa, 'Z') and
+ *  PC_AsText(PC_FilterBetween(pa, ...)), is only detoasted and decoded
+ *  once. Entries are keyed by their TOAST pointer and kept in LRU order
+ *  within the pointcloud.patch_cache_memory limit.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_pgsql.h"
+
+#include "lib/ilist.h"
+#include "utils/guc.h"
+#include "utils/memutils.h"
+
+typedef struct
+{
+  dlist_node node;
+  Oid toastrelid;
+  Oid valueid;
+  /* Holds the detoasted patch and the decoded one */
+  MemoryContext context;
+  Size size;
+  /* Number of functions using the patch right now */
+  int pins;
+  PCPATCH *patch;
+} PCPATCHCACHEENTRY;
+
+/* Decoded patch that did not fit, freed when it is released */
+typedef struct
+{
+  dlist_node node;
+  MemoryContext context;
+  MemoryContextCallback callback;
+  PCPATCH *patch;
+} PCPATCHUNCACHED;
+
+typedef struct
+{
+  /* Query memory context the cache belongs to */
+  MemoryContext owner;
+  MemoryContext context;
+  MemoryContextCallback callback;
+  /* Most recently used entries first */
+  dlist_head entries;
+  Size used;
+} PCPATCHCACHE;
+
+/* Size of the cache, in kB, 0 disables it */
+static int pc_patch_cache_kb = 4096;
+
+/* Cache of the running query, the queries it runs go without one */
+static PCPATCHCACHE *pc_patch_cache = NULL;
+
+/* Patches handed over uncached and not released yet */
+static dlist_head pc_patch_uncached = DLIST_STATIC_INIT(pc_patch_uncached);
+
+void pc_patch_cache_init(void)
+{
+  DefineCustomIntVariable(
+      "pointcloud.patch_cache_memory",
+      "Memory a query uses to keep the toasted patches it decoded.",
+      "0 disables the cache of decoded patches.", &pc_patch_cache_kb, 4096, 0,
+      MAX_KILOBYTES, PGC_USERSET, GUC_UNIT_KB, NULL, NULL, NULL);
+}
+
+/* The context of an uncached patch goes away, forget the patch */
+static void pc_patch_uncached_reset(void *arg)
+{
+  dlist_delete(&((PCPATCHUNCACHED *)arg)->node);
+}
+
+/* The query memory context goes away, and the cache with it */
+static void pc_patch_cache_reset(void *arg)
+{
+  if (pc_patch_cache == arg)
+    pc_patch_cache = NULL;
+}
+
+static PCPATCHCACHE *pc_patch_cache_of(MemoryContext owner)
+{
+  MemoryContext context;
+  PCPATCHCACHE *cache;
+
+  if (pc_patch_cache)
+    return pc_patch_cache->owner == owner ? pc_patch_cache : NULL;
+
+  context = AllocSetContextCreate(owner, "Pointcloud Patch Cache",
+                                  ALLOCSET_SMALL_SIZES);
+  cache = MemoryContextAllocZero(context, sizeof(PCPATCHCACHE));
+  cache->owner = owner;
+  cache->context = context;
+  cache->callback.func = pc_patch_cache_reset;
+  cache->callback.arg = cache;
+  MemoryContextRegisterResetCallback(context, &cache->callback);
+  dlist_init(&cache->entries);
+  pc_patch_cache = cache;
+  return cache;
+}
+
+static void pc_patch_cache_drop(PCPATCHCACHE *cache, PCPATCHCACHEENTRY *entry)
+{
+  dlist_delete(&entry->node);
+  cache->used -= entry->size;
+  MemoryContextDelete(entry->context);
+  pfree(entry);
+}
+
+/* Evict unused entries, least recently used first, until size fits */
+static bool pc_patch_cache_make_room(PCPATCHCACHE *cache, Size size)
+{
+  Size limit = (Size)pc_patch_cache_kb * 1024;
+  dlist_mutable_iter iter;
+
+  if (size > limit)
+    return false;
+
+  dlist_reverse_foreach_modify(iter, &cache->entries)
+  {
+    PCPATCHCACHEENTRY *entry =
+        dlist_container(PCPATCHCACHEENTRY, node, iter.cur);
+    if (cache->used + size <= limit)
+      break;
+    if (!entry->pins)
+      pc_patch_cache_drop(cache, entry);
+  }
+  return cache->used + size <= limit;
+}
+
+static PCPATCHCACHEENTRY *
+pc_patch_cache_find(const PCPATCHCACHE *cache,
+                    const struct varatt_external *toast)
+{
+  dlist_iter iter;
+
+  dlist_foreach(iter, &cache->entries)
+  {
+    PCPATCHCACHEENTRY *entry =
+        dlist_container(PCPATCHCACHEENTRY, node, iter.cur);
+    if (entry->valueid == toast->va_valueid &&
+        entry->toastrelid == toast->va_toastrelid)
+      return entry;
+  }
+  return NULL;
+}
+
+#if PGSQL_VERSION < 120
+bool pc_patch_cache_has(FunctionCallInfoData *fcinfo, struct varlena *ptr)
+#else
+bool pc_patch_cache_has(FunctionCallInfo fcinfo, struct varlena *ptr)
+#endif
+{
+  struct varatt_external toast;
+
+  if (!pc_patch_cache || !fcinfo->flinfo ||
+      pc_patch_cache->owner != fcinfo->flinfo->fn_mcxt ||
+      !VARATT_IS_EXTERNAL_ONDISK(ptr))
+    return false;
+
+  memcpy(&toast, VARDATA_EXTERNAL(ptr), sizeof(toast));
+  return pc_patch_cache_find(pc_patch_cache, &toast) != NULL;
+}
+
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_cache_get(FunctionCallInfoData *fcinfo, struct varlena *ptr)
+#else
+PCPATCH *pc_patch_cache_get(FunctionCallInfo fcinfo, struct varlena *ptr)
+#endif
+{
+  struct varatt_external toast;
+  PCPATCHCACHE *cache;
+  PCPATCHCACHEENTRY *entry;
+  SERIALIZED_PATCH *serpatch;
+  PCSCHEMA *schema;
+  PCPATCH *patch;
+  MemoryContext context, oldcontext;
+  Size size;
+
+  if (!pc_patch_cache_kb || !fcinfo->flinfo ||
+      !VARATT_IS_EXTERNAL_ONDISK(ptr))
+    return NULL;
+
+  cache = pc_patch_cache_of(fcinfo->flinfo->fn_mcxt);
+  if (!cache)
+    return NULL;
+
+  memcpy(&toast, VARDATA_EXTERNAL(ptr), sizeof(toast));
+  entry = pc_patch_cache_find(cache, &toast);
+  if (entry)
+  {
+    dlist_move_head(&cache->entries, &entry->node);
+    entry->pins++;
+    return entry->patch;
+  }
+
+  if (!pc_patch_cache_make_room(cache, toast.va_rawsize))
+    return NULL;
+
+  /* Decode the patch in its own context, to drop it at once */
+  context = AllocSetContextCreate(cache->context, "Pointcloud Cached Patch",
+                                  ALLOCSET_DEFAULT_SIZES);
+  oldcontext = MemoryContextSwitchTo(context);
+  serpatch = (SERIALIZED_PATCH *)PG_DETOAST_DATUM(PointerGetDatum(ptr));
+  MemoryContextSwitchTo(oldcontext);
+
+  schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  size = VARSIZE(serpatch);
+
+  oldcontext = MemoryContextSwitchTo(context);
+  patch = pc_patch_deserialize(serpatch, schema);
+  /* LAZperf is decompressed as a whole, do it once for all the readers */
+  if (patch && patch->type == PC_LAZPERF)
+  {
+    PCPATCH *paun = pc_patch_uncompress(patch);
+    pc_patch_free(patch);
+    patch = paun;
+    size += (Size)patch->npoints * schema->size;
+  }
+  MemoryContextSwitchTo(oldcontext);
+
+  if (!patch)
+    elog(ERROR, "failed to deserialize patch");
+
+  /* The decoded patch may not fit after all, hand it over uncached rather
+   * than have the caller decode it again */
+  if (!pc_patch_cache_make_room(cache, size))
+  {
+    PCPATCHUNCACHED *uncached =
+        MemoryContextAlloc(context, sizeof(PCPATCHUNCACHED));
+    uncached->context = context;
+    uncached->patch = patch;
+    uncached->callback.func = pc_patch_uncached_reset;
+    uncached->callback.arg = uncached;
+    MemoryContextRegisterResetCallback(context, &uncached->callback);
+    dlist_push_head(&pc_patch_uncached, &uncached->node);
+    MemoryContextSetParent(context, CurrentMemoryContext);
+    return patch;
+  }
+
+  entry = MemoryContextAlloc(cache->context, sizeof(PCPATCHCACHEENTRY));
+  entry->toastrelid = toast.va_toastrelid;
+  entry->valueid = toast.va_valueid;
+  entry->context = context;
+  entry->size = size;
+  entry->pins = 1;
+  entry->patch = patch;
+  dlist_push_head(&cache->entries, &entry->node);
+  cache->used += size;
+  return patch;
+}
+
+bool pc_patch_cache_release(const PCPATCH *patch)
+{
+  dlist_iter iter;
+
+  /* An uncached patch goes with its context, detoasted copy included */
+  dlist_foreach(iter, &pc_patch_uncached)
+  {
+    PCPATCHUNCACHED *uncached =
+        dlist_container(PCPATCHUNCACHED, node, iter.cur);
+    if (uncached->patch == patch)
+    {
+      MemoryContextDelete(uncached->context);
+      return true;
+    }
+  }
+
+  if (!pc_patch_cache)
+    return false;
+
+  dlist_foreach(iter, &pc_patch_cache->entries)
+  {
+    PCPATCHCACHEENTRY *entry =
+        dlist_container(PCPATCHCACHEENTRY, node, iter.cur);
+    if (entry->patch == patch)
+    {
+      entry->pins--;
+      return true;
+    }
+  }
+  return false;
+}
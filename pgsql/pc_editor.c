@@ -11,10 +11,13 @@
 
 Datum pcpatch_setpcid(PG_FUNCTION_ARGS);
 Datum pcpatch_transform(PG_FUNCTION_ARGS);
+Datum pcpatch_project(PG_FUNCTION_ARGS);
+Datum pcpatch_affine(PG_FUNCTION_ARGS);
 
 static SERIALIZED_PATCH *pcpatch_set_schema(SERIALIZED_PATCH *serpa,
                                             PCSCHEMA *oschema,
-                                            PCSCHEMA *nschema, float8 def)
+                                            PCSCHEMA *nschema,
+                                            const PCTRANSFORM *plan)
 {
   SERIALIZED_PATCH *serpatch;
   PCPATCH *paout;
@@ -51,7 +54,7 @@ static SERIALIZED_PATCH *pcpatch_set_schema(SERIALIZED_PATCH *serpa,
     if (!patch)
       return NULL;
 
-    paout = pc_patch_set_schema(patch, nschema, def);
+    paout = pc_patch_transform_plan(patch, plan);
 
     if (patch != paout)
       pc_patch_free(patch);
@@ -75,8 +78,16 @@ Datum pcpatch_setpcid(PG_FUNCTION_ARGS)
   float8 def = PG_GETARG_FLOAT8(2);
   PCSCHEMA *oschema = pc_schema_from_pcid(serpa->pcid, fcinfo);
   PCSCHEMA *nschema = pc_schema_from_pcid(pcid, fcinfo);
+  PCTRANSFORM *plan = NULL;
 
-  serpatch = pcpatch_set_schema(serpa, oschema, nschema, def);
+  if (!pc_schema_same_dimensions(oschema, nschema))
+  {
+    plan = pc_transform_from_pcids(serpa->pcid, pcid, def, false, fcinfo);
+    if (!plan)
+      PG_RETURN_NULL();
+  }
+
+  serpatch = pcpatch_set_schema(serpa, oschema, nschema, plan);
   if (!serpatch)
     PG_RETURN_NULL();
   PG_RETURN_POINTER(serpatch);
@@ -86,26 +97,117 @@ PG_FUNCTION_INFO_V1(pcpatch_transform);
 Datum pcpatch_transform(PG_FUNCTION_ARGS)
 {
   PCPATCH *patch, *paout;
-  SERIALIZED_PATCH *serpatch;
-  SERIALIZED_PATCH *serpa = PG_GETARG_SERPATCH_P(0);
   int32 pcid = PG_GETARG_INT32(1);
   float8 def = PG_GETARG_FLOAT8(2);
-  PCSCHEMA *oschema = pc_schema_from_pcid(serpa->pcid, fcinfo);
-  PCSCHEMA *nschema = pc_schema_from_pcid(pcid, fcinfo);
+  MemoryContext context, oldcontext;
+  PCTRANSFORM *plan;
 
-  patch = pc_patch_deserialize(serpa, oschema);
-  if (!patch)
+  patch = pc_patch_getarg(fcinfo, 0);
+  plan = pc_transform_from_pcids(patch->schema->pcid, pcid, def, true, fcinfo);
+  if (!plan)
     PG_RETURN_NULL();
 
-  paout = pc_patch_transform(patch, nschema, def);
+  /* the result stays deserialized for the next function */
+  context = pc_patch_expanded_context();
+  oldcontext = MemoryContextSwitchTo(context);
+  paout = pc_patch_transform_plan(patch, plan);
+  MemoryContextSwitchTo(oldcontext);
 
-  pc_patch_free(patch);
+  pc_patch_freearg(fcinfo, 0, patch);
 
   if (!paout)
+  {
+    MemoryContextDelete(context);
     PG_RETURN_NULL();
+  }
 
-  serpatch = pc_patch_serialize(paout, NULL);
-  pc_patch_free(paout);
+  PG_RETURN_DATUM(pc_patch_expanded_datum(paout, context));
+}
 
-  PG_RETURN_POINTER(serpatch);
+/**
+ * PC_Project(patch pcpatch, dims text[], pcid int4 default 0) returns pcpatch
+ * Keep the named dimensions, under the given pcid or the first one
+ * registered with exactly these dimensions.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_project);
+Datum pcpatch_project(PG_FUNCTION_ARGS)
+{
+  PCPATCH *patch = pc_patch_getarg(fcinfo, 0);
+  ArrayType *array = PG_GETARG_ARRAYTYPE_P(1);
+  int32 pcid = PG_GETARG_INT32(2);
+  PCSCHEMA *nschema;
+  PCPATCH *paout;
+  MemoryContext context, oldcontext;
+  const char **names;
+  int nnames;
+
+  if (pcid < 0)
+    elog(ERROR, "pcid must be positive, or 0 to derive it");
+
+  names = array_to_cstring_array(array, &nnames);
+  if (!nnames)
+  {
+    pc_cstring_array_free(names, nnames);
+    elog(ERROR, "at least one dimension must be kept");
+  }
+
+  nschema = pc_schema_projection_from_pcid(patch->schema, names, nnames, pcid,
+                                           fcinfo);
+  pc_cstring_array_free(names, nnames);
+
+  context = pc_patch_expanded_context();
+  oldcontext = MemoryContextSwitchTo(context);
+  paout = pc_patch_project(patch, nschema);
+  MemoryContextSwitchTo(oldcontext);
+
+  pc_patch_freearg(fcinfo, 0, patch);
+
+  if (!paout)
+  {
+    MemoryContextDelete(context);
+    PG_RETURN_NULL();
+  }
+
+  PG_RETURN_DATUM(pc_patch_expanded_datum(paout, context));
+}
+
+/**
+ * PC_Affine(patch pcpatch, matrix float8[]) returns pcpatch
+ * Apply a 3x4 or 4x4 affine matrix, given row by row, to the X, Y and Z
+ * dimensions. The other dimensions are left as they are.
+ */
+PG_FUNCTION_INFO_V1(pcpatch_affine);
+Datum pcpatch_affine(PG_FUNCTION_ARGS)
+{
+  ArrayType *array = PG_GETARG_ARRAYTYPE_P(1);
+  PCPATCH *patch, *paout;
+  MemoryContext context, oldcontext;
+  float8 *m;
+  int nelems;
+
+  nelems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+  if (ARR_ELEMTYPE(array) != FLOAT8OID || ARR_HASNULL(array) ||
+      (nelems != 12 && nelems != 16))
+    elog(ERROR, "matrix must be a float8[] of 12 or 16 non-null values");
+
+  m = (float8 *)ARR_DATA_PTR(array);
+  if (nelems == 16 && (m[12] != 0 || m[13] != 0 || m[14] != 0 || m[15] != 1))
+    elog(ERROR, "the last row of a 4x4 matrix must be 0, 0, 0, 1");
+
+  patch = pc_patch_getarg(fcinfo, 0);
+
+  context = pc_patch_expanded_context();
+  oldcontext = MemoryContextSwitchTo(context);
+  paout = pc_patch_affine(patch, m);
+  MemoryContextSwitchTo(oldcontext);
+
+  pc_patch_freearg(fcinfo, 0, patch);
+
+  if (!paout)
+  {
+    MemoryContextDelete(context);
+    PG_RETURN_NULL();
+  }
+
+  PG_RETURN_DATUM(pc_patch_expanded_datum(paout, context));
 }
@@ -0,0 +1,170 @@
+/***********************************************************************
+ * pc_expanded.c
+ *
+ *  Expanded pcpatch: a deserialized PCPATCH handed from function to
+ *  function, so that nested calls like PC_Filter*(PC_Transform(...))
+ *  neither serialize nor deserialize their intermediate patches. The
+ *  patch is only serialized when it is stored or output.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_pgsql.h"
+
+#include "utils/expandeddatum.h"
+#include "utils/memutils.h"
+
+#define PC_EXPANDED_MAGIC 0x50435041 /* PCPA */
+
+typedef struct
+{
+  ExpandedObjectHeader hdr;
+  int magic;
+  /* Allocated in the object context along with all its buffers */
+  PCPATCH *patch;
+  /* Serialization of the patch, made once when it is first needed */
+  SERIALIZED_PATCH *flat;
+} PCPATCH_EXPANDED;
+
+static Size pc_patch_expanded_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+  PCPATCH_EXPANDED *eph = (PCPATCH_EXPANDED *)eohptr;
+  MemoryContext oldcontext;
+
+  Assert(eph->magic == PC_EXPANDED_MAGIC);
+  if (!eph->flat)
+  {
+    oldcontext = MemoryContextSwitchTo(eph->hdr.eoh_context);
+    eph->flat = pc_patch_serialize(eph->patch, NULL);
+    MemoryContextSwitchTo(oldcontext);
+    if (!eph->flat)
+      elog(ERROR, "failed to serialize patch");
+  }
+  return VARSIZE(eph->flat);
+}
+
+static void pc_patch_expanded_flatten_into(ExpandedObjectHeader *eohptr,
+                                           void *result, Size allocated_size)
+{
+  PCPATCH_EXPANDED *eph = (PCPATCH_EXPANDED *)eohptr;
+
+  Assert(eph->flat && allocated_size == VARSIZE(eph->flat));
+  memcpy(result, eph->flat, allocated_size);
+}
+
+static const ExpandedObjectMethods pc_patch_expanded_methods = {
+    pc_patch_expanded_get_flat_size, pc_patch_expanded_flatten_into};
+
+MemoryContext pc_patch_expanded_context(void)
+{
+  return AllocSetContextCreate(CurrentMemoryContext, "expanded pcpatch",
+                               ALLOCSET_DEFAULT_SIZES);
+}
+
+Datum pc_patch_expanded_datum(PCPATCH *patch, MemoryContext context)
+{
+  PCPATCH_EXPANDED *eph;
+
+  eph = MemoryContextAlloc(context, sizeof(PCPATCH_EXPANDED));
+  EOH_init_header(&eph->hdr, &pc_patch_expanded_methods, context);
+  eph->magic = PC_EXPANDED_MAGIC;
+  eph->patch = patch;
+  eph->flat = NULL;
+  return EOHPGetRWDatum(&eph->hdr);
+}
+
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_getarg(FunctionCallInfoData *fcinfo, int argno)
+#else
+PCPATCH *pc_patch_getarg(FunctionCallInfo fcinfo, int argno)
+#endif
+{
+  Datum d = PG_GETARG_DATUM(argno);
+  SERIALIZED_PATCH *serpatch;
+  PCPATCH *patch;
+
+  if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d)))
+  {
+    PCPATCH_EXPANDED *eph = (PCPATCH_EXPANDED *)DatumGetEOHP(d);
+    Assert(eph->magic == PC_EXPANDED_MAGIC);
+    return eph->patch;
+  }
+
+  patch = pc_patch_cache_get(fcinfo, (struct varlena *)DatumGetPointer(d));
+  if (patch)
+    return patch;
+
+  serpatch = (SERIALIZED_PATCH *)PG_DETOAST_DATUM(d);
+  patch =
+      pc_patch_deserialize(serpatch, pc_schema_from_pcid(serpatch->pcid, fcinfo));
+  if (!patch)
+    elog(ERROR, "failed to deserialize patch");
+  return patch;
+}
+
+#if PGSQL_VERSION < 120
+void pc_patch_freearg(FunctionCallInfoData *fcinfo, int argno, PCPATCH *patch)
+#else
+void pc_patch_freearg(FunctionCallInfo fcinfo, int argno, PCPATCH *patch)
+#endif
+{
+  /* The patch of an expanded argument belongs to it, cached ones to the
+   * cache */
+  if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(PG_GETARG_DATUM(argno))))
+    return;
+  if (!pc_patch_cache_release(patch))
+    pc_patch_free(patch);
+}
+
+#if PGSQL_VERSION < 120
+const PCSCHEMA *pc_patch_getarg_schema(FunctionCallInfoData *fcinfo, int argno,
+                                       bool *directory)
+#else
+const PCSCHEMA *pc_patch_getarg_schema(FunctionCallInfo fcinfo, int argno,
+                                       bool *directory)
+#endif
+{
+  SERIALIZED_PATCH *serpatch;
+
+  if (VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(PG_GETARG_DATUM(argno))))
+  {
+    *directory = false;
+    return pc_patch_getarg(fcinfo, argno)->schema;
+  }
+
+  serpatch = PG_GETHEADER_SERPATCH_P(argno);
+  *directory = SERPATCH_COMPRESSION(serpatch) == PC_DIMENSIONAL &&
+               SERPATCH_VERSION(serpatch) >= 1;
+  return pc_schema_from_pcid(serpatch->pcid, fcinfo);
+}
+
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_getarg_dims(FunctionCallInfoData *fcinfo, int argno,
+                              const PCSCHEMA *schema, bool directory,
+                              const PCDIMENSION **dims, int ndims)
+#else
+PCPATCH *pc_patch_getarg_dims(FunctionCallInfo fcinfo, int argno,
+                              const PCSCHEMA *schema, bool directory,
+                              const PCDIMENSION **dims, int ndims)
+#endif
+{
+  struct varlena *ptr;
+  PCPATCH *patch;
+
+  ptr = (struct varlena *)DatumGetPointer(PG_GETARG_DATUM(argno));
+
+  /* Fetch the dimensions alone, unless the patch has no directory of them or
+   * the query decoded it already */
+  if (directory && VARATT_IS_EXTERNAL_ONDISK(ptr) &&
+      !pc_patch_cache_has(fcinfo, ptr))
+  {
+    patch = pc_patch_deserialize_dimensions(PointerGetDatum(ptr), schema, dims,
+                                            ndims);
+    if (patch)
+      return patch;
+  }
+  return pc_patch_getarg(fcinfo, argno);
+}
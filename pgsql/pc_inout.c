@@ -13,11 +13,19 @@
 
 #include "pc_pgsql.h" /* Common PgSQL support for our type */
 
+#include "commands/trigger.h"
+#include "libpq/pqformat.h"
+#include "utils/inval.h"
+
 /* In/out functions */
 Datum pcpoint_in(PG_FUNCTION_ARGS);
 Datum pcpoint_out(PG_FUNCTION_ARGS);
 Datum pcpatch_in(PG_FUNCTION_ARGS);
 Datum pcpatch_out(PG_FUNCTION_ARGS);
+Datum pcpoint_send(PG_FUNCTION_ARGS);
+Datum pcpoint_recv(PG_FUNCTION_ARGS);
+Datum pcpatch_send(PG_FUNCTION_ARGS);
+Datum pcpatch_recv(PG_FUNCTION_ARGS);
 
 /* Typmod support */
 Datum pc_typmod_in(PG_FUNCTION_ARGS);
@@ -29,6 +37,7 @@ Datum pcpoint_enforce_typmod(PG_FUNCTION_ARGS);
 /* Other SQL functions */
 Datum pcschema_is_valid(PG_FUNCTION_ARGS);
 Datum pcschema_get_ndims(PG_FUNCTION_ARGS);
+Datum pcschema_invalidate(PG_FUNCTION_ARGS);
 Datum pcpoint_from_double_array(PG_FUNCTION_ARGS);
 Datum pcpoint_as_text(PG_FUNCTION_ARGS);
 Datum pcpatch_as_text(PG_FUNCTION_ARGS);
@@ -166,6 +175,113 @@ Datum pcpatch_out(PG_FUNCTION_ARGS)
   PG_RETURN_CSTRING(hexwkb);
 }
 
+/* Return WKB bytes as a bytea, for the binary output functions */
+static bytea *pc_wkb_to_bytea(uint8 *bytes, size_t bytes_size)
+{
+  size_t wkb_size = VARHDRSZ + bytes_size;
+  bytea *wkb = palloc(wkb_size);
+  memcpy(VARDATA(wkb), bytes, bytes_size);
+  SET_VARSIZE(wkb, wkb_size);
+  pfree(bytes);
+  return wkb;
+}
+
+/*
+ * Read the pcid of the WKB remaining in a binary input buffer, checking it
+ * against the column typmod as the text input functions do
+ */
+static uint32 pc_wkb_recv_pcid(StringInfo buf, size_t hdrsz, int32 typmod)
+{
+  uint32 pcid;
+
+  if ((size_t)(buf->len - buf->cursor) < hdrsz)
+    ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                    errmsg("insufficient data for point cloud wkb")));
+
+  pcid = pc_wkb_get_pcid((uint8 *)(buf->data + buf->cursor));
+  if (!pcid)
+    ereport(ERROR, (errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+                    errmsg("point cloud wkb pcid is zero")));
+
+  pcid_consistent(pcid, pcid_from_typmod(typmod));
+
+  return pcid;
+}
+
+PG_FUNCTION_INFO_V1(pcpoint_send);
+Datum pcpoint_send(PG_FUNCTION_ARGS)
+{
+  SERIALIZED_POINT *serpt = PG_GETARG_SERPOINT_P(0);
+  PCSCHEMA *schema = pc_schema_from_pcid(serpt->pcid, fcinfo);
+  PCPOINT *pt = pc_point_deserialize(serpt, schema);
+  uint8 *bytes;
+  size_t bytes_size;
+
+  bytes = pc_point_to_wkb(pt, &bytes_size);
+  pc_point_free(pt);
+  PG_RETURN_BYTEA_P(pc_wkb_to_bytea(bytes, bytes_size));
+}
+
+PG_FUNCTION_INFO_V1(pcpoint_recv);
+Datum pcpoint_recv(PG_FUNCTION_ARGS)
+{
+  StringInfo buf = (StringInfo)PG_GETARG_POINTER(0);
+  int32 typmod = (PG_NARGS() > 2 && !PG_ARGISNULL(2)) ? PG_GETARG_INT32(2) : -1;
+  uint32 pcid = pc_wkb_recv_pcid(buf, 1 + 4, typmod);
+  PCSCHEMA *schema = pc_schema_from_pcid(pcid, fcinfo);
+  SERIALIZED_POINT *serpt;
+  PCPOINT *pt;
+  size_t wkblen;
+  uint8 *wkb;
+
+  if (!schema)
+    elog(ERROR, "%s: unable to look up schema entry", __func__);
+
+  wkblen = buf->len - buf->cursor;
+  wkb = (uint8 *)pq_getmsgbytes(buf, wkblen);
+  pt = pc_point_from_wkb(schema, wkb, wkblen);
+  serpt = pc_point_serialize(pt);
+  pc_point_free(pt);
+  PG_RETURN_POINTER(serpt);
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_send);
+Datum pcpatch_send(PG_FUNCTION_ARGS)
+{
+  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
+  PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
+  PCPATCH *patch = pc_patch_deserialize(serpatch, schema);
+  uint8 *bytes;
+  size_t bytes_size;
+
+  bytes = pc_patch_to_wkb(patch, &bytes_size);
+  pc_patch_free(patch);
+  PG_RETURN_BYTEA_P(pc_wkb_to_bytea(bytes, bytes_size));
+}
+
+PG_FUNCTION_INFO_V1(pcpatch_recv);
+Datum pcpatch_recv(PG_FUNCTION_ARGS)
+{
+  StringInfo buf = (StringInfo)PG_GETARG_POINTER(0);
+  int32 typmod = (PG_NARGS() > 2 && !PG_ARGISNULL(2)) ? PG_GETARG_INT32(2) : -1;
+  uint32 pcid = pc_wkb_recv_pcid(buf, 1 + 4 + 4, typmod);
+  PCSCHEMA *schema = pc_schema_from_pcid(pcid, fcinfo);
+  SERIALIZED_PATCH *serpatch;
+  PCPATCH *patch;
+  size_t wkblen;
+  uint8 *wkb;
+
+  if (!schema)
+    elog(ERROR, "%s: unable to look up schema entry", __func__);
+
+  wkblen = buf->len - buf->cursor;
+  wkb = (uint8 *)pq_getmsgbytes(buf, wkblen);
+  patch = pc_patch_from_wkb(schema, wkb, wkblen);
+  serpatch = pc_patch_serialize(patch, NULL);
+  pc_patch_free(patch);
+  PG_RETURN_POINTER(serpatch);
+}
+
 PG_FUNCTION_INFO_V1(pcschema_is_valid);
 Datum pcschema_is_valid(PG_FUNCTION_ARGS)
 {
@@ -199,6 +315,24 @@ Datum pcschema_get_ndims(PG_FUNCTION_ARGS)
   PG_RETURN_INT32(ndims);
 }
 
+/**
+ * Trigger on pointcloud_formats. Invalidating the relcache entry of the
+ * table makes every backend drop its cached schemas once the change is
+ * committed, and this backend right away.
+ */
+PG_FUNCTION_INFO_V1(pcschema_invalidate);
+Datum pcschema_invalidate(PG_FUNCTION_ARGS)
+{
+  TriggerData *trigdata = (TriggerData *)fcinfo->context;
+
+  if (!CALLED_AS_TRIGGER(fcinfo))
+    elog(ERROR, "%s: not called by trigger manager", __func__);
+
+  CacheInvalidateRelcache(trigdata->tg_relation);
+  pc_shmem_schemas_changed();
+  PG_RETURN_POINTER(NULL);
+}
+
 /**
  * pcpoint_from_double_array(integer pcid, float8[] returns PcPoint
  */
@@ -259,16 +393,12 @@ Datum pcpoint_as_text(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(pcpatch_as_text);
 Datum pcpatch_as_text(PG_FUNCTION_ARGS)
 {
-  SERIALIZED_PATCH *serpatch = PG_GETARG_SERPATCH_P(0);
+  PCPATCH *patch = pc_patch_getarg(fcinfo, 0);
   text *txt;
   char *str;
-  PCSCHEMA *schema = pc_schema_from_pcid(serpatch->pcid, fcinfo);
-  PCPATCH *patch = pc_patch_deserialize(serpatch, schema);
-  if (!patch)
-    PG_RETURN_NULL();
 
   str = pc_patch_to_string(patch);
-  pc_patch_free(patch);
+  pc_patch_freearg(fcinfo, 0, patch);
   txt = cstring_to_text(str);
   pfree(str);
   PG_RETURN_TEXT_P(txt);
@@ -16,6 +16,7 @@
 #include "access/heapam.h"
 #include "access/htup_details.h"
 #include "access/sysattr.h"
+#include "access/xact.h"
 
 #include "catalog/indexing.h"
 #include "catalog/namespace.h"
@@ -27,6 +28,7 @@
 
 #include "utils/fmgroids.h"
 #include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
 #include "utils/regproc.h"
@@ -217,6 +219,8 @@ static void pgsql_info(const char *fmt, va_list ap)
   pgsql_msg_handler(NOTICE, fmt, ap);
 }
 
+static void pc_schema_cache_invalidate(Datum arg, Oid relid);
+
 /**********************************************************************************
  * POINTCLOUD START-UP/SHUT-DOWN CALLBACKS
  */
@@ -232,6 +236,9 @@ void _PG_init(void)
   elog(LOG, "Pointcloud (%s) module loaded", POINTCLOUD_VERSION);
   pc_set_handlers(pgsql_alloc, pgsql_realloc, pgsql_free, pgsql_error,
                   pgsql_info, pgsql_warn);
+  CacheRegisterRelcacheCallback(pc_schema_cache_invalidate, (Datum)0);
+  pc_shmem_init();
+  pc_patch_cache_init();
 }
 
 /* Module unload callback */
@@ -408,6 +415,7 @@ PCSCHEMA *pc_schema_from_pcid_uncached(uint32 pcid)
 
   /* Build the schema object */
   schema = pc_schema_from_xml(xml);
+  pfree(xml);
 
   if (!schema)
   {
@@ -422,6 +430,150 @@ PCSCHEMA *pc_schema_from_pcid_uncached(uint32 pcid)
   return schema;
 }
 
+/**
+ * Backend-wide schema cache, so that parsing the XML of a pcid happens
+ * once per backend rather than once per call site. It is dropped when
+ * pointcloud_formats changes, which its trigger signals by invalidating
+ * the relcache entry of the table.
+ *
+ * A REPEATABLE READ or SERIALIZABLE transaction reads the table through its
+ * own snapshot, which may predate a change whose invalidation it already
+ * processed. Its schemas are kept for the transaction only.
+ */
+typedef struct
+{
+  uint32 pcid; /* Hash key, must be first */
+  PCSCHEMA *schema;
+} SchemaHashEntry;
+
+static HTAB *pc_schema_hash = NULL;
+static MemoryContext pc_schema_context = NULL;
+static Oid pc_formats_relid = InvalidOid;
+static bool pc_schema_hash_valid = false;
+static bool pc_schema_hash_xact = false;
+static uint32 pc_schema_generation = 0;
+
+static void pc_schema_cache_invalidate(Datum arg, Oid relid)
+{
+  /* Only flag the cache, the callback must not do catalog accesses */
+  if (relid == InvalidOid || relid == pc_formats_relid ||
+      pc_formats_relid == InvalidOid)
+    pc_schema_hash_valid = false;
+
+  /* Also covers the changes committed by COMMIT PREPARED */
+  if (relid == InvalidOid ||
+      (pc_formats_relid != InvalidOid && relid == pc_formats_relid))
+    pc_shmem_formats_invalidated();
+}
+
+/* The transaction of a snapshot-isolated cache is over */
+static void pc_schema_cache_xact_end(void *arg)
+{
+  if (pc_schema_context == arg)
+  {
+    pc_schema_context = NULL;
+    pc_schema_hash = NULL;
+    pc_schema_hash_valid = false;
+  }
+}
+
+static void pc_schema_cache_reset(bool xact)
+{
+  HASHCTL ctl;
+  Oid nsp_oid;
+
+  /*
+   * Schemas handed out before the invalidation may still be in use by the
+   * running statement, so they are only released with the transaction.
+   */
+  if (pc_schema_context && !pc_schema_hash_xact)
+    MemoryContextSetParent(pc_schema_context, TopTransactionContext);
+
+  pc_schema_context = AllocSetContextCreate(
+      xact ? TopTransactionContext : CacheMemoryContext,
+      "Pointcloud Schema Context", ALLOCSET_SMALL_SIZES);
+  pc_schema_hash_xact = xact;
+  if (xact)
+  {
+    MemoryContextCallback *cb =
+        MemoryContextAlloc(pc_schema_context, sizeof(MemoryContextCallback));
+    cb->func = pc_schema_cache_xact_end;
+    cb->arg = pc_schema_context;
+    MemoryContextRegisterResetCallback(pc_schema_context, cb);
+  }
+
+  memset(&ctl, 0, sizeof(ctl));
+  ctl.keysize = sizeof(uint32);
+  ctl.entrysize = sizeof(SchemaHashEntry);
+  ctl.hcxt = pc_schema_context;
+  pc_schema_hash = hash_create("Pointcloud Schema Hash", 16, &ctl,
+                               HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+
+  nsp_oid = get_namespace_oid(pc_constants_cache->schema, true);
+  pc_formats_relid = OidIsValid(nsp_oid)
+                         ? get_relname_relid(pc_constants_cache->formats, nsp_oid)
+                         : InvalidOid;
+
+  pc_schema_hash_valid = true;
+  pc_schema_generation++;
+}
+
+PCSCHEMA *pc_schema_from_pcid_backend(uint32 pcid)
+{
+  SchemaHashEntry *entry;
+  PCSCHEMA *schema;
+  MemoryContext context, oldcontext;
+  bool found;
+  bool xact = IsolationUsesXactSnapshot();
+
+  pointcloud_init_constants_cache();
+  if (!pc_schema_hash_valid || pc_schema_hash_xact != xact)
+    pc_schema_cache_reset(xact);
+
+  entry = hash_search(pc_schema_hash, &pcid, HASH_FIND, NULL);
+  if (entry)
+    return entry->schema;
+
+  /* Load in a context of our own, so a failure does not leak in the cache */
+  context = AllocSetContextCreate(CurrentMemoryContext, "Pointcloud Schema",
+                                  ALLOCSET_SMALL_SIZES);
+  oldcontext = MemoryContextSwitchTo(context);
+  if (pc_shmem_enabled())
+  {
+    /* Read the generation before the table, see pc_shmem.c */
+    uint32 generation = pc_shmem_generation();
+
+    schema = pc_shmem_schema_get(pcid, generation);
+    if (!schema)
+    {
+      elog(DEBUG1, "shared schema miss, use pc_schema_from_pcid_uncached");
+      schema = pc_schema_from_pcid_uncached(pcid);
+      if (schema)
+        pc_shmem_schema_put(schema, generation);
+    }
+  }
+  else
+  {
+    elog(DEBUG1, "schema cache miss, use pc_schema_from_pcid_uncached");
+
+    /* Not in there, load one the old-fashioned way. */
+    schema = pc_schema_from_pcid_uncached(pcid);
+  }
+  MemoryContextSwitchTo(oldcontext);
+
+  /* Failed to load the XML? Odd. */
+  if (!schema)
+  {
+    ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
+                    errmsg("unable to load schema for pcid %u", pcid)));
+  }
+
+  MemoryContextSetParent(context, pc_schema_context);
+  entry = hash_search(pc_schema_hash, &pcid, HASH_ENTER, &found);
+  entry->schema = schema;
+  return schema;
+}
+
 /**
  * Hold the schema references in a list.
  * We'll just search them linearly, because
@@ -429,11 +581,23 @@ PCSCHEMA *pc_schema_from_pcid_uncached(uint32 pcid)
  */
 #define SchemaCacheSize 16
 
+/**
+ * Transform plans between the cached schemas, usually a
+ * statement transforms patches of one pcid into one other.
+ */
+#define TransformCacheSize 4
+
 typedef struct
 {
+  uint32 generation; /* Of the backend cache the schemas come from */
   int next_slot;
   int pcids[SchemaCacheSize];
   PCSCHEMA *schemas[SchemaCacheSize];
+  int next_transform;
+  PCTRANSFORM *transforms[TransformCacheSize];
+  uint32 projected_pcid; /* Last pcid derived for a projection */
+  uint32 projected_from;
+  char *projected_names;
 } SchemaCache;
 
 /**
@@ -449,12 +613,29 @@ GetSchemaCache(FunctionCallInfo fcinfo)
 #endif
 {
   SchemaCache *cache = fcinfo->flinfo->fn_extra;
+  int i;
+
   if (!cache)
   {
     cache = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(SchemaCache));
     memset(cache, 0, sizeof(SchemaCache));
+    cache->generation = pc_schema_generation;
     fcinfo->flinfo->fn_extra = cache;
   }
+
+  /* Forget the schemas of an invalidated backend cache */
+  if (!pc_schema_hash_valid || cache->generation != pc_schema_generation)
+  {
+    for (i = 0; i < TransformCacheSize; i++)
+    {
+      if (cache->transforms[i])
+        pc_transform_free(cache->transforms[i]);
+    }
+    if (cache->projected_names)
+      pfree(cache->projected_names);
+    memset(cache, 0, sizeof(SchemaCache));
+    cache->generation = pc_schema_generation;
+  }
   return cache;
 }
 
@@ -468,7 +649,6 @@ pc_schema_from_pcid(uint32 pcid, FunctionCallInfo fcinfo)
   SchemaCache *schema_cache = GetSchemaCache(fcinfo);
   int i;
   PCSCHEMA *schema;
-  MemoryContext oldcontext;
 
   /* Unable to find/make a schema cache? Odd. */
   if (!schema_cache)
@@ -487,26 +667,200 @@ pc_schema_from_pcid(uint32 pcid, FunctionCallInfo fcinfo)
     }
   }
 
-  elog(DEBUG1, "schema cache miss, use pc_schema_from_pcid_uncached");
+  /* Not in there, ask the backend cache */
+  schema = pc_schema_from_pcid_backend(pcid);
+
+  /* Reloading the backend cache invalidates the statement cache too */
+  if (schema_cache->generation != pc_schema_generation)
+    schema_cache = GetSchemaCache(fcinfo);
+
+  /* Save the schema in the next unused slot */
+  schema_cache->schemas[schema_cache->next_slot] = schema;
+  schema_cache->pcids[schema_cache->next_slot] = pcid;
+  schema_cache->next_slot = (schema_cache->next_slot + 1) % SchemaCacheSize;
+  return schema;
+}
 
-  /* Not in there, load one the old-fashioned way. */
+PCTRANSFORM *
+#if PGSQL_VERSION < 120
+pc_transform_from_pcids(uint32 opcid, uint32 npcid, double def, int rescale,
+                        FunctionCallInfoData *fcinfo)
+#else
+pc_transform_from_pcids(uint32 opcid, uint32 npcid, double def, int rescale,
+                        FunctionCallInfo fcinfo)
+#endif
+{
+  PCSCHEMA *oschema = pc_schema_from_pcid(opcid, fcinfo);
+  PCSCHEMA *nschema = pc_schema_from_pcid(npcid, fcinfo);
+  SchemaCache *schema_cache = GetSchemaCache(fcinfo);
+  PCTRANSFORM *plan;
+  MemoryContext oldcontext;
+  int i;
+
+  /* Plans refer to the cached schemas, so compare those */
+  for (i = 0; i < TransformCacheSize; i++)
+  {
+    plan = schema_cache->transforms[i];
+    if (plan && plan->oschema == oschema && plan->nschema == nschema &&
+        plan->def == def && plan->rescale == rescale)
+    {
+      return plan;
+    }
+  }
+
+  /* Compile the plan for the lifetime of the schemas */
   oldcontext = MemoryContextSwitchTo(fcinfo->flinfo->fn_mcxt);
-  pointcloud_init_constants_cache();
-  schema = pc_schema_from_pcid_uncached(pcid);
+  plan = pc_transform_make(oschema, nschema, def, rescale);
   MemoryContextSwitchTo(oldcontext);
 
-  /* Failed to load the XML? Odd. */
-  if (!schema)
+  if (!plan)
+    return NULL;
+
+  /* Replace the plan in the next slot */
+  i = schema_cache->next_transform;
+  if (schema_cache->transforms[i])
+    pc_transform_free(schema_cache->transforms[i]);
+  schema_cache->transforms[i] = plan;
+  schema_cache->next_transform = (i + 1) % TransformCacheSize;
+  return plan;
+}
+
+/* True if the schema holds exactly the named dimensions, in that order */
+static bool pc_schema_has_dimensions(const PCSCHEMA *schema,
+                                     const char **names, int nnames)
+{
+  int i;
+
+  if (schema->ndims != nnames)
+    return false;
+  for (i = 0; i < nnames; i++)
   {
-    ereport(ERROR, (errcode(ERRCODE_INTERNAL_ERROR),
-                    errmsg("unable to load schema for pcid %u", pcid)));
+    if (strcasecmp(schema->dims[i]->name, names[i]) != 0)
+      return false;
   }
+  return true;
+}
 
-  /* Save the XML in the next unused slot */
-  schema_cache->schemas[schema_cache->next_slot] = schema;
-  schema_cache->pcids[schema_cache->next_slot] = pcid;
-  schema_cache->next_slot = (schema_cache->next_slot + 1) % SchemaCacheSize;
-  return schema;
+/* Pcids of the formats of a srid, in pcid order */
+static uint32 *pc_pcids_from_srid(uint32 srid, int *npcids)
+{
+  char sql[256];
+  char *formats;
+  uint32 *pcids;
+  int err, i;
+
+  if (SPI_OK_CONNECT != SPI_connect())
+  {
+    elog(ERROR, "%s: could not connect to SPI manager", __func__);
+    return NULL;
+  }
+
+  formats = quote_qualified_identifier(pc_constants_cache->schema,
+                                       pc_constants_cache->formats);
+  sprintf(sql, "select pcid from %s where %s = %u order by pcid", formats,
+          pc_constants_cache->formats_srid, srid);
+  err = SPI_exec(sql, 0);
+
+  if (err < 0)
+  {
+    elog(ERROR, "%s: error (%d) executing query: %s", __func__, err, sql);
+    return NULL;
+  }
+
+  /* Copy result to upper executor context */
+  *npcids = SPI_processed;
+  pcids = SPI_palloc((SPI_processed + 1) * sizeof(uint32));
+  for (i = 0; i < *npcids; i++)
+  {
+    bool isnull;
+    Datum d = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1,
+                            &isnull);
+    pcids[i] = isnull ? 0 : DatumGetInt32(d);
+  }
+
+  SPI_finish();
+  return pcids;
+}
+
+PCSCHEMA *
+#if PGSQL_VERSION < 120
+pc_schema_projection_from_pcid(const PCSCHEMA *schema, const char **names,
+                               int nnames, uint32 pcid,
+                               FunctionCallInfoData *fcinfo)
+#else
+pc_schema_projection_from_pcid(const PCSCHEMA *schema, const char **names,
+                               int nnames, uint32 pcid,
+                               FunctionCallInfo fcinfo)
+#endif
+{
+  SchemaCache *schema_cache = GetSchemaCache(fcinfo);
+  PCSCHEMA *nschema = NULL;
+  StringInfoData key;
+  uint32 *pcids;
+  int i, npcids;
+
+  /* A provided pcid must hold the named dimensions */
+  if (pcid)
+  {
+    nschema = pc_schema_from_pcid(pcid, fcinfo);
+    if (!pc_schema_has_dimensions(nschema, names, nnames) ||
+        !pc_schema_is_projection(schema, nschema))
+    {
+      ereport(ERROR,
+              (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+               errmsg("schema of pcid %u is not a projection of pcid %u on "
+                      "the requested dimensions",
+                      pcid, schema->pcid)));
+    }
+    return nschema;
+  }
+
+  /* Usually every call derives the same pcid */
+  initStringInfo(&key);
+  for (i = 0; i < nnames; i++)
+    appendStringInfo(&key, "%s\n", names[i]);
+
+  if (schema_cache->projected_names &&
+      schema_cache->projected_from == schema->pcid &&
+      strcmp(schema_cache->projected_names, key.data) == 0)
+  {
+    pfree(key.data);
+    return pc_schema_from_pcid(schema_cache->projected_pcid, fcinfo);
+  }
+
+  /* Otherwise look for the first format holding the named dimensions */
+  pointcloud_init_constants_cache();
+  pcids = pc_pcids_from_srid(schema->srid, &npcids);
+  for (i = 0; i < npcids; i++)
+  {
+    if (!pcids[i])
+      continue;
+    nschema = pc_schema_from_pcid(pcids[i], fcinfo);
+    if (pc_schema_has_dimensions(nschema, names, nnames) &&
+        pc_schema_is_projection(schema, nschema))
+      break;
+  }
+  pfree(pcids);
+
+  if (i == npcids)
+  {
+    ereport(ERROR,
+            (errcode(ERRCODE_UNDEFINED_OBJECT),
+             errmsg("no entry in \"pointcloud_formats\" holds the requested "
+                    "dimensions of pcid %u",
+                    schema->pcid),
+             errhint("Add a format with these dimensions, or pass its pcid.")));
+  }
+
+  if (schema_cache->projected_names)
+    pfree(schema_cache->projected_names);
+  schema_cache->projected_names =
+      MemoryContextStrdup(fcinfo->flinfo->fn_mcxt, key.data);
+  schema_cache->projected_from = schema->pcid;
+  schema_cache->projected_pcid = nschema->pcid;
+  pfree(key.data);
+
+  return nschema;
 }
 
 /**********************************************************************************
@@ -554,7 +908,9 @@ size_t pc_patch_serialized_size(const PCPATCH *patch)
   }
   case PC_DIMENSIONAL:
   {
-    return common_size + stats_size +
+    size_t directory_size =
+        patch->schema->ndims * sizeof(SERIALIZED_DIMENSION);
+    return common_size + stats_size + directory_size +
            pc_patch_dimensional_serialized_size((PCPATCH_DIMENSIONAL *)patch);
   }
   case PC_LAZPERF:
@@ -585,6 +941,20 @@ static size_t pc_patch_stats_serialize(uint8_t *buf, const PCSCHEMA *schema,
   return sz * 3;
 }
 
+/* Size of the point counts of the levels of detail, if any */
+static size_t pc_patch_lod_size(const uint32_t *counts)
+{
+  return counts ? PC_LOD_NLEVELS * sizeof(uint32_t) : 0;
+}
+
+/* The point counts of the levels of detail go right after the stats */
+static size_t pc_patch_lod_serialize(uint8_t *buf, const uint32_t *counts)
+{
+  if (counts)
+    memcpy(buf, counts, pc_patch_lod_size(counts));
+  return pc_patch_lod_size(counts);
+}
+
 /**
  * Stats are always three PCPOINT serializations in a row,
  * min, max, avg. Their size is the uncompressed buffer size for
@@ -600,7 +970,8 @@ PCSTATS *pc_patch_stats_deserialize(const PCSCHEMA *schema, const uint8_t *buf)
   return pc_stats_new_from_data(schema, buf_min, buf_max, buf_avg);
 }
 
-static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in)
+static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in,
+                                                        const uint32_t *counts)
 {
   //  uint32_t size;
   //  uint32_t pcid;
@@ -609,11 +980,14 @@ static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in)
   //  double xmin, xmax, ymin, ymax;
   //  data:
   //    pcpoint[3] stats;
+  //    uint32_t[PC_LOD_NLEVELS] level counts; (if PC_SERIALIZED_LOD)
+  //    serialized_dimension[ndims] directory;
   //    serialized_pcbytes[ndims] dimensions;
 
   int i;
-  uint8_t *buf;
-  size_t serpch_size = pc_patch_serialized_size(patch_in);
+  uint8_t *buf, *directory;
+  size_t serpch_size =
+      pc_patch_serialized_size(patch_in) + pc_patch_lod_size(counts);
   SERIALIZED_PATCH *serpch = pcalloc(serpch_size);
   const PCPATCH_DIMENSIONAL *patch = (PCPATCH_DIMENSIONAL *)patch_in;
 
@@ -624,7 +998,9 @@ static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in)
   serpch->pcid = patch->schema->pcid;
   serpch->npoints = patch->npoints;
   serpch->bounds = patch->bounds;
-  serpch->compression = patch->type;
+  serpch->compression = patch->type | (PC_SERIALIZED_VERSION << 16);
+  if (counts)
+    serpch->compression |= PC_SERIALIZED_LOD << 16;
 
   /* Get a pointer to the data area */
   buf = serpch->data;
@@ -638,13 +1014,24 @@ static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in)
   {
     pcerror("%s: stats missing!", __func__);
   }
+  buf += pc_patch_lod_serialize(buf, counts);
+
+  /* Leave room for the directory */
+  directory = buf;
+  buf += patch->schema->ndims * sizeof(SERIALIZED_DIMENSION);
 
-  /* Write each dimension in after the stats */
+  /* Write each dimension in after the directory, and where it is in it */
   for (i = 0; i < patch->schema->ndims; i++)
   {
+    SERIALIZED_DIMENSION entry;
     size_t bsize = 0;
     PCBYTES *pcb = &(patch->bytes[i]);
     pc_bytes_serialize(pcb, buf, &bsize);
+    entry.offset = buf - serpch->data;
+    entry.size = bsize;
+    entry.compression = pcb->compression;
+    memcpy(directory + i * sizeof(SERIALIZED_DIMENSION), &entry,
+           sizeof(SERIALIZED_DIMENSION));
     buf += bsize;
   }
 
@@ -652,9 +1039,11 @@ static SERIALIZED_PATCH *pc_patch_dimensional_serialize(const PCPATCH *patch_in)
   return serpch;
 }
 
-static SERIALIZED_PATCH *pc_patch_lazperf_serialize(const PCPATCH *patch_in)
+static SERIALIZED_PATCH *pc_patch_lazperf_serialize(const PCPATCH *patch_in,
+                                                    const uint32_t *counts)
 {
-  size_t serpch_size = pc_patch_serialized_size(patch_in);
+  size_t serpch_size =
+      pc_patch_serialized_size(patch_in) + pc_patch_lod_size(counts);
   SERIALIZED_PATCH *serpch = pcalloc(serpch_size);
   const PCPATCH_LAZPERF *patch = (PCPATCH_LAZPERF *)patch_in;
   uint32_t lazsize = patch->lazperfsize;
@@ -668,6 +1057,8 @@ static SERIALIZED_PATCH *pc_patch_lazperf_serialize(const PCPATCH *patch_in)
   serpch->npoints = patch->npoints;
   serpch->bounds = patch->bounds;
   serpch->compression = patch->type;
+  if (counts)
+    serpch->compression |= PC_SERIALIZED_LOD << 16;
 
   /* Write stats into the buffer first */
   if (patch->stats)
@@ -678,6 +1069,7 @@ static SERIALIZED_PATCH *pc_patch_lazperf_serialize(const PCPATCH *patch_in)
   {
     pcerror("%s: stats missing!", __func__);
   }
+  buf += pc_patch_lod_serialize(buf, counts);
 
   /* Write buffer size */
   memcpy(buf, &(lazsize), 4);
@@ -691,7 +1083,7 @@ static SERIALIZED_PATCH *pc_patch_lazperf_serialize(const PCPATCH *patch_in)
 }
 
 static SERIALIZED_PATCH *
-pc_patch_uncompressed_serialize(const PCPATCH *patch_in)
+pc_patch_uncompressed_serialize(const PCPATCH *patch_in, const uint32_t *counts)
 {
   //  uint32_t size;
   //  uint32_t pcid;
@@ -699,6 +1091,8 @@ pc_patch_uncompressed_serialize(const PCPATCH *patch_in)
   //  uint32_t npoints;
   //  double xmin, xmax, ymin, ymax;
   //  data:
+  //    pcpoint[3] stats;
+  //    uint32_t[PC_LOD_NLEVELS] level counts; (if PC_SERIALIZED_LOD)
   //    pcpoint [];
 
   uint8_t *buf;
@@ -706,11 +1100,13 @@ pc_patch_uncompressed_serialize(const PCPATCH *patch_in)
   SERIALIZED_PATCH *serpch;
   const PCPATCH_UNCOMPRESSED *patch = (PCPATCH_UNCOMPRESSED *)patch_in;
 
-  serpch_size = pc_patch_serialized_size(patch_in);
+  serpch_size = pc_patch_serialized_size(patch_in) + pc_patch_lod_size(counts);
   serpch = pcalloc(serpch_size);
 
   /* Copy basic */
   serpch->compression = patch->type;
+  if (counts)
+    serpch->compression |= PC_SERIALIZED_LOD << 16;
   serpch->pcid = patch->schema->pcid;
   serpch->npoints = patch->npoints;
   serpch->bounds = patch->bounds;
@@ -725,6 +1121,7 @@ pc_patch_uncompressed_serialize(const PCPATCH *patch_in)
   {
     pcerror("%s: stats missing!", __func__);
   }
+  buf += pc_patch_lod_serialize(buf, counts);
 
   /* Copy point list into data buffer */
   memcpy(buf, patch->data, patch->datasize);
@@ -738,6 +1135,17 @@ pc_patch_uncompressed_serialize(const PCPATCH *patch_in)
  * a number of iterations and saved.
  */
 SERIALIZED_PATCH *pc_patch_serialize(const PCPATCH *patch_in, void *userdata)
+{
+  return pc_patch_serialize_lod(patch_in, userdata, NULL);
+}
+
+/**
+ * Convert struct to byte array, with the point counts of the levels of
+ * detail when the patch was sorted by level of detail.
+ */
+SERIALIZED_PATCH *pc_patch_serialize_lod(const PCPATCH *patch_in,
+                                         void *userdata,
+                                         const uint32_t *counts)
 {
   PCPATCH *patch = (PCPATCH *)patch_in;
   SERIALIZED_PATCH *serpatch = NULL;
@@ -762,17 +1170,17 @@ SERIALIZED_PATCH *pc_patch_serialize(const PCPATCH *patch_in, void *userdata)
   {
   case PC_NONE:
   {
-    serpatch = pc_patch_uncompressed_serialize(patch);
+    serpatch = pc_patch_uncompressed_serialize(patch, counts);
     break;
   }
   case PC_DIMENSIONAL:
   {
-    serpatch = pc_patch_dimensional_serialize(patch);
+    serpatch = pc_patch_dimensional_serialize(patch, counts);
     break;
   }
   case PC_LAZPERF:
   {
-    serpatch = pc_patch_lazperf_serialize(patch);
+    serpatch = pc_patch_lazperf_serialize(patch, counts);
     break;
   }
   default:
@@ -792,7 +1200,8 @@ SERIALIZED_PATCH *pc_patch_serialize(const PCPATCH *patch_in, void *userdata)
  * Userdata is currently only PCDIMSTATS, hopefully updated across
  * a number of iterations and saved.
  */
-SERIALIZED_PATCH *pc_patch_serialize_to_uncompressed(const PCPATCH *patch_in)
+SERIALIZED_PATCH *pc_patch_serialize_to_uncompressed(const PCPATCH *patch_in,
+                                                     const uint32_t *counts)
 {
   PCPATCH *patch = (PCPATCH *)patch_in;
   SERIALIZED_PATCH *serpatch;
@@ -803,7 +1212,7 @@ SERIALIZED_PATCH *pc_patch_serialize_to_uncompressed(const PCPATCH *patch_in)
     patch = pc_patch_uncompress(patch_in);
   }
 
-  serpatch = pc_patch_uncompressed_serialize(patch);
+  serpatch = pc_patch_uncompressed_serialize(patch, counts);
 
   /* An uncompressed input won't result in a copy */
   if (patch != patch_in)
@@ -825,16 +1234,17 @@ pc_patch_uncompressed_deserialize(const SERIALIZED_PATCH *serpatch,
   //  double xmin, xmax, ymin, ymax;
   //  data:
   //    pcpoint[3] pcstats(min, max, avg)
+  //    uint32_t[PC_LOD_NLEVELS] level counts; (if PC_SERIALIZED_LOD)
   //    pcpoint[npoints]
   // }
   // SERIALIZED_PATCH;
 
   uint8_t *buf;
-  size_t stats_size = pc_stats_size(schema); // 3 pcpoints worth of stats
+  size_t header_size = SERPATCH_HEADER_SIZE(serpatch, schema);
   PCPATCH_UNCOMPRESSED *patch = pcalloc(sizeof(PCPATCH_UNCOMPRESSED));
 
   /* Set up basic info */
-  patch->type = serpatch->compression;
+  patch->type = SERPATCH_COMPRESSION(serpatch);
   patch->schema = schema;
   patch->readonly = true;
   patch->npoints = serpatch->npoints;
@@ -846,12 +1256,12 @@ pc_patch_uncompressed_deserialize(const SERIALIZED_PATCH *serpatch,
   /* Point into the stats area */
   patch->stats = pc_patch_stats_deserialize(schema, buf);
 
-  /* Advance data pointer past the stats serialization */
-  patch->data = buf + stats_size;
+  /* Advance data pointer past the stats and level counts */
+  patch->data = buf + header_size;
 
   /* Calculate the point data buffer size */
   patch->datasize = VARSIZE(serpatch) - BUFFERALIGN(sizeof(SERIALIZED_PATCH)) +
-                    1 - stats_size;
+                    1 - header_size;
   if (patch->datasize != patch->npoints * schema->size)
     pcerror("%s: calculated patch data sizes don't match (%d != %d)", __func__,
             patch->datasize, patch->npoints * schema->size);
@@ -872,6 +1282,8 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch,
   //  double xmin, xmax, ymin, ymax;
   //  data:
   //    pcpoint[3] pcstats(min, max, avg)
+  //    uint32_t[PC_LOD_NLEVELS] level counts; (if PC_SERIALIZED_LOD)
+  //    serialized_dimension[ndims]; (from version 1)
   //    pcbytes[ndims];
   // }
   // SERIALIZED_PATCH;
@@ -881,13 +1293,13 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch,
   const uint8_t *buf;
   int ndims = schema->ndims;
   int npoints = serpatch->npoints;
-  size_t stats_size = pc_stats_size(schema); // 3 pcpoints worth of stats
+  size_t header_size = SERPATCH_HEADER_SIZE(serpatch, schema);
 
   /* Reference the external data */
   patch = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
 
   /* Set up basic info */
-  patch->type = serpatch->compression;
+  patch->type = SERPATCH_COMPRESSION(serpatch);
   patch->schema = schema;
   patch->readonly = true;
   patch->npoints = npoints;
@@ -896,9 +1308,11 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch,
   /* Point into the stats area */
   patch->stats = pc_patch_stats_deserialize(schema, serpatch->data);
 
-  /* Set up dimensions */
+  /* Set up dimensions, which follow each other after the directory */
   patch->bytes = pcalloc(ndims * sizeof(PCBYTES));
-  buf = serpatch->data + stats_size;
+  buf = serpatch->data + header_size;
+  if (SERPATCH_VERSION(serpatch) >= 1)
+    buf += ndims * sizeof(SERIALIZED_DIMENSION);
 
   for (i = 0; i < ndims; i++)
   {
@@ -916,7 +1330,8 @@ pc_patch_dimensional_deserialize(const SERIALIZED_PATCH *serpatch,
 /*
  * We don't do any radical deserialization here. Don't build out the tree, just
  * set up pointers to the start of the buffer, so we can build it out later
- * if necessary.
+ * if necessary. Like the other compressions, the patch references the
+ * serialized buffer without copying it.
  */
 static PCPATCH *pc_patch_lazperf_deserialize(const SERIALIZED_PATCH *serpatch,
                                              const PCSCHEMA *schema)
@@ -924,14 +1339,14 @@ static PCPATCH *pc_patch_lazperf_deserialize(const SERIALIZED_PATCH *serpatch,
   PCPATCH_LAZPERF *patch;
   uint32_t lazperfsize;
   int npoints = serpatch->npoints;
-  size_t stats_size = pc_stats_size(schema);
-  uint8_t *buf = (uint8_t *)serpatch->data + stats_size;
+  uint8_t *buf =
+      (uint8_t *)serpatch->data + SERPATCH_HEADER_SIZE(serpatch, schema);
 
   /* Reference the external data */
   patch = pcalloc(sizeof(PCPATCH_LAZPERF));
 
   /* Set up basic info */
-  patch->type = serpatch->compression;
+  patch->type = SERPATCH_COMPRESSION(serpatch);
   patch->schema = schema;
   patch->readonly = true;
   patch->npoints = npoints;
@@ -945,8 +1360,8 @@ static PCPATCH *pc_patch_lazperf_deserialize(const SERIALIZED_PATCH *serpatch,
   patch->lazperfsize = lazperfsize;
   buf += 4;
 
-  patch->lazperf = pcalloc(patch->lazperfsize);
-  memcpy(patch->lazperf, buf, patch->lazperfsize);
+  /* Read-only reference to the buffer of the serialization */
+  patch->lazperf = buf;
 
   return (PCPATCH *)patch;
 }
@@ -954,7 +1369,7 @@ static PCPATCH *pc_patch_lazperf_deserialize(const SERIALIZED_PATCH *serpatch,
 PCPATCH *pc_patch_deserialize(const SERIALIZED_PATCH *serpatch,
                               const PCSCHEMA *schema)
 {
-  switch (serpatch->compression)
+  switch (SERPATCH_COMPRESSION(serpatch))
   {
   case PC_NONE:
     return pc_patch_uncompressed_deserialize(serpatch, schema);
@@ -967,6 +1382,84 @@ PCPATCH *pc_patch_deserialize(const SERIALIZED_PATCH *serpatch,
   return NULL;
 }
 
+int pc_patch_serialized_lod(const SERIALIZED_PATCH *serpatch,
+                            const PCSCHEMA *schema, uint32_t *counts)
+{
+  if (!SERPATCH_HAS_LOD(serpatch))
+    return PC_FALSE;
+
+  /* Not aligned after the stats */
+  memcpy(counts, serpatch->data + pc_stats_size(schema),
+         PC_LOD_NLEVELS * sizeof(uint32_t));
+  return PC_TRUE;
+}
+
+PCPATCH *pc_patch_deserialize_dimensions(Datum d, const PCSCHEMA *schema,
+                                         const PCDIMENSION **dims, int ndims)
+{
+  /* Offset of the data area in the slices, which do not count the size */
+  size_t data_offset = offsetof(SERIALIZED_PATCH, data) - VARHDRSZ;
+  size_t header_size;
+  SERIALIZED_PATCH *serpatch;
+  PCPATCH_DIMENSIONAL *patch;
+  int i;
+
+  /* Enough for the level counts too, if any */
+  serpatch = (SERIALIZED_PATCH *)PG_DETOAST_DATUM_SLICE(
+      d, 0,
+      data_offset + pc_stats_size(schema) +
+          PC_LOD_NLEVELS * sizeof(uint32_t) +
+          schema->ndims * sizeof(SERIALIZED_DIMENSION));
+  if (SERPATCH_COMPRESSION(serpatch) != PC_DIMENSIONAL ||
+      SERPATCH_VERSION(serpatch) < 1)
+  {
+    pfree(serpatch);
+    return NULL;
+  }
+  header_size = SERPATCH_HEADER_SIZE(serpatch, schema);
+
+  patch = pcalloc(sizeof(PCPATCH_DIMENSIONAL));
+  patch->type = PC_DIMENSIONAL;
+  patch->schema = schema;
+  patch->readonly = true;
+  patch->npoints = serpatch->npoints;
+  patch->bounds = serpatch->bounds;
+  patch->stats = pc_patch_stats_deserialize(schema, serpatch->data);
+
+  /* The dimensions not asked for stay empty */
+  patch->bytes = pcalloc(schema->ndims * sizeof(PCBYTES));
+  for (i = 0; i < schema->ndims; i++)
+  {
+    patch->bytes[i].readonly = true;
+    patch->bytes[i].interpretation = schema->dims[i]->interpretation;
+  }
+
+  for (i = 0; i < ndims; i++)
+  {
+    const PCDIMENSION *dim = dims[i];
+    PCBYTES *pcb = &(patch->bytes[dim->position]);
+    SERIALIZED_DIMENSION entry;
+    struct varlena *slice;
+
+    if (pcb->bytes)
+      continue;
+
+    memcpy(&entry,
+           serpatch->data + header_size +
+               dim->position * sizeof(SERIALIZED_DIMENSION),
+           sizeof(SERIALIZED_DIMENSION));
+    slice = PG_DETOAST_DATUM_SLICE(d, data_offset + entry.offset, entry.size);
+    if (VARSIZE(slice) - VARHDRSZ != entry.size)
+      elog(ERROR, "dimension \"%s\" is out of the patch", dim->name);
+
+    pc_bytes_deserialize((uint8_t *)VARDATA(slice), dim, pcb,
+                         true /*readonly*/, false /*flipendian*/);
+    pcb->npoints = patch->npoints;
+  }
+
+  return (PCPATCH *)patch;
+}
+
 static uint8_t *pc_patch_wkb_set_double(uint8_t *wkb, double d)
 {
   memcpy(wkb, &d, 8);
@@ -85,6 +85,36 @@ typedef struct
   uint8_t data[1];
 } SERIALIZED_PATCH;
 
+/**
+ * The high bits of the compression of a SERIALIZED_PATCH hold the version
+ * of its layout. From version 1 on, dimensional patches have a directory
+ * of their dimensions between the stats and the dimensions, so that a
+ * dimension can be fetched from TOAST without the rest of the patch.
+ *
+ * A patch sorted by level of detail has the PC_SERIALIZED_LOD flag in the
+ * version bits, and the PC_LOD_NLEVELS point counts of its levels right
+ * after the stats, so that its coarse levels can be found from the header.
+ */
+#define PC_SERIALIZED_VERSION 1
+#define PC_SERIALIZED_LOD 0x8000
+#define SERPATCH_COMPRESSION(serpatch) ((serpatch)->compression & 0xFFFF)
+#define SERPATCH_VERSION(serpatch) (((serpatch)->compression >> 16) & 0x7FFF)
+#define SERPATCH_HAS_LOD(serpatch)                                             \
+  (((serpatch)->compression >> 16) & PC_SERIALIZED_LOD)
+
+/* Size of the stats and level counts in front of the data of a patch */
+#define SERPATCH_HEADER_SIZE(serpatch, schema)                                 \
+  (pc_stats_size(schema) +                                                     \
+   (SERPATCH_HAS_LOD(serpatch) ? PC_LOD_NLEVELS * sizeof(uint32_t) : 0))
+
+/** Directory entry of a dimension, in a dimensional SERIALIZED_PATCH */
+typedef struct
+{
+  uint32_t offset; /* Of the serialized PCBYTES, from the start of data */
+  uint32_t size;   /* Of the serialized PCBYTES */
+  uint32_t compression;
+} SERIALIZED_DIMENSION;
+
 /* PGSQL / POINTCLOUD UTILITY FUNCTIONS */
 uint32 pcid_from_typmod(const int32 typmod);
 
@@ -100,6 +130,72 @@ PCSCHEMA *pc_schema_from_pcid(uint32_t pcid, FunctionCallInfo fcinfo);
  * from the XML therein */
 PCSCHEMA *pc_schema_from_pcid_uncached(uint32 pcid);
 
+/** Get the schema of the PCID from the backend-wide cache, loading it from
+ * the POINTCLOUD_FORMATS table on a miss */
+PCSCHEMA *pc_schema_from_pcid_backend(uint32 pcid);
+
+/** Set up the shared registry of schemas, when preloaded */
+void pc_shmem_init(void);
+/** True if schemas can be looked up in the shared registry */
+bool pc_shmem_enabled(void);
+/** Generation of pointcloud_formats to read the shared registry at */
+uint32 pc_shmem_generation(void);
+/** Copy a schema out of the shared registry, NULL if it is not there */
+PCSCHEMA *pc_shmem_schema_get(uint32 pcid, uint32 generation);
+/** Share a schema read at the given generation */
+void pc_shmem_schema_put(const PCSCHEMA *schema, uint32 generation);
+/** Skip the shared registry until the end of the changing transaction */
+void pc_shmem_schemas_changed(void);
+/** Outdate the shared registry, pointcloud_formats changed elsewhere */
+void pc_shmem_formats_invalidated(void);
+
+/** Set up the per-query cache of decoded patches */
+void pc_patch_cache_init(void);
+/** Decoded patch of a toasted pcpatch from the cache of the query, NULL
+ * when it cannot be cached. Release it with pc_patch_cache_release */
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_cache_get(FunctionCallInfoData *fcinfo, struct varlena *ptr);
+#else
+PCPATCH *pc_patch_cache_get(FunctionCallInfo fcinfo, struct varlena *ptr);
+#endif
+/** True if the toasted pcpatch is decoded in the cache of the query */
+#if PGSQL_VERSION < 120
+bool pc_patch_cache_has(FunctionCallInfoData *fcinfo, struct varlena *ptr);
+#else
+bool pc_patch_cache_has(FunctionCallInfo fcinfo, struct varlena *ptr);
+#endif
+/** Give back a patch of the cache, false if it is not one of them */
+bool pc_patch_cache_release(const PCPATCH *patch);
+
+/** Get the plan transforming patches of opcid into patches of npcid, compiled
+ * once per statement */
+#if PGSQL_VERSION < 120
+PCTRANSFORM *pc_transform_from_pcids(uint32 opcid, uint32 npcid, double def,
+                                     int rescale, FunctionCallInfoData *fcinfo);
+#else
+PCTRANSFORM *pc_transform_from_pcids(uint32 opcid, uint32 npcid, double def,
+                                     int rescale, FunctionCallInfo fcinfo);
+#endif
+
+/** Get the schema of pcid, checking it holds exactly the named dimensions of
+ * schema, or derive it from POINTCLOUD_FORMATS when pcid is 0 */
+#if PGSQL_VERSION < 120
+PCSCHEMA *pc_schema_projection_from_pcid(const PCSCHEMA *schema,
+                                         const char **names, int nnames,
+                                         uint32 pcid,
+                                         FunctionCallInfoData *fcinfo);
+#else
+PCSCHEMA *pc_schema_projection_from_pcid(const PCSCHEMA *schema,
+                                         const char **names, int nnames,
+                                         uint32 pcid, FunctionCallInfo fcinfo);
+#endif
+
+/** Convert a text[] into an array of C strings, skipping NULL elements */
+const char **array_to_cstring_array(ArrayType *array, int *size);
+
+/** Free an array of C strings */
+void pc_cstring_array_free(const char **array, int nelems);
+
 /** Turn a PCPOINT into a byte buffer suitable for saving in PgSQL */
 SERIALIZED_POINT *pc_point_serialize(const PCPOINT *pcpt);
 
@@ -124,13 +220,31 @@ size_t pc_patch_serialized_size(const PCPATCH *patch);
 /** Turn a PCPATCH into a byte buffer suitable for saving in PgSQL */
 SERIALIZED_PATCH *pc_patch_serialize(const PCPATCH *patch, void *userdata);
 
-/** Turn a PCPATCH into an uncompressed byte buffer */
-SERIALIZED_PATCH *pc_patch_serialize_to_uncompressed(const PCPATCH *patch);
+/** Turn a PCPATCH sorted by level of detail into a byte buffer, with the
+ * point counts of its levels when counts is not NULL */
+SERIALIZED_PATCH *pc_patch_serialize_lod(const PCPATCH *patch, void *userdata,
+                                         const uint32_t *counts);
+
+/** Turn a PCPATCH into an uncompressed byte buffer, with the point counts of
+ * its levels of detail when counts is not NULL */
+SERIALIZED_PATCH *pc_patch_serialize_to_uncompressed(const PCPATCH *patch,
+                                                     const uint32_t *counts);
+
+/** Read the point counts of the levels of detail of a patch, PC_FALSE if it
+ * was not sorted by level of detail */
+int pc_patch_serialized_lod(const SERIALIZED_PATCH *serpatch,
+                            const PCSCHEMA *schema, uint32_t *counts);
 
 /** Turn a byte buffer into a PCPATCH for processing */
 PCPATCH *pc_patch_deserialize(const SERIALIZED_PATCH *serpatch,
                               const PCSCHEMA *schema);
 
+/** Read some dimensions of a toasted dimensional patch, fetching their bytes
+ * alone. The other dimensions are left empty. NULL if the patch has no
+ * directory of its dimensions */
+PCPATCH *pc_patch_deserialize_dimensions(Datum d, const PCSCHEMA *schema,
+                                         const PCDIMENSION **dims, int ndims);
+
 /** Create a new readwrite PCPATCH from a hex string */
 #if PGSQL_VERSION < 120
 PCPATCH *pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen,
@@ -143,6 +257,47 @@ PCPATCH *pc_patch_from_hexwkb(const char *hexwkb, size_t hexlen,
 /** Create a hex representation of a PCPOINT */
 char *pc_patch_to_hexwkb(const PCPATCH *patch);
 
+/** Memory context of a new expanded patch, to build its patch in */
+MemoryContext pc_patch_expanded_context(void);
+
+/** Wrap a patch built in the context into an expanded pcpatch datum, which
+ * owns the context */
+Datum pc_patch_expanded_datum(PCPATCH *patch, MemoryContext context);
+
+/** Patch of a pcpatch argument, read from an expanded argument without
+ * deserializing it, or from the query cache for toasted ones. Release it
+ * with pc_patch_freearg */
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_getarg(FunctionCallInfoData *fcinfo, int argno);
+void pc_patch_freearg(FunctionCallInfoData *fcinfo, int argno, PCPATCH *patch);
+#else
+PCPATCH *pc_patch_getarg(FunctionCallInfo fcinfo, int argno);
+void pc_patch_freearg(FunctionCallInfo fcinfo, int argno, PCPATCH *patch);
+#endif
+
+/** Schema of a pcpatch argument, read from its header alone. Directory is
+ * set when the patch is stored with a directory of its dimensions */
+#if PGSQL_VERSION < 120
+const PCSCHEMA *pc_patch_getarg_schema(FunctionCallInfoData *fcinfo, int argno,
+                                       bool *directory);
+#else
+const PCSCHEMA *pc_patch_getarg_schema(FunctionCallInfo fcinfo, int argno,
+                                       bool *directory);
+#endif
+
+/** Patch of a pcpatch argument of the schema, to read the given dimensions
+ * of, the others may be left empty. Directory comes from
+ * pc_patch_getarg_schema. Release it with pc_patch_freearg */
+#if PGSQL_VERSION < 120
+PCPATCH *pc_patch_getarg_dims(FunctionCallInfoData *fcinfo, int argno,
+                              const PCSCHEMA *schema, bool directory,
+                              const PCDIMENSION **dims, int ndims);
+#else
+PCPATCH *pc_patch_getarg_dims(FunctionCallInfo fcinfo, int argno,
+                              const PCSCHEMA *schema, bool directory,
+                              const PCDIMENSION **dims, int ndims);
+#endif
+
 /** Returns OGC WKB for envelope of PCPATCH */
 uint8_t *pc_patch_to_geometry_wkb_envelope(const SERIALIZED_PATCH *pa,
                                            const PCSCHEMA *schema,
@@ -0,0 +1,283 @@
+/***********************************************************************
+ * pc_shmem.c
+ *
+ *  Shared memory registry of the schemas of pointcloud_formats, used
+ *  when the module is in shared_preload_libraries. Backends find the
+ *  compact binary form of a schema there instead of parsing its XML.
+ *
+ *  PgSQL Pointcloud is free and open source software provided
+ *  by the Government of Canada
+ *  Copyright (c) 2013 Natural Resources Canada
+ *
+ ***********************************************************************/
+
+#include "pc_pgsql.h"
+
+#include "access/xact.h"
+#include "miscadmin.h"
+#include "port/atomics.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+
+/* How many schemas the registry holds at most */
+#define PC_SHMEM_MAXSCHEMAS 256
+
+typedef struct
+{
+  Oid dbid; /* Every database has its own pointcloud_formats */
+  uint32 pcid;
+  Size offset; /* Of the schema bytes in the arena */
+  Size size;
+} PCSHMEMENTRY;
+
+typedef struct
+{
+  LWLock *lock;
+  /* Bumped after every committed change of pointcloud_formats */
+  pg_atomic_uint32 generation;
+  /* Generation the entries were read at, entries of older ones are stale */
+  uint32 entries_generation;
+  int nentries;
+  PCSHMEMENTRY entries[PC_SHMEM_MAXSCHEMAS];
+  Size arena_used;
+  Size arena_size;
+  char arena[FLEXIBLE_ARRAY_MEMBER];
+} PCSHMEM;
+
+static PCSHMEM *pc_shmem = NULL;
+
+/* Size of the schema arena, in kB, 0 disables the registry */
+static int pc_shmem_schemas_kb = 1024;
+
+/* Set when this transaction changes pointcloud_formats */
+static bool pc_shmem_bypass = false;
+
+#if PGSQL_VERSION >= 150
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+static Size pc_shmem_size(void)
+{
+  return add_size(offsetof(PCSHMEM, arena),
+                  mul_size(pc_shmem_schemas_kb, 1024));
+}
+
+static void pc_shmem_request(void)
+{
+#if PGSQL_VERSION >= 150
+  if (prev_shmem_request_hook)
+    prev_shmem_request_hook();
+#endif
+  RequestAddinShmemSpace(pc_shmem_size());
+  RequestNamedLWLockTranche("pointcloud", 1);
+}
+
+static void pc_shmem_startup(void)
+{
+  bool found;
+
+  if (prev_shmem_startup_hook)
+    prev_shmem_startup_hook();
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  pc_shmem = ShmemInitStruct("pointcloud schemas", pc_shmem_size(), &found);
+  if (!found)
+  {
+    pc_shmem->lock = &(GetNamedLWLockTranche("pointcloud"))->lock;
+    pg_atomic_init_u32(&pc_shmem->generation, 1);
+    pc_shmem->entries_generation = 0;
+    pc_shmem->nentries = 0;
+    pc_shmem->arena_used = 0;
+    pc_shmem->arena_size = (Size)pc_shmem_schemas_kb * 1024;
+  }
+  LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * Publish the changes of pointcloud_formats once they are visible to the
+ * other backends. A backend registers a schema only if the generation did
+ * not move while it read the table, so a schema read through a snapshot
+ * taken before the commit is not shared under the new generation.
+ *
+ * A prepared transaction commits later, from another session, so nothing
+ * is published at PREPARE. The generation is bumped instead when the
+ * backends process the relcache invalidation of pointcloud_formats that
+ * COMMIT PREPARED sends, see pc_shmem_formats_invalidated.
+ */
+static void pc_shmem_xact_callback(XactEvent event, void *arg)
+{
+  if (!pc_shmem_bypass)
+    return;
+
+  switch (event)
+  {
+  case XACT_EVENT_COMMIT:
+  case XACT_EVENT_PARALLEL_COMMIT:
+    pg_atomic_fetch_add_u32(&pc_shmem->generation, 1);
+    pc_shmem_bypass = false;
+    break;
+  case XACT_EVENT_PREPARE:
+  case XACT_EVENT_ABORT:
+  case XACT_EVENT_PARALLEL_ABORT:
+    pc_shmem_bypass = false;
+    break;
+  default:
+    break;
+  }
+}
+
+void pc_shmem_init(void)
+{
+  if (!process_shared_preload_libraries_in_progress)
+    return;
+
+  DefineCustomIntVariable(
+      "pointcloud.shared_schemas_memory",
+      "Shared memory holding the parsed schemas of pointcloud_formats.",
+      "0 disables the shared registry of schemas.", &pc_shmem_schemas_kb,
+      1024, 0, MAX_KILOBYTES, PGC_POSTMASTER, GUC_UNIT_KB, NULL, NULL, NULL);
+
+  if (!pc_shmem_schemas_kb)
+    return;
+
+#if PGSQL_VERSION >= 150
+  prev_shmem_request_hook = shmem_request_hook;
+  shmem_request_hook = pc_shmem_request;
+#else
+  pc_shmem_request();
+#endif
+  prev_shmem_startup_hook = shmem_startup_hook;
+  shmem_startup_hook = pc_shmem_startup;
+
+  RegisterXactCallback(pc_shmem_xact_callback, NULL);
+}
+
+/*
+ * Transactions reading through their own snapshot may see an older
+ * pointcloud_formats than the registry, and must not register what they
+ * read under the current generation either: they keep to the table.
+ */
+bool pc_shmem_enabled(void)
+{
+  return pc_shmem && !pc_shmem_bypass && !IsolationUsesXactSnapshot();
+}
+
+uint32 pc_shmem_generation(void)
+{
+  /* Pairs with the increment done after the commit */
+  pg_memory_barrier();
+  return pg_atomic_read_u32(&pc_shmem->generation);
+}
+
+void pc_shmem_formats_invalidated(void)
+{
+  /* Extra bumps only cost a few registry misses */
+  if (pc_shmem)
+    pg_atomic_fetch_add_u32(&pc_shmem->generation, 1);
+}
+
+void pc_shmem_schemas_changed(void)
+{
+  /* Our uncommitted changes are not in the registry, skip it until the end
+   * of the transaction */
+  if (pc_shmem)
+    pc_shmem_bypass = true;
+}
+
+PCSCHEMA *pc_shmem_schema_get(uint32 pcid, uint32 generation)
+{
+  uint8 *bytes = NULL;
+  Size size = 0;
+  PCSCHEMA *schema;
+  int i;
+
+  LWLockAcquire(pc_shmem->lock, LW_SHARED);
+  if (pc_shmem->entries_generation == generation)
+  {
+    for (i = 0; i < pc_shmem->nentries; i++)
+    {
+      if (pc_shmem->entries[i].pcid == pcid &&
+          pc_shmem->entries[i].dbid == MyDatabaseId)
+      {
+        size = pc_shmem->entries[i].size;
+        bytes = palloc(size);
+        memcpy(bytes, pc_shmem->arena + pc_shmem->entries[i].offset, size);
+        break;
+      }
+    }
+  }
+  LWLockRelease(pc_shmem->lock);
+
+  if (!bytes)
+    return NULL;
+
+  schema = pc_schema_from_bytes(bytes, size);
+  pfree(bytes);
+  return schema;
+}
+
+/* Find room for a schema of the given generation, -1 if there is none */
+static int pc_shmem_entry_new(uint32 pcid, Size size, uint32 generation)
+{
+  int i;
+
+  /* The schema was read before a change, keep it to ourselves */
+  if (generation != pg_atomic_read_u32(&pc_shmem->generation))
+    return -1;
+
+  /* Drop the entries of a previous generation */
+  if (pc_shmem->entries_generation != generation)
+  {
+    pc_shmem->entries_generation = generation;
+    pc_shmem->nentries = 0;
+    pc_shmem->arena_used = 0;
+  }
+
+  /* Another backend may have been faster */
+  for (i = 0; i < pc_shmem->nentries; i++)
+  {
+    if (pc_shmem->entries[i].pcid == pcid &&
+        pc_shmem->entries[i].dbid == MyDatabaseId)
+      return -1;
+  }
+
+  if (pc_shmem->nentries == PC_SHMEM_MAXSCHEMAS ||
+      MAXALIGN(size) > pc_shmem->arena_size - pc_shmem->arena_used)
+  {
+    elog(DEBUG1, "no room left to share the schema of pcid %u", pcid);
+    return -1;
+  }
+
+  return pc_shmem->nentries++;
+}
+
+void pc_shmem_schema_put(const PCSCHEMA *schema, uint32 generation)
+{
+  PCSHMEMENTRY *entry;
+  uint8 *bytes;
+  size_t size;
+  int i;
+
+  bytes = pc_schema_to_bytes(schema, &size);
+  if (!bytes)
+    return;
+
+  LWLockAcquire(pc_shmem->lock, LW_EXCLUSIVE);
+  i = pc_shmem_entry_new(schema->pcid, size, generation);
+  if (i >= 0)
+  {
+    entry = pc_shmem->entries + i;
+    entry->dbid = MyDatabaseId;
+    entry->pcid = schema->pcid;
+    entry->offset = pc_shmem->arena_used;
+    entry->size = size;
+    memcpy(pc_shmem->arena + entry->offset, bytes, size);
+    pc_shmem->arena_used += MAXALIGN(size);
+  }
+  LWLockRelease(pc_shmem->lock);
+
+  pfree(bytes);
+}
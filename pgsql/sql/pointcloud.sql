@@ -323,6 +323,11 @@ SELECT PC_Get(PC_PatchAvg(pa)) FROM pa_test_dim order by 1 limit 1;
 SELECT PC_Summary(pa) summary FROM pa_test_dim order by 1 limit 1;
 
 
+-- binary output is the wkb of the text output
+SELECT count(*) FROM pt_test WHERE upper(encode(pcpoint_send(pt), 'hex')) <> pt::text;
+SELECT count(*) FROM pa_test WHERE upper(encode(pcpatch_send(pa), 'hex')) <> pa::text;
+SELECT count(*) FROM pa_test_dim WHERE upper(encode(pcpatch_send(pa), 'hex')) <> pa::text;
+
 --DROP TABLE pts_collection;
 DROP TABLE pt_test;
 DROP TABLE pa_test;
@@ -438,9 +443,249 @@ SELECT
   PC_AsText(PC_Transform(p, 10, 1.0)) t, PC_Summary(PC_Transform(p, 10, 1.0))::json->'compr' c
 FROM ( SELECT PC_Patch(PC_MakePoint(1, ARRAY[-1,0,4862413,1])) p ) foo;
 
+-- test PC_Project
+INSERT INTO pointcloud_formats (pcid, srid, schema)
+VALUES (5, 0, -- XYZ, scaled, dimensionally compressed
+'<?xml version="1.0" encoding="UTF-8"?>
+<pc:PointCloudSchema xmlns:pc="http://pointcloud.org/schemas/PC/1.1" xmlns:xsi="http://www.w3.org/2001/XMLSchema-instance">
+  <pc:dimension>
+    <pc:position>1</pc:position>
+    <pc:size>4</pc:size>
+    <pc:name>X</pc:name>
+    <pc:interpretation>int32_t</pc:interpretation>
+    <pc:scale>0.01</pc:scale>
+  </pc:dimension>
+  <pc:dimension>
+    <pc:position>2</pc:position>
+    <pc:size>4</pc:size>
+    <pc:name>Y</pc:name>
+    <pc:interpretation>int32_t</pc:interpretation>
+    <pc:scale>0.01</pc:scale>
+  </pc:dimension>
+  <pc:dimension>
+    <pc:position>3</pc:position>
+    <pc:size>4</pc:size>
+    <pc:name>Z</pc:name>
+    <pc:interpretation>int32_t</pc:interpretation>
+    <pc:scale>0.01</pc:scale>
+  </pc:dimension>
+  <pc:metadata>
+    <Metadata name="compression">dimensional</Metadata>
+  </pc:metadata>
+</pc:PointCloudSchema>'
+);
+-- derived pcid
+SELECT
+  PC_AsText(PC_Project(p, ARRAY['X','Y','Z'])) t,
+  PC_Summary(PC_Project(p, ARRAY['X','Y','Z']))::json->'compr' c
+FROM ( SELECT PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]) p ) foo;
+-- given pcid, dimensional patch
+SELECT
+  PC_AsText(PC_Project(p, ARRAY['X','Y','Z'], 5)) t,
+  PC_PatchMax(PC_Project(p, ARRAY['X','Y','Z'], 5), 'Z') zmax
+FROM ( SELECT PC_SetPCId(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]), 3) p ) foo;
+-- unscaled dimensions cannot be kept as they are
+SELECT PC_Project(PC_MakePatch(1, ARRAY[-1,0,5,1]), ARRAY['X','Y','Z'], 20);
+-- no format holds the requested dimensions
+SELECT PC_Project(PC_MakePatch(1, ARRAY[-1,0,5,1]), ARRAY['Z','X']);
+-- test PC_Affine
+SELECT
+  PC_AsText(PC_Affine(p, ARRAY[0,1,0,10, 1,0,0,20, 0,0,2,0.5]::float8[])) t,
+  PC_PatchMax(PC_Affine(p, ARRAY[0,1,0,10, 1,0,0,20, 0,0,2,0.5]::float8[]), 'Z') zmax
+FROM ( SELECT PC_SetPCId(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]), 3) p ) foo;
+SELECT PC_AsText(PC_Affine(PC_MakePatch(1, ARRAY[-1,0,5,1]),
+  ARRAY[[1,0,0,1],[0,1,0,2],[0,0,1,3],[0,0,0,1]]::float8[]));
+-- projective matrices are not supported
+SELECT PC_Affine(PC_MakePatch(1, ARRAY[-1,0,5,1]),
+  ARRAY[[1,0,0,1],[0,1,0,2],[0,0,1,3],[0,0,1,1]]::float8[]);
+SELECT PC_Affine(PC_MakePatch(1, ARRAY[-1,0,5,1]), ARRAY[1,0,0]::float8[]);
+-- chained functions pass their patches along deserialized
+SELECT PC_AsText(p) t, PC_NumPoints(p) n, PC_Summary(p)::json->'compr' c
+FROM ( SELECT PC_Sort(PC_FilterGreaterThan(PC_Affine(
+  PC_SetPCId(PC_MakePatch(1, ARRAY[-1,0,5,1, -2,0,6,3, 2,1,7,2]), 3),
+  ARRAY[-1,0,0,1, 0,1,0,2, 0,0,1,3]::float8[]), 'Z', 8.5), ARRAY['X']) p ) foo;
+-- test PC_AsArrow
+SELECT
+  substring(a from 1 for 4) = '\xffffffff'::bytea cont,
+  substring(a from length(a) - 7) = '\xffffffff00000000'::bytea eos
+FROM ( SELECT PC_AsArrow(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1])) a ) foo;
+SELECT length(PC_AsArrow(p)) raw, length(PC_AsArrow(p, true)) scaled
+FROM ( SELECT PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]) p ) foo;
+-- test PC_AsArrowAgg
+SELECT length(PC_AsArrowAgg(p)) raw, length(PC_AsArrowAgg(p, true)) scaled
+FROM ( VALUES
+  (PC_MakePatch(1, ARRAY[-1,0,5,1])),
+  (PC_MakePatch(1, ARRAY[-1,0,6,1]))
+) v(p);
+-- all patches of a stream share their format
+SELECT PC_AsArrowAgg(p)
+FROM ( VALUES
+  (PC_MakePatch(1, ARRAY[-1,0,5,1])),
+  (PC_SetPCId(PC_MakePatch(1, ARRAY[-1,0,6,1]), 3))
+) v(p);
+-- test PC_Get on patches
+SELECT PC_Get(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,2]), 'Z');
+SELECT PC_Get(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,2]), ARRAY['Intensity','x']);
+SELECT PC_GetRaw(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,2]), 'Z');
+-- only the requested dimensions of dimensional patches are decoded
+SELECT PC_GetRaw(PC_MakePatch(3, ARRAY[-1,0,5,1, -1,0,6,2]), ARRAY['Z','Intensity']);
+SELECT PC_Get(PC_MakePatch(1, ARRAY[-1,0,5,1]), ARRAY[]::text[]);
+SELECT PC_Get(PC_MakePatch(1, ARRAY[-1,0,5,1]), 'W');
+-- test PC_ExplodeColumns
+SELECT * FROM PC_ExplodeColumns(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,2]),
+  ARRAY['Z','Intensity']) AS t(z float8, i float8);
+SELECT x, y FROM PC_ExplodeColumns(PC_MakePatch(3, ARRAY[-1,0,5,1, -1,0.5,6,2]),
+  ARRAY['x','y']) AS t(x float8, y float8);
+SELECT * FROM PC_ExplodeColumns(PC_MakePatch(1, ARRAY[-1,0,5,1]),
+  ARRAY['Z','Intensity']) AS t(z float8);
+SELECT * FROM PC_ExplodeColumns(PC_MakePatch(1, ARRAY[-1,0,5,1]),
+  ARRAY['Z']) AS t(z int4);
+
 
 -- test PC_Patch from float8 array
 SELECT pc_astext(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1, -1,0,7,1]));
 
+-- test PC_Grid
+SELECT PC_Grid(PC_MakePatch(1, ARRAY[0.5,0.5,1,1, 1.5,0.5,2,1, 0.5,1.5,3,1, 0.5,1.6,5,1]), ARRAY[0,0], 1, 2, 2, 'z', 'max');
+
+-- test PC_GridAgg
+SELECT PC_GridAgg(p, ARRAY[0,0], 1, 2, 1, 'z', 'count')
+FROM ( VALUES
+  (PC_MakePatch(1, ARRAY[0.5,0.5,1,1, 1.5,0.5,2,1])),
+  (PC_MakePatch(1, ARRAY[0.5,0.5,3,1]))
+) v(p);
+
+-- test PC_VoxelFilter
+SELECT m, PC_AsText(PC_VoxelFilter(PC_MakePatch(1, ARRAY[0.5,0.5,0.2,1, 1.5,0.5,1,2, 0.5,1.5,1.5,3, 2.5,2.5,1,4]), 2, m)) t
+FROM unnest(ARRAY['first','centroid','closest']) m;
+-- the centroids are compressed like the schema
+SELECT m, PC_Compression(PC_VoxelFilter(PC_SetPCId(PC_MakePatch(1, ARRAY[0.5,0.5,0.2,1, 1.5,0.5,1,2, 0.5,1.5,1.5,3, 2.5,2.5,1,4]), 3), 2, m)) c
+FROM unnest(ARRAY['first','centroid','closest']) m;
+
+-- test PC_SortSpatial
+SELECT c, PC_AsText(PC_SortSpatial(PC_MakePatch(1, ARRAY[0.01,0.01,0,1, 0,0.01,0,2, 0.01,0,0,3, 0,0,0,4]), c)) t
+FROM unnest(ARRAY['morton','hilbert']) c;
+
+-- test PC_Compress with spatial sort
+SELECT PC_AsText(PC_Compress(PC_MakePatch(1, ARRAY[0.01,0.01,0,1, 0,0.01,0,2, 0.01,0,0,3, 0,0,0,4]), 'dimensional', 'spatialsort=hilbert,auto,rle')) t;
+
+-- test PC_LOD
+SELECT l, PC_AsText(PC_LOD(PC_SortSpatial(PC_MakePatch(1, ARRAY[0,0,0,1, 0.01,0,0,2, 0.02,0,0,3, 0,0.02,0,4, 0.02,0.02,0,5]), 'lod'), l)) t
+FROM generate_series(0, 2) l;
+
+-- the level counts are kept by PC_Compress
+SELECT l, PC_AsText(PC_LOD(PC_Compress(PC_MakePatch(1, ARRAY[0,0,0,1, 0.01,0,0,2, 0.02,0,0,3, 0,0.02,0,4, 0.02,0.02,0,5]), 'dimensional', 'spatialsort=lod'), l)) t
+FROM generate_series(0, 2) l;
+-- a patch not sorted by level of detail has no level counts
+SELECT PC_LOD(PC_MakePatch(1, ARRAY[0,0,0,1]), 0);
+
+-- test PC_Split
+SELECT m, PC_AsText(s) t
+FROM unnest(ARRAY['quadtree','kdtree']) m, PC_Split(PC_MakePatch(1, ARRAY[0.01,0.01,0,1, 0,0,0,2, 0,0.01,0,3, 0.01,0,0,4, 0.02,0.02,0,5]), 2, m) s;
+
+-- test PC_Retile
+SELECT tile_key, PC_AsText(pa) t
+FROM PC_Retile($$SELECT p FROM (VALUES
+  (PC_MakePatch(1, ARRAY[0,0,0,1, 0.03,0,0,2, 0.01,0.01,0,3])),
+  (PC_MakePatch(1, ARRAY[0.01,0,0,4, 0.03,0.01,0,5]))) v(p)$$, 0.02, 2);
+
+-- test PC_VoxelFilterAgg
+SELECT PC_AsText(PC_VoxelFilterAgg(p, 0.02))
+FROM (VALUES (PC_MakePatch(1, ARRAY[0,0,0,1, 0.03,0,0,2])),
+             (PC_MakePatch(1, ARRAY[0.01,0.01,0,3, 0.05,0,0,4]))) v(p);
+
+-- test PC_BuildOverviews and PC_RefreshOverviews
+CREATE TABLE ov_test (pa pcpatch(1));
+INSERT INTO ov_test (pa) VALUES (PC_MakePatch(1, ARRAY[0,0,0,1, 0.01,0,0,2, 0.03,0.03,0,3]));
+INSERT INTO ov_test (pa) VALUES (PC_MakePatch(1, ARRAY[0.02,0.01,0,4, 0.03,0,0,5]));
+SELECT PC_BuildOverviews('ov_test', 'pa', 2, 1);
+SELECT level, node, bounds, PC_NumPoints(pa) n FROM ov_test_overviews ORDER BY level, node;
+SELECT PC_RefreshOverviews('ov_test_overviews', PC_MakePatch(1, ARRAY[0.01,0.02,0,6]));
+SELECT level, node, bounds, PC_NumPoints(pa) n FROM ov_test_overviews ORDER BY level, node;
+SELECT DISTINCT levels, resolution FROM ov_test_overviews;
+DROP TABLE ov_test_overviews;
+DROP TABLE ov_test;
+-- toasted patches read by several expressions are decoded once
+CREATE TABLE cache_test (id int, pa pcpatch(1));
+ALTER TABLE cache_test ALTER COLUMN pa SET STORAGE EXTERNAL;
+INSERT INTO cache_test (id, pa)
+SELECT i / 1000, PC_Patch(PC_MakePoint(1, ARRAY[i * 0.01, 0, i * 0.01, i]))
+FROM generate_series(1, 1999) i GROUP BY i / 1000;
+SELECT PC_NumPoints(PC_FilterGreaterThan(pa, 'Z', 5)) gt,
+  PC_AsText(PC_FilterLessThan(pa, 'Z', 0.025)) lt,
+  PC_NumPoints(PC_FilterBetween(pa, 'Z', 1.005, 2.005)) btw
+FROM cache_test ORDER BY id;
+SET pointcloud.patch_cache_memory = '16kB';
+SELECT PC_NumPoints(PC_FilterGreaterThan(pa, 'Z', 5)) gt,
+  PC_AsText(PC_FilterLessThan(pa, 'Z', 0.025)) lt,
+  PC_NumPoints(PC_FilterBetween(pa, 'Z', 1.005, 2.005)) btw
+FROM cache_test ORDER BY id;
+SET pointcloud.patch_cache_memory = 0;
+SELECT PC_NumPoints(PC_FilterGreaterThan(pa, 'Z', 5)) gt,
+  PC_AsText(PC_FilterLessThan(pa, 'Z', 0.025)) lt,
+  PC_NumPoints(PC_FilterBetween(pa, 'Z', 1.005, 2.005)) btw
+FROM cache_test ORDER BY id;
+RESET pointcloud.patch_cache_memory;
+DROP TABLE cache_test;
+-- dimensions of toasted dimensional patches are fetched alone
+CREATE TABLE slice_test (pa pcpatch(3));
+ALTER TABLE slice_test ALTER COLUMN pa SET STORAGE EXTERNAL;
+INSERT INTO slice_test (pa)
+SELECT PC_Patch(PC_MakePoint(3, ARRAY[(i * 7919) % 10007 * 0.01,
+  (i * 104729) % 10009 * 0.01, i * 0.01, i % 7]))
+FROM generate_series(1, 4000) i;
+SELECT (PC_Get(pa, 'Z'))[1:3] z,
+  (SELECT sum(v) FROM unnest(PC_GetRaw(pa, 'Intensity')) v) isum,
+  PC_NumPoints(pa) n
+FROM slice_test;
+-- patches stored without the directory of dimensions are still read: drop
+-- the layout version and the 4 * 12 bytes of directory that follow the
+-- header and the 3 * 14 bytes of stats
+CREATE CAST (pcpatch AS bytea) WITHOUT FUNCTION;
+CREATE CAST (bytea AS pcpatch) WITHOUT FUNCTION;
+CREATE TABLE slice_test_v0 (pa pcpatch);
+ALTER TABLE slice_test_v0 ALTER COLUMN pa SET STORAGE EXTERNAL;
+INSERT INTO slice_test_v0 (pa)
+SELECT (substring(b FROM 1 FOR 4) || '\x01000000'::bytea ||
+  substring(b FROM 9 FOR 78) || substring(b FROM 135))::pcpatch
+FROM (SELECT pa::bytea b FROM slice_test) foo;
+SELECT (PC_Get(pa, 'Z'))[1:3] z,
+  (SELECT sum(v) FROM unnest(PC_GetRaw(pa, 'Intensity')) v) isum,
+  PC_NumPoints(pa) n,
+  (SELECT PC_MemSize(pa) FROM slice_test) - PC_MemSize(pa) dirsize
+FROM slice_test_v0;
+DROP TABLE slice_test_v0;
+DROP CAST (pcpatch AS bytea);
+DROP CAST (bytea AS pcpatch);
+DROP TABLE slice_test;
+-- binary COPY goes through the send and receive functions
+CREATE TABLE binary_test (pt pcpoint(1), pa pcpatch(1), pd pcpatch(3));
+INSERT INTO binary_test VALUES (PC_MakePoint(1, ARRAY[-1,0,5,1]),
+  PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]),
+  PC_SetPCId(PC_MakePatch(1, ARRAY[-1,0,5,1, -1,0,6,1]), 3));
+\copy binary_test TO 'results/binary_test.copy' (FORMAT binary)
+CREATE TABLE binary_test_in (LIKE binary_test);
+\copy binary_test_in FROM 'results/binary_test.copy' (FORMAT binary)
+SELECT PC_AsText(pt) pt, PC_AsText(pa) pa, PC_AsText(pd) pd,
+  PC_Compression(pd) c
+FROM binary_test_in;
+-- the pcid of the received values must match the column typmod
+\set VERBOSITY terse
+CREATE TABLE binary_test_typmod (pt pcpoint(3), pa pcpatch(1), pd pcpatch(3));
+\copy binary_test_typmod FROM 'results/binary_test.copy' (FORMAT binary)
+ALTER TABLE binary_test_typmod ALTER COLUMN pt TYPE pcpoint(1);
+ALTER TABLE binary_test_typmod ALTER COLUMN pd TYPE pcpatch(1);
+\copy binary_test_typmod FROM 'results/binary_test.copy' (FORMAT binary)
+\set VERBOSITY default
+DROP TABLE binary_test_typmod;
+DROP TABLE binary_test_in;
+DROP TABLE binary_test;
+-- the schema cache follows the changes of pointcloud_formats
+SELECT PC_SchemaGetNDims(5);
+UPDATE pointcloud_formats
+  SET schema = (SELECT schema FROM pointcloud_formats WHERE pcid = 1)
+  WHERE pcid = 5;
+SELECT PC_SchemaGetNDims(5);
+
 
 TRUNCATE pointcloud_formats;
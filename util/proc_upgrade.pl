@@ -8,7 +8,8 @@ eval "exec perl -w $0 $@"
 local $/;
 local $sql = <STDIN>;
 $sql =~ s/\nCREATE TYPE[^;]*;//gs;
-$sql =~ s/\nCREATE AGGREGATE[^;]*;//gs;
+# Aggregates cannot be replaced, only create the ones added since
+$sql =~ s/\nCREATE AGGREGATE\s+(\w+)\s*\(([^)]*)\)([^;]*);/\nDO \$\$\nBEGIN\n\tIF to_regprocedure('$1($2)') IS NULL THEN\n\t\tCREATE AGGREGATE $1($2)$3;\n\tEND IF;\nEND\n\$\$;/gs;
 $sql =~ s/\nCREATE CAST[^;]*;//gs;
 
 print $sql;